@@ -20,6 +20,14 @@
 #define PROBLEM_MOTOR_PROTOCOL_DISABLED		1
 
 #define BF_MOTOR_MAX_NUM		16
+#define BF_BAUD_RATE_COUNT		16
+
+/* Betaflight baudrates */
+extern const uint32_t bf_baud_rates[BF_BAUD_RATE_COUNT];
+
+/* identifier and function of port in serial config */
+#define BF_SERIAL_PORT_VCP		20
+#define BF_SERIAL_FUNCTION_MSP		(1 << 0)
 
 enum {
 	MSP_REBOOT_FIRMWARE = 0,
@@ -37,8 +45,10 @@ typedef struct bf_board_info {
 } __attribute__((__packed__)) bf_board_info_t ;
 
 
+uint32_t bf_baud_rate(uint8_t index);
 int bf_board_info(serial_handle fd);
 int bf_reboot(serial_handle fd, int mode);
+int bf_eeprom_write(serial_handle fd);
 int bf_set_motor(serial_handle fd, int num, int *val);
 int bf_get_motor(serial_handle fd, int *num, int *val);
 int bf_send_dshot(serial_handle fd, int block, int motor, int num , int *val);
@@ -0,0 +1,17 @@
+/*
+ * serial bridge to pty or tcp
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#ifndef _BRIDGE_H_
+#define _BRIDGE_H_
+
+#include "serial.h"
+
+/* bytes moved by one splice or read */
+#define BRIDGE_BUF_SIZE		(64 * 1024)
+
+int bridge_run(serial_handle fd, const char *spec);
+
+#endif
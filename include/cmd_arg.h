@@ -7,6 +7,8 @@
 #ifndef _CMD_ARG_H_
 #define _CMD_ARG_H_
 
+#include <stdbool.h>
+
 typedef struct cmd_s {
 	const char *cmd;
 	const char *help;
@@ -20,6 +22,8 @@ int cmd_arg_copy(const char *buf, char *cmd, int len, char *arg, int arg_len);
 
 int cmd_arg_to_int(const char *arg, int *val, int len);
 
+int cmd_arg_to_set(const char *list, bool *set, int max);
+
 int cmd_arg_handle(void *env, const cmd_t *ctab, const char *cmd, const char *arg);
 
 int cmd_arg_exec(void *env, const char *args, const cmd_t *ctab, int (*help_cb)(void *, const char *));
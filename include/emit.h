@@ -0,0 +1,40 @@
+/*
+ * structured output
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#ifndef _EMIT_H_
+#define _EMIT_H_
+
+#include <stdint.h>
+
+/* output formats, text is printed by commands themselves */
+enum {
+	EMIT_TEXT = 0,
+	EMIT_JSON,
+	EMIT_CBOR,
+};
+
+#define EMIT_BUF_SIZE			(16 * 1024)
+/* nested maps and arrays */
+#define EMIT_DEPTH			16
+
+int emit_format_parse(const char *name);
+void emit_set_format(int format);
+int emit_format(void);
+
+/*
+ * Values of map have key, values of array and top level one have key
+ * NULL. Document is written out when top level map or array ends.
+ */
+void emit_map(const char *key);
+void emit_array(const char *key);
+void emit_end(void);
+void emit_int(const char *key, int64_t v);
+void emit_float(const char *key, double v);
+/* up to len bytes or NUL, len -1 for NUL terminated */
+void emit_str(const char *key, const char *s, int len);
+void emit_flush(void);
+
+#endif
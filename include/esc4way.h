@@ -15,10 +15,30 @@
 #define ESC_FLASH_FIRMWARE_OFFT		0x1000
 #define ESC_FLASH_SETTINGS_OFFT		0x7c00
 #define ESC_FLASH_SETTINGS_SIZE		256
+#define ESC_FLASH_FIRMWARE_SIZE		(ESC_FLASH_SETTINGS_OFFT - ESC_FLASH_FIRMWARE_OFFT)
 
 
 #define ESC_SET_DEVICE_NAME_SIZE	12
 
+/* timeout to drop garbage after broken reply */
+#define ESC4WAY_RESYNC_TIMEOUT		0.05
+
+/* attempts to transfer a block */
+#define ESC4WAY_RETRY_MAX		5
+/* first backoff, doubled on each retry */
+#define ESC4WAY_RETRY_BACKOFF_US	10000
+/* errors on a block before the chunk is halved */
+#define ESC4WAY_RETRY_SHRINK		2
+#define ESC4WAY_CHUNK_MIN		32
+
+#define ESC4WAY_UID_SIZE		12
+
+/* channels with settings cache */
+#define ESC4WAY_CHAN_MAX		16
+
+/* retry counters per 256 bytes block of 64K address space */
+#define ESC4WAY_STAT_BLOCKS		256
+
 
 #define ESC_KV_TO_SET(x)		((x - 20) / 40)
 #define ESC_SET_TO_KV(x)		(x * 40 + 20)
@@ -96,30 +116,62 @@ struct settings {
 } __attribute__((packed));
 
 
+typedef struct esc_set_cache {
+	union {
+		uint8_t byte[ESC_FLASH_SETTINGS_SIZE];
+		struct settings name;
+	} __attribute__((__packed__)) data;
+	/* bytes changed since read or last write */
+	uint8_t dirty[ESC_FLASH_SETTINGS_SIZE / 8];
+	bool cached;
+} esc_set_cache_t;
+
 typedef struct esc4way {
 	serial_handle fd;
+	/* device name, identifies state files */
+	const char *dev;
+	/* last received ack */
+	int ack;
+	/* number of esc reported by passthrough, 0 if unknown */
+	int chans;
+	/* UID of FC the esc are connected to */
+	uint8_t uid[ESC4WAY_UID_SIZE];
+	/* channel with initialized flash access */
 	struct {
-		union {
-			uint8_t byte[1024];
-			struct settings name;
-		} __attribute__((__packed__)) data;
+		int chan;
+		bool valid;
+		uint8_t dev_info[4];
+	} sel;
+	struct {
+		esc_set_cache_t chan[ESC4WAY_CHAN_MAX];
 		unsigned int addr;
 		unsigned int size;
-		bool cached;
 	} set;
 	struct {
 		unsigned int addr;
 	} fw;
+	struct {
+		uint8_t retries[ESC4WAY_STAT_BLOCKS];
+		unsigned int total;
+	} stat;
 } esc4way_t;
 
 esc4way_t *esc4way_init(serial_handle fd);
-int esc4way_settings_cache(esc4way_t *esc);
+esc_set_cache_t *esc4way_settings(esc4way_t *esc, int chan);
+int esc4way_settings_read(esc4way_t *esc, int chan, void *buf, int len);
+int esc4way_settings_set(esc4way_t *esc, int chan, int offt, const void *buf, int len);
+int esc4way_settings_dirty(esc4way_t *esc, int chan);
+int esc4way_settings_commit(esc4way_t *esc, int chan);
+int esc4way_settings_commit_all(esc4way_t *esc);
+void esc4way_settings_invalidate(esc4way_t *esc, int chan);
 int esc4way_read_flash(esc4way_t *esc, int addr, void *buf, int len);
 int esc4way_write_flash(esc4way_t *esc, int addr, const void *buf, int len);
+int esc4way_verify_flash(esc4way_t *esc, int addr, const void *buf, int len);
 int esc4way_select_chan(esc4way_t *esc, int addr, int chan);
-int esc4way_mark_flash(esc4way_t *esc, const char *mark);
-int esc4way_boot_flash(esc4way_t *esc, int mark);
-int esc4way_set_version(esc4way_t *esc, int major, int minor);
+void esc4way_invalidate(esc4way_t *esc);
+int esc4way_mark_flash(esc4way_t *esc, int chan, const char *mark);
+int esc4way_boot_flash(esc4way_t *esc, int chan, int mark);
+int esc4way_set_version(esc4way_t *esc, int chan, int major, int minor);
 int esc4way_exit(esc4way_t *esc);
 int esc4way_reset(esc4way_t *esc, int chan);
 int esc4way_interface_name(esc4way_t *esc, char *name, int len);
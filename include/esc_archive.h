@@ -0,0 +1,62 @@
+/*
+ * esc image archive
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#ifndef _ESC_ARCHIVE_H_
+#define _ESC_ARCHIVE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sha256.h"
+
+#define ESC_ARCHIVE_MAGIC		0x31414642	/* BFA1 */
+#define ESC_ARCHIVE_UID_SIZE		12
+
+/* record types */
+#define ESC_ARCHIVE_BLOB		1
+#define ESC_ARCHIVE_ENTRY		2
+
+/* kinds of image */
+#define ESC_ARCHIVE_FIRMWARE		0
+#define ESC_ARCHIVE_SETTINGS		1
+
+typedef struct esc_archive_entry {
+	uint8_t uid[ESC_ARCHIVE_UID_SIZE];
+	uint8_t chan;
+	uint8_t kind;
+	uint16_t reserved;
+	uint32_t addr;
+	uint32_t size;
+	uint64_t time;
+	uint8_t hash[SHA256_SIZE];
+} __attribute__((__packed__)) esc_archive_entry_t;
+
+typedef struct esc_archive_blob {
+	uint8_t hash[SHA256_SIZE];
+	/* offset of data in archive file */
+	long offt;
+	uint32_t size;
+} esc_archive_blob_t;
+
+typedef struct esc_archive {
+	int fd;
+	/* opened for write, read only archive is never created nor changed */
+	bool write;
+	char fname[512];
+	esc_archive_blob_t *blob;
+	int blobs;
+	esc_archive_entry_t *entry;
+	int entries;
+} esc_archive_t;
+
+esc_archive_t *esc_archive_open(const char *fname, bool write);
+void esc_archive_close(esc_archive_t *a);
+int esc_archive_put(esc_archive_t *a, esc_archive_entry_t *e, const void *data);
+const esc_archive_entry_t *esc_archive_find(esc_archive_t *a, const uint8_t *uid,
+					    int chan, int kind, uint64_t time);
+int esc_archive_get(esc_archive_t *a, const uint8_t *hash, void *buf, int len);
+
+#endif
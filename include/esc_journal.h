@@ -0,0 +1,68 @@
+/*
+ * esc flash journal
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#ifndef _ESC_JOURNAL_H_
+#define _ESC_JOURNAL_H_
+
+#include <stdint.h>
+
+#include "sha256.h"
+
+#define ESC_JOURNAL_MAGIC		0x324a4642	/* BFJ2 */
+#define ESC_JOURNAL_BLOCK_SIZE		256
+#define ESC_JOURNAL_BLOCKS		256
+/* save journal every number of written blocks */
+#define ESC_JOURNAL_SAVE_BLOCKS		8
+/* FC UID and esc device info */
+#define ESC_JOURNAL_UID_SIZE		16
+
+/* flashall steps already done */
+#define ESC_JOURNAL_BOOT_CLEAR		(1 << 0)
+#define ESC_JOURNAL_MARK_FAIL		(1 << 1)
+#define ESC_JOURNAL_VERSION		(1 << 2)
+#define ESC_JOURNAL_FLASHED		(1 << 3)
+#define ESC_JOURNAL_MARK_NOT_READY	(1 << 4)
+#define ESC_JOURNAL_BOOT_SET		(1 << 5)
+
+typedef struct esc_journal {
+	char path[512];
+	struct {
+		uint32_t magic;
+		uint8_t uid[ESC_JOURNAL_UID_SIZE];
+		uint8_t hash[SHA256_SIZE];
+		uint32_t addr;
+		uint32_t size;
+		uint32_t marks;
+		/* blocks written and acknowledged */
+		uint8_t blocks[ESC_JOURNAL_BLOCKS / 8];
+	} __attribute__((__packed__)) rec;
+} esc_journal_t;
+
+int esc_journal_open(esc_journal_t *j, const char *dev, int chan,
+		     const uint8_t *uid, const uint8_t *hash, int addr, int size);
+int esc_journal_save(esc_journal_t *j);
+int esc_journal_mark(esc_journal_t *j, uint32_t mark);
+void esc_journal_remove(esc_journal_t *j);
+
+static inline int esc_journal_done(const esc_journal_t *j, uint32_t mark)
+{
+	return j && (j->rec.marks & mark) == mark;
+}
+
+static inline int esc_journal_block(const esc_journal_t *j, int blk)
+{
+	if (blk >= ESC_JOURNAL_BLOCKS)
+		return 0;
+	return j->rec.blocks[blk / 8] & (1 << (blk % 8));
+}
+
+static inline void esc_journal_set_block(esc_journal_t *j, int blk)
+{
+	if (blk < ESC_JOURNAL_BLOCKS)
+		j->rec.blocks[blk / 8] |= 1 << (blk % 8);
+}
+
+#endif
@@ -0,0 +1,31 @@
+/*
+ * file input/output helpers
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#ifndef _FILE_IO_H_
+#define _FILE_IO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct file_map {
+	const uint8_t *data;
+	size_t size;
+	int mapped;
+} file_map_t;
+
+int file_map(const char *fname, file_map_t *map);
+void file_unmap(file_map_t *map);
+
+/* Size of each of the two buffers of background writer */
+#define FILE_WRITER_BUF_SIZE		(16 * 1024)
+
+typedef struct file_writer file_writer_t;
+
+file_writer_t *file_writer_open(const char *fname);
+int file_writer_write(file_writer_t *fw, const void *data, int len);
+int file_writer_close(file_writer_t *fw);
+
+#endif
@@ -0,0 +1,23 @@
+/*
+ * msp capture
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#ifndef _MSP_CAPTURE_H_
+#define _MSP_CAPTURE_H_
+
+#include "serial.h"
+
+/* requests sent and not answered yet */
+#define MSP_CAPTURE_INFLIGHT		4
+/* longest capture, seconds */
+#define MSP_CAPTURE_SECONDS_MAX		3600
+
+/*
+ * Request MSP_RAW_IMU and MSP_ATTITUDE hz times a second, 0 for as fast
+ * as FC answers, and log replies in msp_codec_log() records
+ */
+int msp_capture_imu(serial_handle fd, int hz, int seconds, const char *fname);
+
+#endif
@@ -7,16 +7,29 @@
 #ifndef _MSP_CMD_H_
 #define _MSP_CMD_H_
 
+#include <stdbool.h>
+
 #include "serial.h"
 #include "esc4way.h"
 
 typedef struct msp {
 	serial_handle fd;
+	const char *dev;
+	/* baud rate of serial link */
+	unsigned int baud;
+	/*
+	 * Rate to fall back to if cached baud rate is of other FC, it is
+	 * checked before the first MSP command, 0 if there is no check
+	 */
+	unsigned int baud_check;
 	esc4way_t *esc;
+	/* FC configuration changed by setters, EEPROM is not written yet */
+	bool eeprom_dirty;
 } msp_t;
 
 int msp_exec_cmd(msp_t *msp, const char *cmd);
 int msp_usage(msp_t *msp, const char *arg);
 int esc_usage(esc4way_t *esc, const char *arg);
+unsigned int msp_baud_cached(const char *dev);
 
 #endif
@@ -0,0 +1,129 @@
+/*
+ * msp codec
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#ifndef _MSP_CODEC_H_
+#define _MSP_CODEC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "msp.h"
+#include "msp_protocol.h"
+#include "file_io.h"
+
+/* field types */
+enum {
+	MSP_CODEC_U8 = 0,
+	MSP_CODEC_U16,
+	MSP_CODEC_U32,
+	MSP_CODEC_I8,
+	MSP_CODEC_I16,
+	MSP_CODEC_I32,
+};
+
+/* field formats */
+enum {
+	MSP_CODEC_DEC = 0,
+	MSP_CODEC_HEX,
+	/* Betaflight baud rate index */
+	MSP_CODEC_BAUD,
+};
+
+/* message kinds */
+enum {
+	MSP_CODEC_ONE = 0,
+	MSP_CODEC_COUNT,
+	MSP_CODEC_ARRAY,
+};
+
+typedef struct msp_codec_field {
+	const char *name;
+	const char *label;
+	uint8_t type;
+	uint8_t fmt;
+	uint16_t offt;
+	/* value is multiplied by */
+	int scale;
+} msp_codec_field_t;
+
+typedef struct msp_codec_msg {
+	const char *name;
+	const char *title;
+	uint16_t cmd;
+	uint8_t kind;
+	/* size of record */
+	uint16_t size;
+	const msp_codec_field_t *field;
+	int fields;
+} msp_codec_msg_t;
+
+/* record of binary log, size bytes of payload follow */
+typedef struct msp_codec_log_rec {
+	double time;
+	uint16_t cmd;
+	uint16_t size;
+} __attribute__((__packed__)) msp_codec_log_rec_t;
+
+#define MSP_CODEC_CTYPE_U8		uint8_t
+#define MSP_CODEC_CTYPE_U16		uint16_t
+#define MSP_CODEC_CTYPE_U32		uint32_t
+#define MSP_CODEC_CTYPE_I8		int8_t
+#define MSP_CODEC_CTYPE_I16		int16_t
+#define MSP_CODEC_CTYPE_I32		int32_t
+
+/* records as they are on the wire, msp_analog_t etc */
+#define MSP_MSG(msg, cmd, kind, title)			typedef struct msp_##msg {
+#define MSP_FIELD(msg, type, name, label, fmt, scale)	MSP_CODEC_CTYPE_##type name;
+#define MSP_MSG_END(msg, size)				} __attribute__((__packed__)) msp_##msg##_t; \
+	_Static_assert(sizeof(msp_##msg##_t) == (size), "msp_" #msg "_t size");
+#include "msp_codec_def.h"
+#undef MSP_MSG
+#undef MSP_FIELD
+#undef MSP_MSG_END
+
+/* index of message in msp_codec_msgs, MSP_CODEC_ID_analog etc */
+#define MSP_MSG(msg, cmd, kind, title)			MSP_CODEC_ID_##msg,
+#define MSP_FIELD(msg, type, name, label, fmt, scale)
+#define MSP_MSG_END(msg, size)
+enum {
+#include "msp_codec_def.h"
+	MSP_CODEC_ID_COUNT
+};
+#undef MSP_MSG
+#undef MSP_FIELD
+#undef MSP_MSG_END
+
+extern const msp_codec_msg_t msp_codec_msgs[];
+
+const msp_codec_msg_t *msp_codec_find(uint16_t cmd);
+const msp_codec_msg_t *msp_codec_find_name(const char *name);
+/* number of records in payload */
+int msp_codec_count(const msp_codec_msg_t *m, const void *data, int len);
+/* record i of payload, NULL if payload is short */
+const void *msp_codec_rec(const msp_codec_msg_t *m, const void *data, int len, int i);
+int64_t msp_codec_value(const msp_codec_field_t *f, const void *rec);
+
+/* print records, all of them if index is -1 */
+void msp_codec_printf(const msp_codec_msg_t *m, const void *data, int len, int index);
+/* JSON or CBOR of --format */
+void msp_codec_emit(const msp_codec_msg_t *m, const void *data, int len, int index);
+int msp_codec_log(file_writer_t *fw, double t, uint16_t cmd, const void *data, int len);
+
+/* typed zero copy accessors, msp_codec_analog(data, len, 0)->vbat */
+#define MSP_MSG(msg, cmd, kind, title)						\
+static inline const msp_##msg##_t *msp_codec_##msg(const void *data, int len, int i)	\
+{										\
+	return msp_codec_rec(&msp_codec_msgs[MSP_CODEC_ID_##msg], data, len, i);	\
+}
+#define MSP_FIELD(msg, type, name, label, fmt, scale)
+#define MSP_MSG_END(msg, size)
+#include "msp_codec_def.h"
+#undef MSP_MSG
+#undef MSP_FIELD
+#undef MSP_MSG_END
+
+#endif
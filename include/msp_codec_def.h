@@ -0,0 +1,120 @@
+/*
+ * msp codec messages
+ *
+ * Included by msp_codec.h and msp_codec.c with MSP_MSG, MSP_FIELD and
+ * MSP_MSG_END defined:
+ *   MSP_MSG(msg, cmd, kind, title)
+ *   MSP_FIELD(msg, type, name, label, fmt, scale)
+ *   MSP_MSG_END(msg, size)
+ * kind is ONE record, COUNT of records in u8 in front or ARRAY of records
+ * up to end of payload, size is size of record on the wire.
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+MSP_MSG(api_version, MSP_API_VERSION, ONE, "API version")
+	MSP_FIELD(api_version, U8, protocol, "Protocol", DEC, 1)
+	MSP_FIELD(api_version, U8, major, "Major", DEC, 1)
+	MSP_FIELD(api_version, U8, minor, "Minor", DEC, 1)
+MSP_MSG_END(api_version, 3)
+
+MSP_MSG(raw_imu, MSP_RAW_IMU, ONE, "Raw IMU")
+	MSP_FIELD(raw_imu, I16, acc_x, "Acc X", DEC, 1)
+	MSP_FIELD(raw_imu, I16, acc_y, "Acc Y", DEC, 1)
+	MSP_FIELD(raw_imu, I16, acc_z, "Acc Z", DEC, 1)
+	MSP_FIELD(raw_imu, I16, gyro_x, "Gyro X", DEC, 1)
+	MSP_FIELD(raw_imu, I16, gyro_y, "Gyro Y", DEC, 1)
+	MSP_FIELD(raw_imu, I16, gyro_z, "Gyro Z", DEC, 1)
+	MSP_FIELD(raw_imu, I16, mag_x, "Mag X", DEC, 1)
+	MSP_FIELD(raw_imu, I16, mag_y, "Mag Y", DEC, 1)
+	MSP_FIELD(raw_imu, I16, mag_z, "Mag Z", DEC, 1)
+MSP_MSG_END(raw_imu, 18)
+
+MSP_MSG(motor, MSP_MOTOR, ARRAY, "Motor values")
+	MSP_FIELD(motor, U16, value, "Value", DEC, 1)
+MSP_MSG_END(motor, 2)
+
+MSP_MSG(rc, MSP_RC, ARRAY, "RC channels")
+	MSP_FIELD(rc, U16, value, "Value", DEC, 1)
+MSP_MSG_END(rc, 2)
+
+MSP_MSG(attitude, MSP_ATTITUDE, ONE, "Attitude")
+	MSP_FIELD(attitude, I16, roll, "Roll 0.1 deg", DEC, 1)
+	MSP_FIELD(attitude, I16, pitch, "Pitch 0.1 deg", DEC, 1)
+	MSP_FIELD(attitude, I16, yaw, "Yaw deg", DEC, 1)
+MSP_MSG_END(attitude, 6)
+
+MSP_MSG(altitude, MSP_ALTITUDE, ONE, "Altitude")
+	MSP_FIELD(altitude, I32, alt, "Altitude cm", DEC, 1)
+	MSP_FIELD(altitude, I16, vario, "Vario cm/s", DEC, 1)
+MSP_MSG_END(altitude, 6)
+
+MSP_MSG(raw_gps, MSP_RAW_GPS, ONE, "GPS")
+	MSP_FIELD(raw_gps, U8, fix, "Fix", DEC, 1)
+	MSP_FIELD(raw_gps, U8, num_sat, "Satellites", DEC, 1)
+	MSP_FIELD(raw_gps, I32, lat, "Latitude 1e-7 deg", DEC, 1)
+	MSP_FIELD(raw_gps, I32, lon, "Longitude 1e-7 deg", DEC, 1)
+	MSP_FIELD(raw_gps, U16, alt, "Altitude m", DEC, 1)
+	MSP_FIELD(raw_gps, U16, speed, "Speed cm/s", DEC, 1)
+	MSP_FIELD(raw_gps, U16, course, "Course 0.1 deg", DEC, 1)
+MSP_MSG_END(raw_gps, 16)
+
+MSP_MSG(set_raw_gps, MSP_SET_RAW_GPS, ONE, "GPS fix to FC")
+	MSP_FIELD(set_raw_gps, U8, fix, "Fix", DEC, 1)
+	MSP_FIELD(set_raw_gps, U8, num_sat, "Satellites", DEC, 1)
+	MSP_FIELD(set_raw_gps, I32, lat, "Latitude 1e-7 deg", DEC, 1)
+	MSP_FIELD(set_raw_gps, I32, lon, "Longitude 1e-7 deg", DEC, 1)
+	MSP_FIELD(set_raw_gps, U16, alt, "Altitude m", DEC, 1)
+	MSP_FIELD(set_raw_gps, U16, speed, "Speed cm/s", DEC, 1)
+MSP_MSG_END(set_raw_gps, 14)
+
+MSP_MSG(analog, MSP_ANALOG, ONE, "Analog data")
+	MSP_FIELD(analog, U8, vbat, "Battery 0.1 V", DEC, 1)
+	MSP_FIELD(analog, U16, mah, "Battery mAh", DEC, 1)
+	MSP_FIELD(analog, U16, rssi, "RSSI", DEC, 1)
+	MSP_FIELD(analog, I16, current, "Current mA", DEC, 10)
+	MSP_FIELD(analog, U16, voltage, "Battery 0.01 V", DEC, 1)
+MSP_MSG_END(analog, 9)
+
+MSP_MSG(battery_state, MSP_BATTERY_STATE, ONE, "Battery state")
+	MSP_FIELD(battery_state, U8, cells, "Cells", DEC, 1)
+	MSP_FIELD(battery_state, U16, capacity, "Capacity mAh", DEC, 1)
+	MSP_FIELD(battery_state, U8, vbat, "Battery 0.1 V", DEC, 1)
+	MSP_FIELD(battery_state, U16, mah, "Drawn mAh", DEC, 1)
+	MSP_FIELD(battery_state, U16, current, "Current mA", DEC, 10)
+	MSP_FIELD(battery_state, U8, state, "State", DEC, 1)
+	MSP_FIELD(battery_state, U16, voltage, "Battery 0.01 V", DEC, 1)
+MSP_MSG_END(battery_state, 11)
+
+MSP_MSG(motor_telemetry, MSP_MOTOR_TELEMETRY, COUNT, "Motor telemetry")
+	MSP_FIELD(motor_telemetry, U32, rpm, "RPM", DEC, 1)
+	MSP_FIELD(motor_telemetry, U16, invalid_pkt, "Invalid 0.01 %", DEC, 1)
+	MSP_FIELD(motor_telemetry, U8, temperature, "Temperature C", DEC, 1)
+	MSP_FIELD(motor_telemetry, U16, voltage, "Voltage 0.01 V", DEC, 1)
+	MSP_FIELD(motor_telemetry, U16, current, "Current 0.01 A", DEC, 1)
+	MSP_FIELD(motor_telemetry, U16, consumption, "Consumption mAh", DEC, 1)
+MSP_MSG_END(motor_telemetry, 13)
+
+MSP_MSG(uid, MSP_UID, ONE, "Unique ID")
+	MSP_FIELD(uid, U32, uid0, "UID 0", HEX, 1)
+	MSP_FIELD(uid, U32, uid1, "UID 1", HEX, 1)
+	MSP_FIELD(uid, U32, uid2, "UID 2", HEX, 1)
+MSP_MSG_END(uid, 12)
+
+MSP_MSG(tx_info, MSP_TX_INFO, ONE, "TX info")
+	MSP_FIELD(tx_info, U8, rssi_source, "RSSI source", DEC, 1)
+	MSP_FIELD(tx_info, U8, rtc_set, "Date and time is set", DEC, 1)
+MSP_MSG_END(tx_info, 2)
+
+MSP_MSG(debug, MSP_DEBUG, ARRAY, "Debug values")
+	MSP_FIELD(debug, I16, value, "Value", DEC, 1)
+MSP_MSG_END(debug, 2)
+
+MSP_MSG(serial_config, MSP2_COMMON_SERIAL_CONFIG, COUNT, "Serial ports")
+	MSP_FIELD(serial_config, U8, id, "Identifier", DEC, 1)
+	MSP_FIELD(serial_config, U32, functions, "Functions mask", HEX, 1)
+	MSP_FIELD(serial_config, U8, msp_baud, "MSP baud rate", BAUD, 1)
+	MSP_FIELD(serial_config, U8, gps_baud, "GPS baud rate", BAUD, 1)
+	MSP_FIELD(serial_config, U8, telemetry_baud, "Telemetry baud rate", BAUD, 1)
+	MSP_FIELD(serial_config, U8, blackbox_baud, "Black box baud rate", BAUD, 1)
+MSP_MSG_END(serial_config, 9)
@@ -0,0 +1,36 @@
+/*
+ * gps replay
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#ifndef _MSP_GPS_H_
+#define _MSP_GPS_H_
+
+#include "serial.h"
+
+/* replay speed factor */
+#define MSP_GPS_SPEED_MAX		1000
+#define MSP_GPS_LINE_MAX		256
+/* fields of NMEA sentence */
+#define MSP_GPS_FIELDS_MAX		24
+/* fix of MSP_SET_RAW_GPS */
+#define MSP_GPS_FIX_3D			2
+/* status line, seconds */
+#define MSP_GPS_REPORT_SEC		10
+
+/* track format */
+#define MSP_GPS_FORMAT_AUTO		0
+#define MSP_GPS_FORMAT_NMEA		1
+#define MSP_GPS_FORMAT_LOG		2
+
+/*
+ * Send fixes of a track to MSP_SET_RAW_GPS at times of the track divided
+ * by speed. Track is read as it is replayed, NMEA log of GGA and RMC
+ * sentences or binary log of msp_codec_log() records of MSP_RAW_GPS or
+ * MSP_SET_RAW_GPS. Sentences of one UTC time make one fix. Format is
+ * found by start of the track if it is MSP_GPS_FORMAT_AUTO.
+ */
+int msp_gps_replay(serial_handle fd, const char *fname, double speed, int format);
+
+#endif
@@ -0,0 +1,41 @@
+/*
+ * osd view
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#ifndef _MSP_OSD_H_
+#define _MSP_OSD_H_
+
+#include "serial.h"
+
+/* sub commands of MSP_DISPLAYPORT */
+enum {
+	MSP_OSD_HEARTBEAT = 0,
+	MSP_OSD_RELEASE,
+	MSP_OSD_CLEAR_SCREEN,
+	MSP_OSD_WRITE_STRING,
+	MSP_OSD_DRAW_SCREEN,
+	MSP_OSD_OPTIONS,
+	MSP_OSD_SYS,
+};
+
+/* attribute of MSP_OSD_WRITE_STRING, font page is severity */
+#define MSP_OSD_ATTR_PAGE_MASK		0x03
+#define MSP_OSD_ATTR_BLINK		0x40
+
+#define MSP_OSD_COLS_MAX		64
+#define MSP_OSD_ROWS_MAX		32
+/* grid is drawn after, if FC sends no draw screen */
+#define MSP_OSD_DRAW_MS			100
+/* unchanged cells reprinted instead of moving cursor */
+#define MSP_OSD_GAP_MAX			4
+
+/*
+ * Mirror displayport OSD of FC on the terminal until Ctrl-C, only cells
+ * which changed since the last draw are sent to terminal. Canvas size is
+ * set if cols and rows are not 0, FC port has to be MSP displayport.
+ */
+int msp_osd_view(serial_handle fd, int cols, int rows);
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * msp stream parser
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#ifndef _MSP_PARSER_H_
+#define _MSP_PARSER_H_
+
+#include <stdint.h>
+
+/* largest payload accepted, longer frames are dropped */
+#define MSP_PARSER_PAYLOAD_MAX		1024
+/* $ M/X dir, v2 header and crc */
+#define MSP_PARSER_FRAME_MAX		(3 + 5 + MSP_PARSER_PAYLOAD_MAX + 1)
+
+typedef struct msp_frame {
+	/* 1 or 2 */
+	uint8_t version;
+	/* '<' request, '>' reply, '!' error */
+	uint8_t dir;
+	uint8_t flags;
+	uint16_t cmd;
+	uint16_t size;
+	const uint8_t *payload;
+	/* frame as received, with header and crc */
+	const uint8_t *raw;
+	int raw_len;
+} msp_frame_t;
+
+typedef struct msp_parser {
+	int state;
+	int len;
+	/* bytes of frame still expected in current state */
+	int need;
+	unsigned int frames;
+	unsigned int errors;
+	msp_frame_t frame;
+	uint8_t buf[MSP_PARSER_FRAME_MAX];
+} msp_parser_t;
+
+void msp_parser_init(msp_parser_t *p);
+int msp_parser_feed(msp_parser_t *p, const uint8_t *data, int len, const msp_frame_t **frame);
+int msp_parser_want(const msp_parser_t *p);
+
+#endif
@@ -0,0 +1,24 @@
+/*
+ * msp proxy
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#ifndef _MSP_PROXY_H_
+#define _MSP_PROXY_H_
+
+#include "serial.h"
+
+#define MSP_PROXY_CLIENTS		16
+/* requests waiting for the link */
+#define MSP_PROXY_QUEUE			64
+/* replies of read only requests */
+#define MSP_PROXY_CACHE			64
+/* time cached reply is used, milliseconds */
+#define MSP_PROXY_TTL_DEFAULT		50
+/* replies not written to slow client yet */
+#define MSP_PROXY_OUT_SIZE		(16 * 1024)
+
+int msp_proxy_run(serial_handle fd, const char *spec, int ttl_ms);
+
+#endif
@@ -0,0 +1,39 @@
+/*
+ * rc stream
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#ifndef _MSP_RC_H_
+#define _MSP_RC_H_
+
+#include "serial.h"
+
+/* channels of MSP_SET_RAW_RC, Betaflight supports 18 */
+#define MSP_RC_CHANNELS_MAX		18
+/* roll, pitch, throttle and yaw at least */
+#define MSP_RC_CHANNELS_MIN		4
+#define MSP_RC_VALUE_MIN		750
+#define MSP_RC_VALUE_MAX		2250
+#define MSP_RC_HZ_MAX			500
+/* input is stalled after, milliseconds */
+#define MSP_RC_STALL_MS_DEFAULT		300
+/* failsafe frames are sent before control is released, milliseconds */
+#define MSP_RC_RELEASE_MS		200
+/* sent frames of which replies are timed */
+#define MSP_RC_INFLIGHT			32
+/* status line, seconds */
+#define MSP_RC_REPORT_SEC		10
+#define MSP_RC_LINE_MAX			256
+
+/*
+ * Send channel frames of file or stdin ("-") to MSP_SET_RAW_RC hz times
+ * a second. Line is a frame of channel values in AETR order. Lines of
+ * regular file are sent one per tick, of pipe the latest one is repeated.
+ * When input stalls or ends, failsafe frame (sticks centered, throttle
+ * and aux low) is sent for MSP_RC_RELEASE_MS and then nothing, so FC
+ * falls back to its own failsafe.
+ */
+int msp_rc_stream(serial_handle fd, const char *src, int hz, int stall_ms);
+
+#endif
@@ -6,6 +6,9 @@
 #ifndef _MSP_SERIAL_H_
 #define _MSP_SERIAL_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+
 #include "serial.h"
 
 #define MSP_DIR_IN		0
@@ -14,9 +17,35 @@
 int msp_raw_transmit(serial_handle fd, const void *out, int out_size,
 		     void *in, int in_size);
 
+int msp_encode(void *buf, int size, uint16_t cmd, int dir, const void *data, int len);
+
 int msp_transmit(serial_handle fd, uint16_t cmd, int dir, const void *out, int out_size,
 		 void *in, int in_size);
 
+/* Betaflight CLI prompt, output of each command line ends with it */
+#define MSP_CLI_PROMPT		"\r\n# "
+/*
+ * Upper bound of CLI output drain, pauses between its lines depend on FC,
+ * not on the link, e.g. while diff all or dump is built
+ */
+#define MSP_CLI_DRAIN_TIMEOUT	0.2
+
+typedef struct msp_cli {
+	/* bytes of prompt matched at the end of output */
+	int match;
+	int prompts;
+	/* output is printed */
+	int pr;
+} msp_cli_t;
+
+/*
+ * Read CLI output which comes in tmo seconds, up to size - 1 bytes, return
+ * number of bytes, 0 if nothing comes, or -1
+ */
+int msp_cli_read(serial_handle fd, msp_cli_t *cli, double tmo, char *buf, int size);
+/* output ends with prompt */
+bool msp_cli_at_prompt(const msp_cli_t *cli);
+
 int msp_cmd_transmit(serial_handle fd, const char *out, char *in, int in_size, int pr);
 
 #endif
@@ -0,0 +1,42 @@
+/*
+ * msp configuration snapshot
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#ifndef _MSP_SNAPSHOT_H_
+#define _MSP_SNAPSHOT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "serial.h"
+
+#define MSP_SNAPSHOT_MAGIC		0x31534642	/* BFS1 */
+#define MSP_SNAPSHOT_UID_SIZE		12
+/* largest getter reply msp_transmit takes, 256 bytes frame */
+#define MSP_SNAPSHOT_SECT_MAX		247
+
+typedef struct msp_snapshot_hdr {
+	uint32_t magic;
+	/* MSP_API_VERSION reply: protocol, major, minor */
+	uint8_t api[3];
+	uint8_t reserved;
+	uint8_t uid[MSP_SNAPSHOT_UID_SIZE];
+	uint64_t time;
+} __attribute__((__packed__)) msp_snapshot_hdr_t;
+
+/* section record, size bytes of getter reply follow */
+typedef struct msp_snapshot_rec {
+	uint16_t cmd;
+	uint16_t size;
+} __attribute__((__packed__)) msp_snapshot_rec_t;
+
+int msp_snapshot_save(serial_handle fd, const char *fname);
+/*
+ * Send setters of sections which differ from FC, return number of
+ * sections written, EEPROM write is up to caller
+ */
+int msp_snapshot_restore(serial_handle fd, const char *fname, bool dry, bool force);
+
+#endif
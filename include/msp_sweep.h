@@ -0,0 +1,28 @@
+/*
+ * motor sweep
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#ifndef _MSP_SWEEP_H_
+#define _MSP_SWEEP_H_
+
+#include <stdbool.h>
+
+#include "serial.h"
+
+/* largest motor value of MSP_SET_MOTOR */
+#define MSP_SWEEP_VALUE_MAX		2000
+#define MSP_SWEEP_STEPS_MAX		1000
+/* first 1/n of dwell motor settles, telemetry is not counted */
+#define MSP_SWEEP_SETTLE_DIV		4
+
+/*
+ * Step motors[num] from value to value, other motors are off, sample
+ * telemetry back to back during dwell and print statistics of each step.
+ * Motors are stopped at the end, on error and on Ctrl-C.
+ */
+int msp_sweep_run(serial_handle fd, const bool *motors, int num, int from, int to,
+		  int step, int dwell_ms);
+
+#endif
@@ -0,0 +1,27 @@
+/*
+ * motor waveform
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#ifndef _MSP_WAVE_H_
+#define _MSP_WAVE_H_
+
+#include "serial.h"
+
+#define MSP_WAVE_HZ_MAX			1000
+/* largest motor value of MSP_SET_MOTOR */
+#define MSP_WAVE_VALUE_MAX		2000
+/* longest waveform, ticks */
+#define MSP_WAVE_TICKS_MAX		(600 * MSP_WAVE_HZ_MAX)
+
+/*
+ * Stream rows of motor values to MSP_SET_MOTOR hz times a second without
+ * waiting for replies. File is CSV, a row of up to motors values per
+ * line, # comments, or binary (name ends with .bin) of u16 little endian
+ * rows of motors values. Motors are stopped at the end, on error and on
+ * Ctrl-C.
+ */
+int msp_wave_run(serial_handle fd, const char *fname, int hz, int motors);
+
+#endif
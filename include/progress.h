@@ -0,0 +1,24 @@
+/*
+ * progress meter
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#ifndef _PROGRESS_H_
+#define _PROGRESS_H_
+
+typedef struct progress {
+	unsigned int total;
+	unsigned int base;
+	double start;
+	double last;
+} progress_t;
+
+/* minimal interval between progress lines, seconds */
+#define PROGRESS_INTERVAL		0.1
+
+void progress_start(progress_t *pr, unsigned int total, unsigned int base);
+void progress_update(progress_t *pr, unsigned int done);
+void progress_done(progress_t *pr, unsigned int done);
+
+#endif
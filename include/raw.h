@@ -0,0 +1,18 @@
+/*
+ * raw serial transfer
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#ifndef _RAW_H_
+#define _RAW_H_
+
+#include "serial.h"
+
+#define RAW_BUF_SIZE		(64 * 1024)
+/* stop after no data is received for, milliseconds */
+#define RAW_WAIT_DEFAULT	500
+
+int raw_run(serial_handle fd, const char *arg, int wait_ms);
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ * link round trip time model
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#ifndef _RTT_H_
+#define _RTT_H_
+
+#include "serial.h"
+
+enum {
+	RTT_MSP = 0,
+	RTT_CLI,
+	RTT_4WAY_READ,
+	RTT_4WAY_WRITE,
+	RTT_4WAY_ERASE,
+	RTT_4WAY_CTRL,
+	RTT_COUNT,
+};
+
+typedef struct rtt {
+	const char *name;
+	/* smoothed round trip time and its variance, seconds */
+	double srtt;
+	double rttvar;
+	/* current timeout */
+	double rto;
+	double min;
+	double max;
+	unsigned int samples;
+	unsigned int timeouts;
+} rtt_t;
+
+rtt_t *rtt_model(int id);
+void rtt_update(rtt_t *r, double sample);
+void rtt_backoff(rtt_t *r);
+int rtt_set_timeout(serial_handle fd, int id);
+
+int rtt_load(const char *dev);
+int rtt_save(const char *dev);
+void rtt_printf(void);
+
+#endif
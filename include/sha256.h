@@ -0,0 +1,29 @@
+/*
+ * sha256
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#ifndef _SHA256_H_
+#define _SHA256_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHA256_SIZE		32
+
+typedef struct sha256 {
+	uint32_t state[8];
+	uint64_t len;
+	uint8_t buf[64];
+	unsigned int fill;
+} sha256_t;
+
+void sha256_init(sha256_t *ctx);
+void sha256_update(sha256_t *ctx, const void *data, size_t len);
+void sha256_final(sha256_t *ctx, uint8_t *hash);
+
+void sha256(const void *data, size_t len, uint8_t *hash);
+void sha256_str(const uint8_t *hash, char *str);
+
+#endif
@@ -0,0 +1,14 @@
+/*
+ * per device state files
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#ifndef _STATE_H_
+#define _STATE_H_
+
+#define STATE_DIR_NAME		".bfctl"
+
+int state_path(char *path, int len, const char *dev, const char *name);
+
+#endif
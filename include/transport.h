@@ -0,0 +1,40 @@
+/*
+ * link transport
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#ifndef _TRANSPORT_H_
+#define _TRANSPORT_H_
+
+#include "serial.h"
+
+/* links open at the same time */
+#define TRANSPORT_OPEN_MAX		4
+/* read timeout of stream links until set, seconds */
+#define TRANSPORT_TIMEOUT_DEFAULT	0.2
+
+/*
+ * Device is chosen by name:
+ *   tcp://host:port	MSP on tcp, Betaflight SITL or network bridge
+ *   pty:/dev/pts/N	pseudo terminal, /dev/pts/N works as well
+ *   anything else	serial port
+ */
+serial_handle transport_open(const char *dev);
+int transport_setup(serial_handle fd, unsigned int baud);
+int transport_set_timeout(serial_handle fd, double t);
+int transport_read(serial_handle fd, void *buf, int len);
+int transport_write(serial_handle fd, const void *buf, int len);
+int transport_close(serial_handle fd);
+/*
+ * Descriptor to wait for input of link on, -1 if handle is not one
+ * (serial port on Windows). Input is read with transport_read() and
+ * timeout 0, which returns what is received already.
+ */
+int transport_fd(serial_handle fd);
+/* wait up to tmo seconds for input, 1 if it is there, 0 on timeout */
+int transport_poll(serial_handle fd, double tmo);
+/* "serial", "tcp" or "pty" */
+const char *transport_name(serial_handle fd);
+
+#endif
@@ -0,0 +1,23 @@
+/*
+ * monotonic time stamps
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#ifndef _TSTAMP_H_
+#define _TSTAMP_H_
+
+#include <time.h>
+
+/*
+ * Seconds since an arbitrary fixed point, CLOCK_MONOTONIC
+ */
+static inline double tstamp(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#endif
@@ -7,6 +7,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
 
 #include "bf.h"
@@ -15,9 +16,26 @@
 #include "dshot.h"
 
 #include "dump_hex.h"
+#include "emit.h"
 
 #define bit_is_set(v, b)		((v) & (1 << (b)))
 
+const uint32_t bf_baud_rates[BF_BAUD_RATE_COUNT] = {
+	0, 9600, 19200, 38400, 57600, 115200, 230400, 250000,
+	400000, 460800, 500000, 921600, 1000000, 1500000, 2000000, 2470000
+};
+
+/*
+ * Baud rate of index in betaflight serial config, 0 if out of range
+ */
+uint32_t bf_baud_rate(uint8_t index)
+{
+	if (index >= BF_BAUD_RATE_COUNT)
+		index = 0;
+
+	return bf_baud_rates[index];
+}
+
 static void dump_board_info(const void *data, unsigned int data_len)
 {
 	const uint8_t *p;
@@ -71,6 +89,79 @@ static void dump_board_info(const void *data, unsigned int data_len)
 	printf("I2C devices:\t%d\n", *p++);
 }
 
+/* string with u8 length in front, false if payload is short */
+static bool emit_board_str(const char *key, const uint8_t **p, const uint8_t *end)
+{
+	unsigned int len;
+
+	if (*p >= end || (len = **p) > end - *p - 1)
+		return false;
+
+	emit_str(key, (const char *)*p + 1, len);
+	*p += len + 1;
+	return true;
+}
+
+/*
+ * Same fields as dump_board_info(), short payload ends the map early
+ */
+static void emit_board_info(const void *data, unsigned int data_len)
+{
+	const uint8_t *p = data, *end = p + data_len;
+	char sig[SIGNATURE_LENGTH * 2 + 1];
+	uint32_t problems;
+	uint16_t rate;
+	size_t len;
+	int i;
+
+	emit_map(NULL);
+
+	len = strnlen((const char *)p, data_len);
+	emit_str("board_id", (const char *)p, len);
+	p += len + 1;
+	if (p + 2 > end)
+		goto out;
+	emit_int("hw_revision", *p++);
+	emit_int("max7456", *p++ == 2);
+
+	if (p >= end)
+		goto out;
+	emit_map("capabilities");
+	emit_int("vcp", !!bit_is_set(*p, TARGET_HAS_VCP));
+	emit_int("softserial", !!bit_is_set(*p, TARGET_HAS_SOFTSERIAL));
+	emit_int("flash_bootloader", !!bit_is_set(*p, TARGET_HAS_FLASH_BOOTLOADER));
+	emit_int("rx_bind", !!bit_is_set(*p, TARGET_SUPPORTS_RX_BIND));
+	emit_end();
+	p++;
+
+	if (!emit_board_str("target_name", &p, end) ||
+	    !emit_board_str("board_name", &p, end) ||
+	    !emit_board_str("manufacturer_id", &p, end))
+		goto out;
+
+	if (p + SIGNATURE_LENGTH + 10 > end)
+		goto out;
+	for (i = 0; i < SIGNATURE_LENGTH; i++)
+		snprintf(&sig[i * 2], 3, "%02x", p[i]);
+	emit_str("signature", sig, -1);
+	p += SIGNATURE_LENGTH;
+
+	emit_int("mcu_id", *p++);
+	emit_int("config_state", *p++);
+	memcpy(&rate, p, sizeof(rate));
+	emit_int("gyro_rate", rate);
+	p += 2;
+	memcpy(&problems, p, sizeof(problems));
+	emit_map("problems");
+	emit_int("acc_calibration", !!bit_is_set(problems, PROBLEM_ACC_NEEDS_CALIBRATION));
+	emit_int("motor_protocol_disabled", !!bit_is_set(problems, PROBLEM_MOTOR_PROTOCOL_DISABLED));
+	emit_end();
+	p += 4;
+	emit_int("spi_devices", *p++);
+	emit_int("i2c_devices", *p++);
+out:
+	emit_end();
+}
 
 int bf_board_info(serial_handle fd)
 {
@@ -82,7 +173,10 @@ int bf_board_info(serial_handle fd)
 				data, sizeof(data))) < 0)
 		return -1;
 
-	dump_board_info(data, len);
+	if (emit_format() != EMIT_TEXT)
+		emit_board_info(data, len);
+	else
+		dump_board_info(data, len);
 	return 0;
 }
 
@@ -153,6 +247,19 @@ int bf_reboot(serial_handle fd, int mode)
 	return 0;
 }
 
+/*
+ * Save configuration set by MSP setters to flash, FC stalls for a while
+ */
+int bf_eeprom_write(serial_handle fd)
+{
+	uint8_t data[16];
+
+	if (msp_transmit(fd, MSP_EEPROM_WRITE, MSP_DIR_OUT, data, 0, data, sizeof(data)) < 0)
+		return -1;
+
+	return 0;
+}
+
 int bf_send_dshot(serial_handle fd, int block, int motor, int num , int *val)
 {
 	uint8_t data[256];
@@ -11,10 +11,14 @@
 
 #include "failure.h"
 #include "serial.h"
+#include "transport.h"
 #include "progopt.h"
 #include "esc4way.h"
 #include "msp_serial.h"
 #include "msp_cmd.h"
+#include "rtt.h"
+#include "raw.h"
+#include "emit.h"
 
 #define BFCTL_VERSION_MAJOR		1
 #define BFCTL_VERSION_MINOR		0
@@ -26,7 +30,9 @@ struct bfctl_conf {
 	int info;
 	int help;
 	char *send_raw;
+	int raw_wait;
 	char *msp_cmd;
+	char *format;
 	msp_t msp;
 };
 
@@ -58,17 +64,22 @@ struct bfctl_conf {
 #define BFCTL_OPT_STR(s, l, d, o)		BFCTL_OPT(s, l, d, OPT_STRING, o, 0)
 
 static struct prog_option bfctl_options[] = {
-	BFCTL_OPT_INT('b', "baud", "baud rate, default "
+	BFCTL_OPT_INT('b', "baud", "baud rate, default found by autobaud or "
 				   XINTSTR(BAUD_RATE_DEFAULT), baud),
 	BFCTL_OPT_STR('d', "device", "serial device, default "
 				     BFCTL_LINUX_DEVICE_DEFAULT " or "
 				     MSP_LINUX_DEVICE_DEFAULT " on Linux"
 				     "\n\t\t" BFCTL_WINDOWS_DEVICE_DEFAULT
-			" on Windows", dev),
+			" on Windows, tcp://host:port for SITL or network bridge,"
+			"\n\t\tpty:<path> for pseudo terminal", dev),
 	BFCTL_OPT_NO ('h', "help", "help usage", help, 1),
-	BFCTL_OPT_STR ('\0', "raw", "send raw data, ; or space delimiter", send_raw),
+	BFCTL_OPT_STR ('\0', "raw", "send raw data, ; or space delimiter, @file to send file,"
+				    " @- to send stdin, received data is printed", send_raw),
+	BFCTL_OPT_INT ('\0', "wait", "raw mode, stop after milliseconds without data, default "
+				     XINTSTR(RAW_WAIT_DEFAULT), raw_wait),
 	BFCTL_OPT_STR ('\0', "msp", "use MSP protocol for serial commucations,"
 				    " usually to FC, try \"help\" to show help", msp_cmd),
+	BFCTL_OPT_STR ('\0', "format", "output of queries: text, json or cbor, default text", format),
 	PROG_END,
 };
 
@@ -107,6 +118,15 @@ static int bfctl_com_port_name_validate(const char *dev, char *name)
 	return 0;
 }
 
+/* device of link timeouts to save on exit */
+static const char *rtt_dev;
+
+static void bfctl_exit(void)
+{
+	if (rtt_dev)
+		rtt_save(rtt_dev);
+}
+
 /*
  *
  */
@@ -116,6 +136,7 @@ int main(int argc, char **argv)
 	char optstr[2 * OPT_LEN + 1];
 	struct bfctl_conf conf;
 	char port_name[256];
+	bool baud_cached = false;
 	int err_dev = 0;
 	int err;
 
@@ -128,7 +149,8 @@ int main(int argc, char **argv)
 
 	/* set default values */
 	conf.dev = NULL;
-	conf.baud = BAUD_RATE_DEFAULT;
+	conf.baud = 0;
+	conf.raw_wait = RAW_WAIT_DEFAULT;
 
 	if (prog_option_make(bfctl_options, opt, optstr, OPT_LEN) < 0)
 		failure(0, "Invalid options");
@@ -145,6 +167,14 @@ int main(int argc, char **argv)
 		exit(EXIT_SUCCESS);
 	}
 
+	if (conf.format) {
+		int format = emit_format_parse(conf.format);
+
+		if (format < 0)
+			failure(0, "Invalid format %s", conf.format);
+		emit_set_format(format);
+	}
+
 	if (conf.dev == NULL) {
 		if (conf.msp_cmd)
 			conf.dev = MSP_DEVICE_DEFAULT;
@@ -156,18 +186,36 @@ int main(int argc, char **argv)
 	if (strlen(port_name))
 		conf.dev = port_name;
 
-	if ((conf.fd = serial_open(conf.dev)) < 0) {
+	if (conf.baud == 0 && conf.msp_cmd) {
+		conf.baud = msp_baud_cached(conf.dev);
+		baud_cached = conf.baud != 0;
+	}
+	if (conf.baud == 0)
+		conf.baud = BAUD_RATE_DEFAULT;
+
+	if ((conf.fd = transport_open(conf.dev)) < 0) {
 		err_dev = errno;
 	} else {
-		if (serial_setup(conf.fd, conf.baud) < 0)
+		if (transport_setup(conf.fd, conf.baud) < 0)
 			failure(errno, "Can't set serial port %s parameters", conf.dev);
 
-		serial_set_timeout(conf.fd, 0.2);
+		rtt_load(conf.dev);
+		rtt_dev = conf.dev;
+		atexit(bfctl_exit);
+
+		rtt_set_timeout(conf.fd, RTT_MSP);
 	}
 
 	if (conf.msp_cmd) {
 		conf.msp.fd = conf.fd;
+		conf.msp.dev = conf.dev;
+		conf.msp.baud = conf.baud;
+		conf.msp.baud_check = baud_cached ? BAUD_RATE_DEFAULT : 0;
 		conf.msp.esc = esc4way_init(conf.fd);
+		if (!conf.msp.esc)
+			failure(errno, "Can't allocate esc interface");
+
+		conf.msp.esc->dev = conf.dev;
 		/* if passthrough mode, set first passthrough over MSP protocol */
 		if ((err = msp_exec_cmd(&conf.msp, conf.msp_cmd)) < 0) {
 			if (err == -2)
@@ -179,6 +227,13 @@ int main(int argc, char **argv)
 		exit(EXIT_SUCCESS);
 	}
 
+	if (conf.send_raw) {
+		if (conf.fd < 0)
+			failure(err_dev, "Can't open serial port %s", conf.dev);
+
+		if (raw_run(conf.fd, conf.send_raw, conf.raw_wait) < 0)
+			exit(EXIT_FAILURE);
+	}
 
 	exit(EXIT_SUCCESS);
 }
@@ -0,0 +1,502 @@
+/*
+ * serial bridge to pty or tcp
+ *
+ * Exposes serial port, usually FC in serial passthrough mode, as a pty
+ * ("pty") or as a tcp port on loopback ("tcp:5760"), so configurators
+ * can use it directly. Both directions are moved from one epoll loop
+ * with splice through a pipe, devices which can't splice (tty on most
+ * kernels) fall back to large buffer read and write.
+ *
+ * Linux only.
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "serial.h"
+#include "bridge.h"
+
+#ifdef __linux__
+#include <signal.h>
+#include <termios.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "tstamp.h"
+
+/* one direction of bridge */
+typedef struct bridge_dir {
+	const char *name;
+	int in;
+	int out;
+	bool splice;
+	int pipe[2];
+	/* bytes in pipe or buf not written yet */
+	size_t pending;
+	uint8_t *buf;
+	size_t pos;
+	/* time pending data was read */
+	double t_read;
+	/* statistics */
+	unsigned long long bytes;
+	unsigned long chunks;
+	double lat_min;
+	double lat_max;
+	double lat_sum;
+} bridge_dir_t;
+
+typedef struct bridge {
+	int epfd;
+	int serial;
+	/* peer is pty master or tcp client, -1 if no client */
+	int peer;
+	int listen;
+	int pty_slave;
+	/* epoll masks of serial and peer */
+	uint32_t ev_serial;
+	uint32_t ev_peer;
+	bridge_dir_t up;
+	bridge_dir_t down;
+} bridge_t;
+
+static volatile sig_atomic_t bridge_stop;
+
+static void bridge_signal(int sig)
+{
+	bridge_stop = 1;
+}
+
+static int bridge_nonblock(int fd)
+{
+	return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+static int bridge_dir_init(bridge_dir_t *d, const char *name, int in, int out)
+{
+	memset(d, 0, sizeof(*d));
+	d->name = name;
+	d->in = in;
+	d->out = out;
+	d->lat_min = 1e9;
+	d->splice = true;
+
+	if (pipe2(d->pipe, O_NONBLOCK) < 0) {
+		d->pipe[0] = d->pipe[1] = -1;
+		return -1;
+	}
+	/* pipe as big as buffer, so one splice takes all what is ready */
+	fcntl(d->pipe[1], F_SETPIPE_SZ, BRIDGE_BUF_SIZE);
+
+	d->buf = malloc(BRIDGE_BUF_SIZE);
+	return d->buf ? 0 : -1;
+}
+
+static void bridge_dir_free(bridge_dir_t *d)
+{
+	if (d->pipe[0] >= 0) {
+		close(d->pipe[0]);
+		close(d->pipe[1]);
+	}
+	free(d->buf);
+}
+
+/*
+ * Pending data of direction, kept in pipe, is moved to buffer when
+ * splice to output is not supported
+ */
+static int bridge_unsplice(bridge_dir_t *d)
+{
+	ssize_t n;
+
+	d->splice = false;
+	d->pos = 0;
+	if (!d->pending)
+		return 0;
+
+	n = read(d->pipe[0], d->buf, d->pending);
+	if (n != d->pending)
+		return -1;
+	return 0;
+}
+
+static void bridge_dir_done(bridge_dir_t *d, size_t n)
+{
+	double lat;
+
+	d->pending -= n;
+	d->bytes += n;
+	if (d->pending)
+		return;
+
+	lat = tstamp() - d->t_read;
+	d->chunks++;
+	d->lat_sum += lat;
+	if (lat < d->lat_min)
+		d->lat_min = lat;
+	if (lat > d->lat_max)
+		d->lat_max = lat;
+}
+
+/*
+ * Move data of direction, return 0 on end of input, -1 on error
+ */
+static int bridge_pump(bridge_dir_t *d)
+{
+	ssize_t n;
+
+	if (d->in < 0 || d->out < 0)
+		return 1;
+
+	if (!d->pending) {
+		if (d->splice) {
+			n = splice(d->in, NULL, d->pipe[1], NULL, BRIDGE_BUF_SIZE,
+				   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (n < 0 && errno == EINVAL) {
+				d->splice = false;
+				return bridge_pump(d);
+			}
+		} else {
+			n = read(d->in, d->buf, BRIDGE_BUF_SIZE);
+			d->pos = 0;
+		}
+
+		if (n == 0)
+			return 0;
+		if (n < 0)
+			return errno == EAGAIN || errno == EINTR ? 1 : -1;
+
+		d->pending = n;
+		d->t_read = tstamp();
+	}
+
+	while (d->pending) {
+		if (d->splice) {
+			n = splice(d->pipe[0], NULL, d->out, NULL, d->pending,
+				   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (n < 0 && errno == EINVAL) {
+				if (bridge_unsplice(d) < 0)
+					return -1;
+				continue;
+			}
+		} else {
+			n = write(d->out, d->buf + d->pos, d->pending);
+			if (n > 0)
+				d->pos += n;
+		}
+
+		if (n < 0)
+			return errno == EAGAIN || errno == EINTR ? 1 : -1;
+
+		bridge_dir_done(d, n);
+	}
+	return 1;
+}
+
+static int bridge_ctl(bridge_t *br, int fd, uint32_t *cur, uint32_t ev)
+{
+	struct epoll_event e = {.events = ev, .data.fd = fd};
+
+	if (fd < 0 || *cur == ev)
+		return 0;
+
+	*cur = ev;
+	return epoll_ctl(br->epfd, EPOLL_CTL_MOD, fd, &e);
+}
+
+/*
+ * Read input only when its direction has nothing pending, wait for
+ * output otherwise, so slow side holds back the fast one
+ */
+static int bridge_update(bridge_t *br)
+{
+	uint32_t ev_serial = 0, ev_peer = 0;
+
+	if (br->peer >= 0) {
+		ev_serial = br->up.pending ? 0 : EPOLLIN;
+		ev_peer = br->down.pending ? 0 : EPOLLIN;
+		if (br->up.pending)
+			ev_peer |= EPOLLOUT;
+		if (br->down.pending)
+			ev_serial |= EPOLLOUT;
+	}
+
+	if (bridge_ctl(br, br->serial, &br->ev_serial, ev_serial) < 0 ||
+	    bridge_ctl(br, br->peer, &br->ev_peer, ev_peer) < 0)
+		return -1;
+	return 0;
+}
+
+static int bridge_add(bridge_t *br, int fd, uint32_t ev)
+{
+	struct epoll_event e = {.events = ev, .data.fd = fd};
+
+	return epoll_ctl(br->epfd, EPOLL_CTL_ADD, fd, &e);
+}
+
+static void bridge_set_peer(bridge_t *br, int fd)
+{
+	br->peer = fd;
+	br->up.out = fd;
+	br->down.in = fd;
+	br->ev_peer = 0;
+}
+
+static int bridge_open_pty(bridge_t *br)
+{
+	struct termios tio;
+	const char *name;
+	int fd;
+
+	fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0 || !(name = ptsname(fd))) {
+		fprintf(stderr, "Can't open pty, %s\n", strerror(errno));
+		return -1;
+	}
+
+	/* slave is kept open, so pty is alive between clients */
+	br->pty_slave = open(name, O_RDWR | O_NOCTTY);
+	if (br->pty_slave < 0 || tcgetattr(br->pty_slave, &tio) < 0) {
+		fprintf(stderr, "Can't open %s, %s\n", name, strerror(errno));
+		return -1;
+	}
+	cfmakeraw(&tio);
+	tcsetattr(br->pty_slave, TCSANOW, &tio);
+
+	bridge_nonblock(fd);
+	bridge_set_peer(br, fd);
+	if (bridge_add(br, fd, 0) < 0)
+		return -1;
+
+	printf("Bridge on %s\n", name);
+	return 0;
+}
+
+static int bridge_open_tcp(bridge_t *br, int port)
+{
+	struct sockaddr_in addr;
+	int fd, on = 1;
+
+	fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (fd < 0)
+		return -1;
+
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+		fprintf(stderr, "Can't listen tcp port %d, %s\n", port, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	br->listen = fd;
+	if (bridge_add(br, fd, EPOLLIN) < 0)
+		return -1;
+
+	printf("Bridge on tcp 127.0.0.1:%d\n", port);
+	return 0;
+}
+
+static int bridge_accept(bridge_t *br)
+{
+	int fd, on = 1;
+
+	fd = accept4(br->listen, NULL, NULL, SOCK_NONBLOCK);
+	if (fd < 0)
+		return errno == EAGAIN ? 0 : -1;
+
+	/* one client at time */
+	if (br->peer >= 0) {
+		close(fd);
+		return 0;
+	}
+
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	bridge_set_peer(br, fd);
+	if (bridge_add(br, fd, 0) < 0)
+		return -1;
+
+	printf("Client connected\n");
+	return 0;
+}
+
+/* data of direction which is not written yet is dropped */
+static void bridge_dir_drop(bridge_dir_t *d)
+{
+	uint8_t drain[256];
+
+	/* pipe is non-blocking, read stops when it is empty */
+	while (read(d->pipe[0], drain, sizeof(drain)) > 0)
+		;
+	d->pending = 0;
+	d->pos = 0;
+}
+
+/*
+ * Client is gone, data from and to it is dropped
+ */
+static void bridge_drop_peer(bridge_t *br)
+{
+	epoll_ctl(br->epfd, EPOLL_CTL_DEL, br->peer, NULL);
+	close(br->peer);
+	bridge_set_peer(br, -1);
+
+	/* neither FC nor the next client get bytes of the old one */
+	bridge_dir_drop(&br->up);
+	bridge_dir_drop(&br->down);
+	br->down.splice = true;
+	printf("Client disconnected\n");
+}
+
+static void bridge_dir_printf(const bridge_dir_t *d)
+{
+	printf("%-10s %12llu bytes in %8lu chunks, %s", d->name, d->bytes, d->chunks,
+	       d->splice ? "splice" : "buffered");
+	if (d->chunks)
+		printf(", latency min %.3f avg %.3f max %.3f ms", d->lat_min * 1000,
+		       d->lat_sum / d->chunks * 1000, d->lat_max * 1000);
+	printf("\n");
+}
+
+static int bridge_loop(bridge_t *br)
+{
+	struct epoll_event ev[4];
+	int i, n, err;
+
+	while (!bridge_stop) {
+		if (bridge_update(br) < 0)
+			return -1;
+
+		n = epoll_wait(br->epfd, ev, sizeof(ev) / sizeof(ev[0]), -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		for (i = 0; i < n; i++) {
+			int fd = ev[i].data.fd;
+
+			if (fd == br->listen) {
+				if (bridge_accept(br) < 0)
+					return -1;
+				continue;
+			}
+
+			if (fd == br->serial && (ev[i].events & (EPOLLERR | EPOLLHUP))) {
+				fprintf(stderr, "Serial port closed\n");
+				return -1;
+			}
+		}
+
+		/* both directions, whatever woke us up */
+		if ((err = bridge_pump(&br->up)) <= 0) {
+			if (err == 0 || br->peer < 0) {
+				fprintf(stderr, "Serial port closed\n");
+				return -1;
+			}
+			/* write error to client */
+			bridge_drop_peer(br);
+			continue;
+		}
+
+		if (br->peer >= 0 && (err = bridge_pump(&br->down)) <= 0) {
+			if (br->listen < 0) {
+				fprintf(stderr, "pty error, %s\n", strerror(errno));
+				return -1;
+			}
+			bridge_drop_peer(br);
+		}
+	}
+	return 0;
+}
+
+int bridge_run(serial_handle fd, const char *spec)
+{
+	struct sigaction sa;
+	bridge_t br;
+	double start;
+	int err = -1;
+
+	memset(&br, 0, sizeof(br));
+	br.serial = fd;
+	br.peer = -1;
+	br.listen = -1;
+	br.pty_slave = -1;
+	br.up.pipe[0] = br.down.pipe[0] = -1;
+
+	br.epfd = epoll_create1(0);
+	if (br.epfd < 0)
+		return -1;
+
+	if (bridge_dir_init(&br.up, "FC->client", fd, -1) < 0 ||
+	    bridge_dir_init(&br.down, "client->FC", -1, fd) < 0)
+		goto out;
+
+	bridge_nonblock(fd);
+	if (bridge_add(&br, fd, 0) < 0)
+		goto out;
+
+	if (!strcmp(spec, "pty")) {
+		if (bridge_open_pty(&br) < 0)
+			goto out;
+	} else if (!strncmp(spec, "tcp:", 4)) {
+		if (bridge_open_tcp(&br, strtol(&spec[4], NULL, 0)) < 0)
+			goto out;
+	} else {
+		fprintf(stderr, "Invalid bridge: %s, pty or tcp:<port>\n", spec);
+		goto out;
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = bridge_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	printf("Press Ctrl-C to stop\n");
+	fflush(stdout);
+
+	start = tstamp();
+	err = bridge_loop(&br);
+
+	printf("\nBridge %.1fs\n", tstamp() - start);
+	bridge_dir_printf(&br.up);
+	bridge_dir_printf(&br.down);
+out:
+	if (br.peer >= 0)
+		close(br.peer);
+	if (br.pty_slave >= 0)
+		close(br.pty_slave);
+	if (br.listen >= 0)
+		close(br.listen);
+	bridge_dir_free(&br.up);
+	bridge_dir_free(&br.down);
+	close(br.epfd);
+	return err;
+}
+
+#else
+
+int bridge_run(serial_handle fd, const char *spec)
+{
+	fprintf(stderr, "bridge is supported on Linux only\n");
+	return -1;
+}
+
+#endif
@@ -22,7 +22,7 @@ int cmd_name_copy(const char *arg, char *name, int len)
 		n++;
 	}
 
-	name = '\0';
+	*name = '\0';
 	return n;
 }
 
@@ -43,6 +43,46 @@ int cmd_arg_to_int(const char *arg, int *val, int len)
 	return num;
 }
 
+/*
+ * List of numbers "2", "0,2", "0-3" or mixed "0,2-3" to set[max], return
+ * number of members or -1 if list is invalid or empty
+ */
+int cmd_arg_to_set(const char *list, bool *set, int max)
+{
+	const char *p = list;
+	char *end;
+	int from, to, n = 0;
+
+	memset(set, 0, max * sizeof(set[0]));
+
+	while (*p) {
+		from = strtol(p, &end, 0);
+		if (end == p)
+			return -1;
+		to = from;
+		if (*end == '-') {
+			p = end + 1;
+			to = strtol(p, &end, 0);
+			if (end == p)
+				return -1;
+		}
+		if (from < 0 || to >= max || from > to)
+			return -1;
+		for (; from <= to; from++) {
+			if (!set[from])
+				n++;
+			set[from] = true;
+		}
+		if (*end == ',')
+			end++;
+		else if (*end != '\0')
+			return -1;
+		p = end;
+	}
+
+	return n ? n : -1;
+}
+
 /*
  *  Format: <cmd><spaces><args and space delimitters><, or ;>
  */
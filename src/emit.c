@@ -0,0 +1,339 @@
+/*
+ * structured output
+ *
+ * JSON and CBOR of query commands for scripts. Values are encoded right
+ * into one reusable buffer, numbers and strings are converted here without
+ * printf, buffer goes to stdout when document is complete or buffer is
+ * full. CBOR maps and arrays are of indefinite length, so nothing has to
+ * be counted in advance.
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "emit.h"
+
+static struct {
+	int format;
+	int depth;
+	/* values written at each level, for JSON commas */
+	int count[EMIT_DEPTH];
+	/* JSON closing bracket of level */
+	char close[EMIT_DEPTH];
+	int len;
+	uint8_t buf[EMIT_BUF_SIZE];
+} emit;
+
+int emit_format_parse(const char *name)
+{
+	if (!strcmp(name, "text"))
+		return EMIT_TEXT;
+	if (!strcmp(name, "json"))
+		return EMIT_JSON;
+	if (!strcmp(name, "cbor"))
+		return EMIT_CBOR;
+	return -1;
+}
+
+void emit_set_format(int format)
+{
+	emit.format = format;
+}
+
+int emit_format(void)
+{
+	return emit.format;
+}
+
+void emit_flush(void)
+{
+	const uint8_t *p = emit.buf;
+	int n;
+
+	/* text printed before goes first */
+	fflush(stdout);
+
+	while (emit.len > 0) {
+		n = write(STDOUT_FILENO, p, emit.len);
+		if (n <= 0)
+			break;
+		p += n;
+		emit.len -= n;
+	}
+	emit.len = 0;
+}
+
+static void emit_put(const void *data, int len)
+{
+	const uint8_t *p = data;
+	int n;
+
+	while (len > 0) {
+		if (emit.len == EMIT_BUF_SIZE)
+			emit_flush();
+
+		n = EMIT_BUF_SIZE - emit.len;
+		if (n > len)
+			n = len;
+		memcpy(&emit.buf[emit.len], p, n);
+		emit.len += n;
+		p += n;
+		len -= n;
+	}
+}
+
+static void emit_byte(uint8_t c)
+{
+	emit_put(&c, 1);
+}
+
+/*****************************************************************************/
+
+static void emit_json_uint(uint64_t v)
+{
+	char digits[20];
+	int n = 0;
+
+	do {
+		digits[sizeof(digits) - ++n] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+
+	emit_put(&digits[sizeof(digits) - n], n);
+}
+
+static void emit_json_int(int64_t v)
+{
+	if (v < 0) {
+		emit_byte('-');
+		emit_json_uint(-(uint64_t)v);
+	} else {
+		emit_json_uint(v);
+	}
+}
+
+/*
+ * Three decimals are enough for settings and sensor values
+ */
+static void emit_json_float(double v)
+{
+	uint64_t milli;
+	char frac[3];
+
+	if (!isfinite(v)) {
+		emit_put("null", 4);
+		return;
+	}
+
+	if (v < 0) {
+		emit_byte('-');
+		v = -v;
+	}
+
+	milli = (uint64_t)(v * 1000 + 0.5);
+	emit_json_uint(milli / 1000);
+	frac[0] = '0' + milli / 100 % 10;
+	frac[1] = '0' + milli / 10 % 10;
+	frac[2] = '0' + milli % 10;
+	emit_byte('.');
+	emit_put(frac, 3);
+}
+
+static void emit_json_str(const char *s, int len)
+{
+	static const char hex[] = "0123456789abcdef";
+	char esc[6] = {'\\', 'u', '0', '0'};
+	int i;
+
+	emit_byte('"');
+	for (i = 0; (len < 0 || i < len) && s[i]; i++) {
+		uint8_t c = s[i];
+
+		if (c == '"' || c == '\\') {
+			emit_byte('\\');
+			emit_byte(c);
+		} else if (c < 0x20 || c >= 0x7f) {
+			esc[4] = hex[c >> 4];
+			esc[5] = hex[c & 0xf];
+			emit_put(esc, sizeof(esc));
+		} else {
+			emit_byte(c);
+		}
+	}
+	emit_byte('"');
+}
+
+/*****************************************************************************/
+
+/* major type and argument in the shortest form */
+static void emit_cbor_head(uint8_t major, uint64_t v)
+{
+	uint8_t h[9];
+	int i, n;
+
+	major <<= 5;
+	if (v < 24) {
+		emit_byte(major | v);
+		return;
+	}
+
+	if (v <= 0xff) {
+		h[0] = major | 24;
+		n = 1;
+	} else if (v <= 0xffff) {
+		h[0] = major | 25;
+		n = 2;
+	} else if (v <= 0xffffffff) {
+		h[0] = major | 26;
+		n = 4;
+	} else {
+		h[0] = major | 27;
+		n = 8;
+	}
+
+	for (i = 0; i < n; i++)
+		h[n - i] = v >> (i * 8);
+	emit_put(h, n + 1);
+}
+
+static void emit_cbor_int(int64_t v)
+{
+	if (v < 0)
+		emit_cbor_head(1, -(v + 1));
+	else
+		emit_cbor_head(0, v);
+}
+
+static void emit_cbor_float(double v)
+{
+	uint8_t h[9];
+	uint64_t u;
+	int i;
+
+	memcpy(&u, &v, sizeof(u));
+	h[0] = 0xfb;
+	for (i = 0; i < 8; i++)
+		h[8 - i] = u >> (i * 8);
+	emit_put(h, sizeof(h));
+}
+
+static void emit_cbor_str(const char *s, int len)
+{
+	int n = 0;
+
+	while ((len < 0 || n < len) && s[n])
+		n++;
+
+	emit_cbor_head(3, n);
+	emit_put(s, n);
+}
+
+/*****************************************************************************/
+
+/*
+ * Separator and key in front of value
+ */
+static void emit_key(const char *key)
+{
+	if (emit.format == EMIT_JSON) {
+		if (emit.depth && emit.count[emit.depth - 1])
+			emit_byte(',');
+		if (key) {
+			emit_json_str(key, -1);
+			emit_byte(':');
+		}
+	} else if (key) {
+		emit_cbor_str(key, -1);
+	}
+
+	if (emit.depth)
+		emit.count[emit.depth - 1]++;
+}
+
+/* value at top level is a complete document */
+static void emit_done(void)
+{
+	if (emit.depth)
+		return;
+
+	if (emit.format == EMIT_JSON)
+		emit_byte('\n');
+	emit_flush();
+}
+
+static void emit_open(const char *key, const char *json, uint8_t cbor)
+{
+	if (emit.depth == EMIT_DEPTH)
+		return;
+
+	emit_key(key);
+
+	if (emit.format == EMIT_JSON)
+		emit_byte(json[0]);
+	else
+		emit_byte(cbor);
+
+	emit.count[emit.depth] = 0;
+	emit.close[emit.depth] = json[1];
+	emit.depth++;
+}
+
+void emit_map(const char *key)
+{
+	emit_open(key, "{}", 0xbf);
+}
+
+void emit_array(const char *key)
+{
+	emit_open(key, "[]", 0x9f);
+}
+
+void emit_end(void)
+{
+	if (!emit.depth)
+		return;
+
+	emit.depth--;
+	if (emit.format == EMIT_JSON)
+		emit_byte(emit.close[emit.depth]);
+	else
+		emit_byte(0xff);
+
+	emit_done();
+}
+
+void emit_int(const char *key, int64_t v)
+{
+	emit_key(key);
+	if (emit.format == EMIT_JSON)
+		emit_json_int(v);
+	else
+		emit_cbor_int(v);
+	emit_done();
+}
+
+void emit_float(const char *key, double v)
+{
+	emit_key(key);
+	if (emit.format == EMIT_JSON)
+		emit_json_float(v);
+	else
+		emit_cbor_float(v);
+	emit_done();
+}
+
+void emit_str(const char *key, const char *s, int len)
+{
+	emit_key(key);
+	if (emit.format == EMIT_JSON)
+		emit_json_str(s, len);
+	else
+		emit_cbor_str(s, len);
+	emit_done();
+}
@@ -5,16 +5,21 @@
  */
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include "zalloc.h"
 #include "dump_hex.h"
 
 #include "serial.h"
+#include "transport.h"
 #include "esc4way.h"
 #include "esc_boot.h"
 #include "crc.h"
+#include "rtt.h"
+#include "tstamp.h"
 
 //#define DEBUG
 
@@ -84,7 +89,7 @@ static int esc4way_write(serial_handle fd, const void *data, int len)
 	debug("esc4way out:\n");
 	debug_dump(data, len, 0);
 
-	if (serial_write(fd, data, len) != len)
+	if (transport_write(fd, data, len) != len)
 		return -1;
 	return 0;
 }
@@ -93,7 +98,7 @@ static int esc4way_read(serial_handle fd, void *data, int len)
 {
 	int n;
 
-	if ((n = serial_read(fd, data, len)) != len) {
+	if ((n = transport_read(fd, data, len)) != len) {
 		debug("Request read %d, but read %d\n", len, n);
 		return -1;
 	}
@@ -102,6 +107,27 @@ static int esc4way_read(serial_handle fd, void *data, int len)
 	return n;
 }
 
+/*
+ * Timeout model of command
+ */
+static int esc4way_rtt_model(int cmd)
+{
+	switch (cmd) {
+		case cmd_DeviceRead:
+		case cmd_DeviceReadEEprom:
+			return RTT_4WAY_READ;
+		case cmd_DeviceWrite:
+		case cmd_DeviceWriteEEprom:
+		case cmd_DeviceVerify:
+			return RTT_4WAY_WRITE;
+		case cmd_DeviceEraseAll:
+		case cmd_DevicePageErase:
+			return RTT_4WAY_ERASE;
+		default:
+			return RTT_4WAY_CTRL;
+	}
+}
+
 int esc4way_send(esc4way_t *esc, int cmd, int addr, const void *out, int out_len, void *in, int in_len)
 {
 	uint8_t data[sizeof(esc4way_hdr_t) + out_len + sizeof(uint16_t)];
@@ -109,13 +135,17 @@ int esc4way_send(esc4way_t *esc, int cmd, int addr, const void *out, int out_len
 	esc4way_pkt_t *pkt = (esc4way_pkt_t *)data;
 	esc4way_hdr_t *hdr = &pkt->hdr;
 	uint16_t crc, rd_crc;
-	int len;
+	int len, ack;
+	int model;
+	double t;
 
 	if (!out || !out_len) {
 		out_len = 0;
 		out = NULL;
 	}
 
+	esc->ack = -1;
+
 	hdr->esc = cmd_Local_Escape;
 	hdr->cmd = cmd;
 	hdr->addr.byte[0] = addr >> 8;
@@ -128,8 +158,15 @@ int esc4way_send(esc4way_t *esc, int cmd, int addr, const void *out, int out_len
 
 	pkt->data[out_len] = crc >> 8;
 	pkt->data[out_len + 1] = crc;
-	if (esc4way_write(esc->fd, data, sizeof(esc4way_hdr_t) + out_len + sizeof(uint16_t)) < 0)
+
+	model = esc4way_rtt_model(cmd);
+	rtt_set_timeout(esc->fd, model);
+
+	if (esc4way_write(esc->fd, data, sizeof(esc4way_hdr_t) + out_len + sizeof(uint16_t)) < 0) {
+		esc4way_invalidate(esc);
 		return -1;
+	}
+	t = tstamp();
 
 	if (!in || !in_len) {
 		in_len = 0;
@@ -139,16 +176,23 @@ int esc4way_send(esc4way_t *esc, int cmd, int addr, const void *out, int out_len
 	/* read reply header */
 	pkt = (esc4way_pkt_t *)rd;
 
-	if (esc4way_read(esc->fd, pkt, sizeof(esc4way_pkt_t)) < 0)
+	if (esc4way_read(esc->fd, pkt, sizeof(esc4way_pkt_t)) < 0) {
+		rtt_backoff(rtt_model(model));
+		esc4way_invalidate(esc);
 		return -1;
+	}
 
 	/* read data + ack + crc */
 	len = pkt->hdr.len;
 	if (len == 0)
 		len = 256;
 
-	if (esc4way_read(esc->fd, pkt->data, len + 3) < 0)
+	if (esc4way_read(esc->fd, pkt->data, len + 3) < 0) {
+		rtt_backoff(rtt_model(model));
+		esc4way_invalidate(esc);
 		return -1;
+	}
+	t = tstamp() - t;
 
 	esc4way_dump_reply(pkt);
 
@@ -157,71 +201,229 @@ int esc4way_send(esc4way_t *esc, int cmd, int addr, const void *out, int out_len
 
 	if (rd_crc != crc) {
 		debug("Invalid CRC %04x, should %04x\n", rd_crc, crc);
+		esc4way_invalidate(esc);
 		return -1;
 	}
 
+	rtt_update(rtt_model(model), t);
+
+	ack = pkt->data[len];
+	esc->ack = ack;
+
 	if (in) {
 		if (len > in_len)
 			len = in_len;
 		memcpy(in, pkt->data, len);
 	}
 
-	if (pkt->data[len] != ACK_OK) {
-		printf("ack: %s\n", esc4way_ack_str(pkt->data[len]));
+	if (ack != ACK_OK) {
+		/* verify mismatch is an answer, not a failure */
+		if (!(cmd == cmd_DeviceVerify && ack == ACK_I_VERIFY_ERROR)) {
+			printf("ack: %s\n", esc4way_ack_str(ack));
+			esc4way_invalidate(esc);
+		}
 		return -1;
 	}
 
 	return len;
 }
 
-int esc4way_set_version(esc4way_t *esc, int major, int minor)
+/*
+ * Settings are edited in cache of channel and written by
+ * esc4way_settings_commit(), so any number of edits costs one read and
+ * one write of settings block
+ */
+static esc_set_cache_t *esc4way_set_cache(esc4way_t *esc, int chan)
 {
-	if (!esc->set.cached) {
-		if (esc4way_settings_cache(esc) < 0)
-			return -1;
+	if (chan < 0 || chan >= ESC4WAY_CHAN_MAX) {
+		fprintf(stderr, "Invalid esc channel %d\n", chan);
+		return NULL;
 	}
+	return &esc->set.chan[chan];
+}
 
-	esc->set.data.name.version.major = major;
-	esc->set.data.name.version.minor = minor;
+/*
+ * Settings of channel, read from esc if not cached yet
+ */
+esc_set_cache_t *esc4way_settings(esc4way_t *esc, int chan)
+{
+	esc_set_cache_t *sc;
+
+	if (!(sc = esc4way_set_cache(esc, chan)))
+		return NULL;
+
+	if (sc->cached)
+		return sc;
 
-	return esc4way_write_flash(esc, esc->set.addr, esc->set.data.byte, esc->set.size);
+	if (esc4way_select_chan(esc, 0, chan) < 0)
+		return NULL;
+
+	if (esc4way_read_flash(esc, esc->set.addr, sc->data.byte, esc->set.size) < 0)
+		return NULL;
+
+	memset(sc->dirty, 0, sizeof(sc->dirty));
+	sc->cached = true;
+	return sc;
 }
 
-int esc4way_boot_flash(esc4way_t *esc, int mark)
+/*
+ * First len bytes of settings, from cache if channel is cached, otherwise
+ * only these bytes are read
+ */
+int esc4way_settings_read(esc4way_t *esc, int chan, void *buf, int len)
 {
-	if (!esc->set.cached) {
-		if (esc4way_settings_cache(esc) < 0)
-			return -1;
+	esc_set_cache_t *sc;
+
+	if (len <= 0 || len > esc->set.size || !(sc = esc4way_set_cache(esc, chan)))
+		return -1;
+
+	if (sc->cached) {
+		memcpy(buf, sc->data.byte, len);
+		return len;
+	}
+
+	if (esc4way_select_chan(esc, 0, chan) < 0)
+		return -1;
+
+	if (esc4way_read_flash(esc, esc->set.addr, buf, len) < 0)
+		return -1;
+
+	return len;
+}
+
+/*
+ * Change settings bytes in cache, only changed bytes are marked dirty
+ */
+int esc4way_settings_set(esc4way_t *esc, int chan, int offt, const void *buf, int len)
+{
+	const uint8_t *p = buf;
+	esc_set_cache_t *sc;
+	int i;
+
+	if (offt < 0 || offt + len > esc->set.size)
+		return -1;
+
+	if (!(sc = esc4way_settings(esc, chan)))
+		return -1;
+
+	for (i = offt; i < offt + len; i++, p++) {
+		if (sc->data.byte[i] == *p)
+			continue;
+		sc->data.byte[i] = *p;
+		sc->dirty[i / 8] |= 1 << (i % 8);
+	}
+	return 0;
+}
+
+/*
+ * Number of changed bytes not written yet
+ */
+int esc4way_settings_dirty(esc4way_t *esc, int chan)
+{
+	esc_set_cache_t *sc;
+	int i, n = 0;
+
+	if (chan < 0 || chan >= ESC4WAY_CHAN_MAX)
+		return 0;
+
+	sc = &esc->set.chan[chan];
+	if (!sc->cached)
+		return 0;
+
+	for (i = 0; i < esc->set.size; i++) {
+		if (sc->dirty[i / 8] & (1 << (i % 8)))
+			n++;
+	}
+	return n;
+}
+
+int esc4way_settings_commit(esc4way_t *esc, int chan)
+{
+	esc_set_cache_t *sc;
+
+	if (!esc4way_settings_dirty(esc, chan))
+		return 0;
+
+	sc = &esc->set.chan[chan];
+
+	if (esc4way_select_chan(esc, 0, chan) < 0)
+		return -1;
+
+	if (esc4way_write_flash(esc, esc->set.addr, sc->data.byte, esc->set.size) < 0)
+		return -1;
+
+	memset(sc->dirty, 0, sizeof(sc->dirty));
+	return 0;
+}
+
+int esc4way_settings_commit_all(esc4way_t *esc)
+{
+	int chan, err = 0;
+
+	for (chan = 0; chan < ESC4WAY_CHAN_MAX; chan++) {
+		if (esc4way_settings_commit(esc, chan) < 0)
+			err = -1;
+	}
+	return err;
+}
+
+/*
+ * Drop cache of channel, or of all channels if chan < 0
+ */
+void esc4way_settings_invalidate(esc4way_t *esc, int chan)
+{
+	int i;
+
+	for (i = 0; i < ESC4WAY_CHAN_MAX; i++) {
+		if (chan < 0 || chan == i)
+			esc->set.chan[i].cached = false;
 	}
+}
 
-	esc->set.data.name.head = mark;
+int esc4way_set_version(esc4way_t *esc, int chan, int major, int minor)
+{
+	uint8_t ver[2] = {major, minor};
 
-	return esc4way_write_flash(esc, esc->set.addr, esc->set.data.byte, esc->set.size);
+	return esc4way_settings_set(esc, chan, offsetof(struct settings, version),
+				    ver, sizeof(ver));
 }
 
-int esc4way_mark_flash(esc4way_t *esc, const char *mark)
+int esc4way_boot_flash(esc4way_t *esc, int chan, int mark)
 {
+	uint8_t head = mark;
+
+	return esc4way_settings_set(esc, chan, offsetof(struct settings, head),
+				    &head, sizeof(head));
+}
+
+int esc4way_mark_flash(esc4way_t *esc, int chan, const char *mark)
+{
+	uint8_t name[ESC_SET_DEVICE_NAME_SIZE];
 	int len;
 
 	len = strlen(mark);
 	if (len > ESC_SET_DEVICE_NAME_SIZE)
 		len = ESC_SET_DEVICE_NAME_SIZE;
 
-	if (!esc->set.cached) {
-		if (esc4way_settings_cache(esc) < 0)
-			return -1;
-	}
+	memset(name, 0, ESC_SET_DEVICE_NAME_SIZE);
+	memcpy(name, mark, len);
 
-	memset(esc->set.data.name.device_name, 0, ESC_SET_DEVICE_NAME_SIZE);
-	memcpy(esc->set.data.name.device_name, mark, len);
+	return esc4way_settings_set(esc, chan, offsetof(struct settings, device_name),
+				    name, sizeof(name));
+}
 
-	return esc4way_write_flash(esc, esc->set.addr, esc->set.data.byte, esc->set.size);
+void esc4way_invalidate(esc4way_t *esc)
+{
+	esc->sel.valid = false;
 }
 
+/*
+ * Init flash access of channel, nothing is sent if channel is already
+ * selected and nothing changed link state since
+ */
 int esc4way_select_chan(esc4way_t *esc, int addr, int chan)
 {
 	uint8_t c = chan;
-	uint8_t dev_info[4];
 	int err;
 	/* uint8_t connected;  // > 0
 	 * uint8_t ;
@@ -229,12 +431,108 @@ int esc4way_select_chan(esc4way_t *esc, int addr, int chan)
 	 * uint8_t mode; // imC2 0, imSIL_BLB 1, imATM_BLB 2, imSK 3, imARM_BLB 4
 	 * */
 
-	err = esc4way_send(esc, cmd_DeviceInitFlash, addr, &c, 1, &dev_info, sizeof(dev_info));
+	if (esc->sel.valid && esc->sel.chan == chan)
+		return sizeof(esc->sel.dev_info);
+
+	err = esc4way_send(esc, cmd_DeviceInitFlash, addr, &c, 1,
+			   esc->sel.dev_info, sizeof(esc->sel.dev_info));
 	debug("esc4way device info\n");
-	debug_dump(dev_info, sizeof(dev_info), 1);
+	debug_dump(esc->sel.dev_info, sizeof(esc->sel.dev_info), 1);
+
+	esc->sel.chan = chan;
+	esc->sel.valid = err >= 0;
 	return err;
 }
 
+/*
+ * Drop everything left in input after broken reply
+ */
+static void esc4way_resync(esc4way_t *esc)
+{
+	uint8_t data[256];
+
+	transport_set_timeout(esc->fd, ESC4WAY_RESYNC_TIMEOUT);
+	while (transport_read(esc->fd, data, sizeof(data)) > 0)
+		;
+}
+
+/*
+ * Broken or lost reply and transient errors are worth to repeat,
+ * invalid request is not
+ */
+static bool esc4way_ack_retry(int cmd, int ack)
+{
+	switch (ack) {
+		case ACK_I_INVALID_CMD:
+		case ACK_I_INVALID_CHANNEL:
+		case ACK_I_INVALID_PARAM:
+			return false;
+		case ACK_I_VERIFY_ERROR:
+			return cmd != cmd_DeviceVerify;
+		default:
+			return true;
+	}
+}
+
+static void esc4way_stat_retry(esc4way_t *esc, int addr)
+{
+	unsigned int blk = (addr >> 8) % ESC4WAY_STAT_BLOCKS;
+
+	if (esc->stat.retries[blk] < UINT8_MAX)
+		esc->stat.retries[blk]++;
+	esc->stat.total++;
+}
+
+/*
+ * Read, write or verify up to 256 bytes block, on error input is
+ * resynchronized and request is repeated after backoff, and if errors
+ * repeat the block is transfered by smaller chunks
+ */
+static int esc4way_xfer_block(esc4way_t *esc, int cmd, int addr, uint8_t *p, int len)
+{
+	int chunk = len;
+	int errs = 0;
+	uint8_t num;
+	int n, err;
+
+	while (len > 0) {
+		n = len;
+		if (n > chunk)
+			n = chunk;
+
+		if (cmd == cmd_DeviceRead) {
+			num = n;
+			err = esc4way_send(esc, cmd, addr, &num, 1, p, n);
+		} else {
+			err = esc4way_send(esc, cmd, addr, p, n, NULL, 0);
+		}
+
+		if (err >= 0) {
+			len -= n;
+			p += n;
+			addr += n;
+			continue;
+		}
+
+		if (!esc4way_ack_retry(cmd, esc->ack))
+			return -1;
+
+		esc4way_stat_retry(esc, addr);
+		if (++errs >= ESC4WAY_RETRY_MAX) {
+			fprintf(stderr, "esc4way block %04x failed after %d attempts\n",
+					addr, errs);
+			return -1;
+		}
+
+		esc4way_resync(esc);
+		usleep(ESC4WAY_RETRY_BACKOFF_US << (errs - 1));
+
+		if (errs >= ESC4WAY_RETRY_SHRINK && chunk > ESC4WAY_CHUNK_MIN)
+			chunk /= 2;
+	}
+	return 0;
+}
+
 int esc4way_write_flash(esc4way_t *esc, int addr, const void *buf, int len)
 {
 	const uint8_t *p = buf;
@@ -246,7 +544,7 @@ int esc4way_write_flash(esc4way_t *esc, int addr, const void *buf, int len)
 		else
 			n = len;
 
-		if (esc4way_send(esc, cmd_DeviceWrite, addr, p, n, NULL, 0) < 0)
+		if (esc4way_xfer_block(esc, cmd_DeviceWrite, addr, (uint8_t *)p, n) < 0)
 			return -1;
 
 		len -= n;
@@ -257,10 +555,12 @@ int esc4way_write_flash(esc4way_t *esc, int addr, const void *buf, int len)
 
 }
 
-int esc4way_read_flash(esc4way_t *esc, int addr, void *buf, int len)
+/*
+ * Compare flash with buffer, return 1 if equal, 0 if not
+ */
+int esc4way_verify_flash(esc4way_t *esc, int addr, const void *buf, int len)
 {
-	uint8_t num;
-	uint8_t *p = buf;
+	const uint8_t *p = buf;
 	int n;
 
 	while (len > 0) {
@@ -269,25 +569,37 @@ int esc4way_read_flash(esc4way_t *esc, int addr, void *buf, int len)
 		else
 			n = len;
 
-		num = n;
-		if (esc4way_send(esc, cmd_DeviceRead, addr, &num, 1, p, n) < 0)
+		if (esc4way_xfer_block(esc, cmd_DeviceVerify, addr, (uint8_t *)p, n) < 0) {
+			if (esc->ack == ACK_I_VERIFY_ERROR)
+				return 0;
 			return -1;
+		}
 
 		len -= n;
 		p += n;
 		addr += n;
 	}
-	return 0;
+	return 1;
 }
 
-int esc4way_settings_cache(esc4way_t *esc)
+int esc4way_read_flash(esc4way_t *esc, int addr, void *buf, int len)
 {
-	int err;
-	err = esc4way_read_flash(esc, esc->set.addr, &esc->set.data.name, sizeof(esc->set.data.name));
-	if (err < 0)
-		return err;
+	uint8_t *p = buf;
+	int n;
 
-	esc->set.cached = true;
+	while (len > 0) {
+		if (len > 256)
+			n = 256;
+		else
+			n = len;
+
+		if (esc4way_xfer_block(esc, cmd_DeviceRead, addr, p, n) < 0)
+			return -1;
+
+		len -= n;
+		p += n;
+		addr += n;
+	}
 	return 0;
 }
 
@@ -298,15 +610,29 @@ int esc4way_interface_name(esc4way_t *esc, char *name, int len)
 	return esc4way_send(esc, cmd_InterfaceGetName, 0, &data, 1, name, len);
 }
 
+/*
+ * Pending settings are written before esc is restarted
+ */
 int esc4way_exit(esc4way_t *esc)
 {
 	uint8_t data = 0;
+
+	if (esc4way_settings_commit_all(esc) < 0)
+		return -1;
+
+	esc4way_invalidate(esc);
+	esc4way_settings_invalidate(esc, -1);
 	return esc4way_send(esc, cmd_InterfaceExit, 0, &data, 1, NULL, 0);
 }
 
 int esc4way_reset(esc4way_t *esc, int chan)
 {
 	uint8_t data = chan;
+
+	if (esc4way_settings_commit(esc, chan) < 0)
+		return -1;
+
+	esc4way_invalidate(esc);
 	return esc4way_send(esc, cmd_DeviceReset, 0, &data, 1, NULL, 0);
 }
 
@@ -319,6 +645,7 @@ esc4way_t *esc4way_init(serial_handle fd)
 		return NULL;
 
 	esc->fd = fd;
+	esc->sel.chan = -1;
 	esc->set.addr = ESC_FLASH_SETTINGS_OFFT;
 	esc->set.size = ESC_FLASH_SETTINGS_SIZE;
 	esc->fw.addr = ESC_FLASH_FIRMWARE_OFFT;
@@ -0,0 +1,281 @@
+/*
+ * esc image archive
+ *
+ * Single append only file with firmware and settings images of esc.
+ * Images are stored once as blobs addressed by SHA-256 of content, the
+ * manifest entries refer to blobs by hash and are keyed by FC UID, esc
+ * channel, kind of image and time of backup.
+ *
+ * File is magic followed by records: type, size and size bytes of data.
+ * Blob data is hash and image, entry data is esc_archive_entry_t.
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "zalloc.h"
+#include "esc_archive.h"
+
+#ifndef O_BINARY
+# define O_BINARY	0
+#endif
+
+struct esc_archive_rec {
+	uint32_t type;
+	uint32_t size;
+} __attribute__((__packed__));
+
+static esc_archive_blob_t *esc_archive_blob(esc_archive_t *a, const uint8_t *hash)
+{
+	int i;
+
+	for (i = 0; i < a->blobs; i++) {
+		if (!memcmp(a->blob[i].hash, hash, SHA256_SIZE))
+			return &a->blob[i];
+	}
+	return NULL;
+}
+
+static int esc_archive_add_blob(esc_archive_t *a, const uint8_t *hash, long offt, uint32_t size)
+{
+	esc_archive_blob_t *b;
+
+	b = realloc(a->blob, (a->blobs + 1) * sizeof(esc_archive_blob_t));
+	if (!b)
+		return -1;
+
+	a->blob = b;
+	b = &a->blob[a->blobs++];
+	memcpy(b->hash, hash, SHA256_SIZE);
+	b->offt = offt;
+	b->size = size;
+	return 0;
+}
+
+static int esc_archive_add_entry(esc_archive_t *a, const esc_archive_entry_t *e)
+{
+	esc_archive_entry_t *n;
+
+	n = realloc(a->entry, (a->entries + 1) * sizeof(esc_archive_entry_t));
+	if (!n)
+		return -1;
+
+	a->entry = n;
+	a->entry[a->entries++] = *e;
+	return 0;
+}
+
+static int esc_archive_read(int fd, void *buf, int len)
+{
+	int n;
+
+	if ((n = read(fd, buf, len)) < 0)
+		return -1;
+	return n == len ? 0 : -1;
+}
+
+/*
+ * Build index of blobs and entries, record cut by interrupted write
+ * is dropped
+ */
+static int esc_archive_scan(esc_archive_t *a)
+{
+	struct esc_archive_rec rec;
+	esc_archive_entry_t e;
+	uint8_t hash[SHA256_SIZE];
+	uint32_t magic;
+	long offt, end;
+
+	end = lseek(a->fd, 0, SEEK_END);
+	if (end == 0 && a->write) {
+		magic = ESC_ARCHIVE_MAGIC;
+		if (write(a->fd, &magic, sizeof(magic)) != sizeof(magic))
+			return -1;
+		return 0;
+	}
+
+	lseek(a->fd, 0, SEEK_SET);
+	if (esc_archive_read(a->fd, &magic, sizeof(magic)) < 0 ||
+	    magic != ESC_ARCHIVE_MAGIC) {
+		fprintf(stderr, "%s is not esc archive\n", a->fname);
+		return -1;
+	}
+
+	offt = sizeof(magic);
+	while (offt + sizeof(rec) <= end) {
+		if (esc_archive_read(a->fd, &rec, sizeof(rec)) < 0)
+			break;
+		if (offt + sizeof(rec) + rec.size > end)
+			break;
+
+		if (rec.type == ESC_ARCHIVE_BLOB && rec.size > SHA256_SIZE) {
+			if (esc_archive_read(a->fd, hash, SHA256_SIZE) < 0)
+				break;
+			if (esc_archive_add_blob(a, hash, offt + sizeof(rec) + SHA256_SIZE,
+						 rec.size - SHA256_SIZE) < 0)
+				return -1;
+		} else if (rec.type == ESC_ARCHIVE_ENTRY && rec.size == sizeof(e)) {
+			if (esc_archive_read(a->fd, &e, sizeof(e)) < 0)
+				break;
+			if (esc_archive_add_entry(a, &e) < 0)
+				return -1;
+		}
+
+		offt += sizeof(rec) + rec.size;
+		lseek(a->fd, offt, SEEK_SET);
+	}
+
+	if (offt != end) {
+		fprintf(stderr, "%s: %s %ld bytes of broken record\n", a->fname,
+				a->write ? "dropped" : "ignored", end - offt);
+		if (a->write && ftruncate(a->fd, offt) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+esc_archive_t *esc_archive_open(const char *fname, bool write)
+{
+	esc_archive_t *a;
+
+	a = zalloc(sizeof(esc_archive_t));
+	if (!a)
+		return NULL;
+
+	snprintf(a->fname, sizeof(a->fname), "%s", fname);
+	a->write = write;
+	a->fd = open(fname, write ? O_RDWR | O_CREAT | O_BINARY : O_RDONLY | O_BINARY, 0644);
+	if (a->fd < 0) {
+		fprintf(stderr, "Can't open archive %s, %s\n", fname, strerror(errno));
+		free(a);
+		return NULL;
+	}
+
+	if (esc_archive_scan(a) < 0) {
+		esc_archive_close(a);
+		return NULL;
+	}
+	return a;
+}
+
+void esc_archive_close(esc_archive_t *a)
+{
+	if (!a)
+		return;
+
+	close(a->fd);
+	free(a->blob);
+	free(a->entry);
+	free(a);
+}
+
+static int esc_archive_append(esc_archive_t *a, uint32_t type, const void *head, int head_len,
+			      const void *data, int len)
+{
+	struct esc_archive_rec rec;
+	long offt;
+
+	rec.type = type;
+	rec.size = head_len + len;
+
+	offt = lseek(a->fd, 0, SEEK_END);
+	if (write(a->fd, &rec, sizeof(rec)) != sizeof(rec) ||
+	    write(a->fd, head, head_len) != head_len ||
+	    (len && write(a->fd, data, len) != len)) {
+		fprintf(stderr, "Can't write archive %s, %s\n", a->fname, strerror(errno));
+		/* drop partial record, otherwise it is dropped by next open */
+		if (ftruncate(a->fd, offt) < 0)
+			fprintf(stderr, "Can't truncate archive %s\n", a->fname);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Add entry for image, image is stored only if archive has no equal one,
+ * return 1 if image is stored, 0 if it is already in archive
+ */
+int esc_archive_put(esc_archive_t *a, esc_archive_entry_t *e, const void *data)
+{
+	long offt;
+	int stored = 0;
+
+	if (!a->write) {
+		fprintf(stderr, "Archive %s is opened read only\n", a->fname);
+		return -1;
+	}
+
+	sha256(data, e->size, e->hash);
+
+	if (!esc_archive_blob(a, e->hash)) {
+		offt = lseek(a->fd, 0, SEEK_END);
+		if (esc_archive_append(a, ESC_ARCHIVE_BLOB, e->hash, SHA256_SIZE,
+				       data, e->size) < 0)
+			return -1;
+		if (esc_archive_add_blob(a, e->hash, offt + sizeof(struct esc_archive_rec) +
+					 SHA256_SIZE, e->size) < 0)
+			return -1;
+		stored = 1;
+	}
+
+	if (esc_archive_append(a, ESC_ARCHIVE_ENTRY, e, sizeof(*e), NULL, 0) < 0)
+		return -1;
+
+	if (esc_archive_add_entry(a, e) < 0)
+		return -1;
+
+	return stored;
+}
+
+/*
+ * Latest entry not newer than time, any time if time is 0
+ */
+const esc_archive_entry_t *esc_archive_find(esc_archive_t *a, const uint8_t *uid,
+					    int chan, int kind, uint64_t time)
+{
+	const esc_archive_entry_t *e, *found = NULL;
+	int i;
+
+	for (i = 0; i < a->entries; i++) {
+		e = &a->entry[i];
+		if (memcmp(e->uid, uid, ESC_ARCHIVE_UID_SIZE) || e->chan != chan ||
+		    e->kind != kind || (time && e->time > time))
+			continue;
+		if (!found || e->time >= found->time)
+			found = e;
+	}
+	return found;
+}
+
+/*
+ * Read image by hash, content is checked against hash
+ */
+int esc_archive_get(esc_archive_t *a, const uint8_t *hash, void *buf, int len)
+{
+	esc_archive_blob_t *b;
+	uint8_t check[SHA256_SIZE];
+	char str[SHA256_SIZE * 2 + 1];
+
+	if (!(b = esc_archive_blob(a, hash)) || b->size > len)
+		return -1;
+
+	if (lseek(a->fd, b->offt, SEEK_SET) != b->offt ||
+	    esc_archive_read(a->fd, buf, b->size) < 0) {
+		fprintf(stderr, "Can't read archive %s\n", a->fname);
+		return -1;
+	}
+
+	sha256(buf, b->size, check);
+	if (memcmp(check, hash, SHA256_SIZE)) {
+		sha256_str(hash, str);
+		fprintf(stderr, "Archive %s: image %s is damaged\n", a->fname, str);
+		return -1;
+	}
+	return b->size;
+}
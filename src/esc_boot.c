@@ -9,6 +9,7 @@
 #include <unistd.h>
 
 #include "serial.h"
+#include "transport.h"
 #include "dump_hex.h"
 #include "crc.h"
 #include "esc_boot.h"
@@ -40,9 +41,9 @@ int esc_boot_send(serial_handle fd, const void *buf, int len)
 {
 	uint16_t crc = crc_calc(buf, len);
 
-	if (serial_write(fd, buf, len) != len)
+	if (transport_write(fd, buf, len) != len)
 		return -1;
-	if (serial_write(fd, &crc, 2) != 2)
+	if (transport_write(fd, &crc, 2) != 2)
 		return -1;
 
 	return len + 2;
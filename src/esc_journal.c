@@ -0,0 +1,97 @@
+/*
+ * esc flash journal
+ *
+ * Records which steps of flashing a firmware image to esc channel are
+ * done, so an interrupted flash continues instead of starting over.
+ * Blocks recorded here are still checked with cmd_DeviceVerify before
+ * they are skipped.
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "state.h"
+#include "esc_journal.h"
+
+#ifndef O_BINARY
+# define O_BINARY	0
+#endif
+
+/*
+ * Load journal of device channel, return 1 if journal is for the same
+ * esc and image and can be resumed, 0 if new journal is started
+ */
+int esc_journal_open(esc_journal_t *j, const char *dev, int chan,
+		     const uint8_t *uid, const uint8_t *hash, int addr, int size)
+{
+	char name[32];
+	int fl, n;
+
+	memset(j, 0, sizeof(esc_journal_t));
+
+	snprintf(name, sizeof(name), "esc%d.journal", chan);
+	if (state_path(j->path, sizeof(j->path), dev, name) < 0)
+		return -1;
+
+	fl = open(j->path, O_RDONLY | O_BINARY);
+	if (fl >= 0) {
+		n = read(fl, &j->rec, sizeof(j->rec));
+		close(fl);
+
+		if (n == sizeof(j->rec) && j->rec.magic == ESC_JOURNAL_MAGIC &&
+		    !memcmp(j->rec.uid, uid, ESC_JOURNAL_UID_SIZE) &&
+		    !memcmp(j->rec.hash, hash, SHA256_SIZE) &&
+		    j->rec.addr == addr && j->rec.size == size)
+			return 1;
+	}
+
+	memset(&j->rec, 0, sizeof(j->rec));
+	j->rec.magic = ESC_JOURNAL_MAGIC;
+	memcpy(j->rec.uid, uid, ESC_JOURNAL_UID_SIZE);
+	memcpy(j->rec.hash, hash, SHA256_SIZE);
+	j->rec.addr = addr;
+	j->rec.size = size;
+	return 0;
+}
+
+int esc_journal_save(esc_journal_t *j)
+{
+	int fl, n;
+
+	fl = open(j->path, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+	if (fl < 0) {
+		fprintf(stderr, "Can't open journal %s, %s\n", j->path, strerror(errno));
+		return -1;
+	}
+
+	n = write(fl, &j->rec, sizeof(j->rec));
+	close(fl);
+
+	if (n != sizeof(j->rec)) {
+		fprintf(stderr, "Can't write journal %s\n", j->path);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Record step done, journal may be NULL if disabled
+ */
+int esc_journal_mark(esc_journal_t *j, uint32_t mark)
+{
+	if (!j)
+		return 0;
+
+	j->rec.marks |= mark;
+	return esc_journal_save(j);
+}
+
+void esc_journal_remove(esc_journal_t *j)
+{
+	unlink(j->path);
+}
@@ -0,0 +1,283 @@
+/*
+ * file input/output helpers
+ *
+ * Input images are mapped (or read at once on Windows) so the flash loop
+ * does not make a syscall per block. Output goes through a writer thread
+ * with two buffers, while one is filled from the link the other is
+ * written to disk.
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef __MINGW32__
+#include <sys/mman.h>
+#endif
+
+#include "zalloc.h"
+#include "file_io.h"
+
+#ifndef O_BINARY
+# define O_BINARY	0
+#endif
+
+/*
+ *
+ */
+int file_map(const char *fname, file_map_t *map)
+{
+	struct stat stat;
+	void *data;
+	int fl;
+
+	memset(map, 0, sizeof(file_map_t));
+
+	if (!strlen(fname)) {
+		printf("Invalid file name: <%s>\n", fname);
+		return -1;
+	}
+
+	fl = open(fname, O_RDONLY | O_BINARY);
+	if (fl < 0) {
+		fprintf(stderr, "Can't open file %s, %s\n", fname, strerror(errno));
+		return -1;
+	}
+
+	if (fstat(fl, &stat) < 0) {
+		fprintf(stderr, "Can't get file %s size, %s\n", fname, strerror(errno));
+		close(fl);
+		return -1;
+	}
+
+	if (stat.st_size == 0) {
+		close(fl);
+		return 0;
+	}
+
+#ifndef __MINGW32__
+	data = mmap(NULL, stat.st_size, PROT_READ, MAP_PRIVATE, fl, 0);
+	if (data != MAP_FAILED) {
+		close(fl);
+		map->data = data;
+		map->size = stat.st_size;
+		map->mapped = 1;
+		return 0;
+	}
+#endif
+	/* not mappable, read whole file */
+	data = malloc(stat.st_size);
+	if (!data) {
+		close(fl);
+		return -1;
+	}
+
+	map->size = 0;
+	while (map->size < stat.st_size) {
+		int n = read(fl, (uint8_t *)data + map->size, stat.st_size - map->size);
+		if (n <= 0) {
+			fprintf(stderr, "Can't read file %s, %s\n", fname,
+					n < 0 ? strerror(errno) : "short read");
+			free(data);
+			close(fl);
+			return -1;
+		}
+		map->size += n;
+	}
+	close(fl);
+	map->data = data;
+	return 0;
+}
+
+void file_unmap(file_map_t *map)
+{
+	if (!map->data)
+		return;
+#ifndef __MINGW32__
+	if (map->mapped)
+		munmap((void *)map->data, map->size);
+	else
+#endif
+		free((void *)map->data);
+
+	map->data = NULL;
+	map->size = 0;
+}
+
+/*****************************************************************************/
+
+struct file_writer {
+	int fd;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint8_t buf[2][FILE_WRITER_BUF_SIZE];
+	int len[2];
+	/* buffer filled by caller */
+	int fill;
+	/* buffer handed to thread, -1 if none */
+	int busy;
+	int stop;
+	int err;
+};
+
+static void *file_writer_thread(void *arg)
+{
+	file_writer_t *fw = arg;
+	int b, n, off, err;
+
+	pthread_mutex_lock(&fw->lock);
+	for (;;) {
+		while (fw->busy < 0 && !fw->stop)
+			pthread_cond_wait(&fw->cond, &fw->lock);
+
+		if (fw->busy < 0)
+			break;
+
+		b = fw->busy;
+		pthread_mutex_unlock(&fw->lock);
+
+		off = 0;
+		err = 0;
+		while (off < fw->len[b]) {
+			n = write(fw->fd, &fw->buf[b][off], fw->len[b] - off);
+			if (n < 0 && errno == EINTR)
+				continue;
+			/* nothing written is an error too, or it loops forever */
+			if (n <= 0) {
+				err = n < 0 ? errno : EIO;
+				break;
+			}
+			off += n;
+		}
+
+		pthread_mutex_lock(&fw->lock);
+		if (err && !fw->err)
+			fw->err = err;
+		fw->len[b] = 0;
+		fw->busy = -1;
+		pthread_cond_broadcast(&fw->cond);
+	}
+	pthread_mutex_unlock(&fw->lock);
+	return NULL;
+}
+
+/*
+ * Hand filled buffer to thread, wait if previous is not written yet
+ */
+static int file_writer_flip(file_writer_t *fw)
+{
+	int err;
+
+	pthread_mutex_lock(&fw->lock);
+	while (fw->busy >= 0)
+		pthread_cond_wait(&fw->cond, &fw->lock);
+
+	if (fw->len[fw->fill]) {
+		fw->busy = fw->fill;
+		fw->fill ^= 1;
+		pthread_cond_broadcast(&fw->cond);
+	}
+	err = fw->err;
+	pthread_mutex_unlock(&fw->lock);
+
+	if (err) {
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+file_writer_t *file_writer_open(const char *fname)
+{
+	file_writer_t *fw;
+
+	if (!strlen(fname)) {
+		printf("Invalid file name: <%s>\n", fname);
+		return NULL;
+	}
+
+	fw = zalloc(sizeof(file_writer_t));
+	if (!fw)
+		return NULL;
+
+	fw->fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+	if (fw->fd < 0) {
+		fprintf(stderr, "Can't open file %s, %s\n", fname, strerror(errno));
+		free(fw);
+		return NULL;
+	}
+
+	fw->busy = -1;
+	pthread_mutex_init(&fw->lock, NULL);
+	pthread_cond_init(&fw->cond, NULL);
+
+	if (pthread_create(&fw->thread, NULL, file_writer_thread, fw) != 0) {
+		fprintf(stderr, "Can't create writer thread\n");
+		pthread_cond_destroy(&fw->cond);
+		pthread_mutex_destroy(&fw->lock);
+		close(fw->fd);
+		free(fw);
+		return NULL;
+	}
+	return fw;
+}
+
+int file_writer_write(file_writer_t *fw, const void *data, int len)
+{
+	const uint8_t *p = data;
+	int n;
+
+	while (len > 0) {
+		n = FILE_WRITER_BUF_SIZE - fw->len[fw->fill];
+		if (n > len)
+			n = len;
+
+		memcpy(&fw->buf[fw->fill][fw->len[fw->fill]], p, n);
+		fw->len[fw->fill] += n;
+		p += n;
+		len -= n;
+
+		if (fw->len[fw->fill] == FILE_WRITER_BUF_SIZE) {
+			if (file_writer_flip(fw) < 0)
+				return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Flush buffers, stop thread and close file
+ */
+int file_writer_close(file_writer_t *fw)
+{
+	int err;
+
+	err = file_writer_flip(fw);
+
+	pthread_mutex_lock(&fw->lock);
+	fw->stop = 1;
+	pthread_cond_broadcast(&fw->cond);
+	pthread_mutex_unlock(&fw->lock);
+	pthread_join(fw->thread, NULL);
+
+	if (fw->err) {
+		errno = fw->err;
+		err = -1;
+	}
+
+	if (close(fw->fd) < 0)
+		err = -1;
+
+	pthread_mutex_destroy(&fw->lock);
+	pthread_cond_destroy(&fw->cond);
+	free(fw);
+	return err;
+}
@@ -9,8 +9,11 @@
 
 #include "msp.h"
 #include "msp_serial.h"
+#include "transport.h"
 #include "crc.h"
 #include "dump_hex.h"
+#include "rtt.h"
+#include "tstamp.h"
 
 //#define DEBUG
 #include "debug.h"
@@ -28,18 +31,20 @@
 # define verrmsg_errno(...)
 #endif
 
+#define MSP_CLI_PROMPT_LEN	((int)sizeof(MSP_CLI_PROMPT) - 1)
+
 int msp_raw_transmit(serial_handle fd, const void *out, int out_size,
 			void *in, int in_size)
 {
 	int len;
 
-	if ((len = serial_write(fd, out, out_size)) < 0) {
+	if ((len = transport_write(fd, out, out_size)) < 0) {
 		verrmsg_errno("Serial write faled %d", len);
 		return -1;
 	}
 	verbose_msg("msp transmited %d\n", len);
 
-	if ((len = serial_read(fd, in, in_size)) < 0) {
+	if ((len = transport_read(fd, in, in_size)) < 0) {
 		verrmsg_errno("Serial read faled %d", len);
 		return -1;
 	}
@@ -48,51 +53,112 @@ int msp_raw_transmit(serial_handle fd, const void *out, int out_size,
 	return len;
 }
 
+/*
+ * Read exactly len bytes, or less on timeout
+ */
+static int msp_read(serial_handle fd, void *in, int len)
+{
+	uint8_t *p = in;
+	int n, rd = 0;
+
+	while (rd < len) {
+		if ((n = transport_read(fd, p + rd, len - rd)) < 0) {
+			verrmsg_errno("Serial read faled %d", n);
+			return -1;
+		}
+		if (n == 0)
+			break;
+		rd += n;
+	}
+	return rd;
+}
+
+/*
+ * MSP v2 frame of cmd and payload, return frame length or -1 if buffer
+ * is short
+ */
+int msp_encode(void *buf, int size, uint16_t cmd, int dir, const void *data, int len)
+{
+	uint8_t *p = buf;
+	mspHeaderV2_t *mh = (mspHeaderV2_t *)&p[3];
+
+	if (len < 0 || 3 + sizeof(mspHeaderV2_t) + len + 1 > size)
+		return -1;
+
+	p[0] = '$';
+	p[1] = 'X';
+	p[2] = dir ? '<' : '>';
+
+	mh->flags = 0;
+	mh->cmd = cmd;
+	mh->size = len;
+	if (len)
+		memcpy(&p[3 + sizeof(mspHeaderV2_t)], data, len);
+
+	p[3 + sizeof(mspHeaderV2_t) + len] = crc8_cal_buf(mh, sizeof(mspHeaderV2_t) + len,
+							   MSP_CRC_POLY);
+	return 3 + sizeof(mspHeaderV2_t) + len + 1;
+}
+
 int msp_transmit(serial_handle fd, uint16_t cmd, int dir, const void *out, int out_size,
 		 void *in, int in_size)
 {
 	mspHeaderV2_t *mh;
 	uint8_t *arg;
 	uint8_t buf[256];
-	int len = 0;
+	int len;
 	uint8_t crc;
-
-	buf[0] = '$';
-	buf[1] = 'X';
-	buf[2] = dir ? '<' : '>';
-	len += 3;
+	double t;
 
 	mh = (mspHeaderV2_t *)&buf[3];
 	arg = &buf[3 + sizeof(mspHeaderV2_t)];
 
-	mh->flags = 0;
-	mh->cmd = cmd;
-	memcpy(arg, out, out_size);
-	mh->size = out_size;
-
-	len += sizeof(mspHeaderV2_t) + mh->size;
-
-	arg[mh->size] = crc8_cal_buf(mh, sizeof(mspHeaderV2_t) + mh->size, MSP_CRC_POLY);
-	len += 1;
+	if ((len = msp_encode(buf, sizeof(buf), cmd, dir, out, out_size)) < 0) {
+		verbose_msg("Payload %d is too long\n", out_size);
+		return -1;
+	}
 
 	verbose_msg("Write\n");
 	vdump_hex(buf, len, 1);
 
-	if ((len = msp_raw_transmit(fd, buf, len, buf, sizeof(buf))) < 1)
-		return -1;
+	rtt_set_timeout(fd, RTT_MSP);
 
-	verbose_msg("Read\n");
-	vdump_hex(buf, len, 1);
+	if (transport_write(fd, buf, len) != len) {
+		verrmsg_errno("Serial write faled");
+		return -1;
+	}
+	t = tstamp();
+
+	/* read header first and then exactly payload and crc, so reply
+	 * is complete when it is received, not on timeout */
+	len = 3 + sizeof(mspHeaderV2_t);
+	if (msp_read(fd, buf, len) != len) {
+		verbose_msg("Reply timeout\n");
+		rtt_backoff(rtt_model(RTT_MSP));
+		return -1;
+	}
 
 	if (buf[0] != '$') {
 		verbose_msg("Invalid reply header 0x%02x\n", buf[0]);
 		return -1;
 	}
 
-	if (len != sizeof(mspHeaderV2_t) + mh->size + 1 + 3) {
-		verbose_msg("Invalid reply len %d\n", len);
+	if (mh->size + 1 > sizeof(buf) - len) {
+		verbose_msg("Invalid reply size %d\n", mh->size);
+		return -1;
+	}
+
+	if (msp_read(fd, arg, mh->size + 1) != mh->size + 1) {
+		verbose_msg("Reply payload timeout\n");
+		rtt_backoff(rtt_model(RTT_MSP));
 		return -1;
 	}
+	len += mh->size + 1;
+
+	rtt_update(rtt_model(RTT_MSP), tstamp() - t);
+
+	verbose_msg("Read\n");
+	vdump_hex(buf, len, 1);
 
 	crc = crc8_cal_buf(mh, sizeof(mspHeaderV2_t) + mh->size, MSP_CRC_POLY);
 	if (crc != arg[mh->size]) {
@@ -113,40 +179,96 @@ int msp_transmit(serial_handle fd, uint16_t cmd, int dir, const void *out, int o
 
 }
 
+/*
+ * Prompt of output is counted, match of its bytes is kept between reads
+ */
+static void msp_cli_match(msp_cli_t *cli, const char *p, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if (cli->match < MSP_CLI_PROMPT_LEN && p[i] == MSP_CLI_PROMPT[cli->match]) {
+			if (++cli->match == MSP_CLI_PROMPT_LEN)
+				cli->prompts++;
+		} else {
+			cli->match = p[i] == MSP_CLI_PROMPT[0];
+		}
+	}
+}
+
+bool msp_cli_at_prompt(const msp_cli_t *cli)
+{
+	return cli->match == MSP_CLI_PROMPT_LEN;
+}
+
+int msp_cli_read(serial_handle fd, msp_cli_t *cli, double tmo, char *buf, int size)
+{
+	int n;
+
+	transport_set_timeout(fd, 0);
+	if ((n = transport_poll(fd, tmo)) <= 0)
+		return n;
+	if ((n = transport_read(fd, buf, size - 1)) < 0)
+		return -1;
+
+	buf[n] = '\0';
+	msp_cli_match(cli, buf, n);
+	if (cli->pr)
+		printf("%s", buf);
+	return n;
+}
+
+/*
+ * Output is read until prompt or until it stops for drain timeout, when
+ * FC gives no prompt (exit, save). Prompt is taken when nothing follows
+ * it in round trip time, as comment lines of dump start with the same
+ * bytes. Command without new line is only echoed.
+ */
 int msp_cmd_transmit(serial_handle fd, const char *out, char *in, int in_size, int pr)
 {
-	int len;
-	char temp_in[1024];
-	char *pin = in;
-	int sz;
+	msp_cli_t cli = {.pr = pr};
+	char buf[1024];
+	int len, echo, rd = 0;
+	bool first = true;
+	double t, tmo;
+
+	echo = strpbrk(out, "\r\n") ? 0 : strlen(out);
 
 	/* write out */
 	verbose_msg("cmd send: %s\n", out);
-	if ((len = serial_write(fd, out, strlen(out))) < 0)
+	if ((len = transport_write(fd, out, strlen(out))) < 0)
 		return -1;
-
-	sz = in_size - 1;
-	while (sz && (len = serial_read(fd, pin, sz)) > 0) {
-		pin += len;
-		sz -= len;
+	t = tstamp();
+
+	/* first byte of reply gives round trip time */
+	tmo = rtt_model(RTT_CLI)->rto;
+	while ((len = msp_cli_read(fd, &cli, tmo, buf, sizeof(buf))) > 0) {
+		if (first) {
+			rtt_update(rtt_model(RTT_CLI), tstamp() - t);
+			first = false;
+		}
+
+		if (len > in_size - 1 - rd)
+			len = in_size - 1 - rd;
+		memcpy(in + rd, buf, len);
+		rd += len;
+
+		if (echo && rd >= echo && !memcmp(in, out, echo))
+			tmo = 0;
+		else if (msp_cli_at_prompt(&cli))
+			tmo = rtt_model(RTT_CLI)->rto;
+		else
+			tmo = MSP_CLI_DRAIN_TIMEOUT;
 	}
-	pin[0] = '\0';
+	in[rd] = '\0';
 
 	if (len < 0)
 		return -1;
+	if (first)
+		rtt_backoff(rtt_model(RTT_CLI));
 
 	verbose_msg("reply\n%s\n", in);
-	vdump_hex(in, in_size - sz, 1);
-
-	if (pr)
-		printf("%s", in);
-
-	/* flush serial input */
-	while ((len = serial_read(fd, temp_in, sizeof(temp_in) - 1)) > 0) {
-		temp_in[len] = '\0';
-		if (pr)
-			printf("%s", temp_in);
-	}
+	vdump_hex(in, rd, 1);
 
 	if (pr)
 		printf("\n");
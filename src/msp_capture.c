@@ -0,0 +1,320 @@
+/*
+ * msp capture
+ *
+ * Getters are sent with several of them outstanding, so link latency is
+ * hidden and rate is limited by FC MSP service only. FC answers requests
+ * one by one in order, replies are matched to ring of sent requests, so
+ * late reply of request counted lost is not taken for reply of a new
+ * one. Every reply is time stamped on receive
+ * (CLOCK_MONOTONIC) and appended to the log through buffers of the
+ * background file writer, nothing is allocated while capturing.
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "msp.h"
+#include "msp_protocol.h"
+#include "msp_parser.h"
+#include "msp_serial.h"
+#include "msp_codec.h"
+#include "msp_capture.h"
+#include "transport.h"
+#include "file_io.h"
+#include "rtt.h"
+#include "tstamp.h"
+
+#define ARRAYLEN(x)			(sizeof(x) / sizeof((x)[0]))
+
+/* requests of one sample, first one is timed */
+static const uint16_t msp_capture_cmds[] = {MSP_RAW_IMU, MSP_ATTITUDE};
+
+#define MSP_CAPTURE_CMDS		ARRAYLEN(msp_capture_cmds)
+/* $X< header and crc, no payload */
+#define MSP_CAPTURE_REQ_SIZE		(3 + sizeof(mspHeaderV2_t) + 1)
+
+typedef struct msp_capture_stat {
+	unsigned int samples;
+	unsigned int errors;
+	unsigned int lost;
+	/* replies of requests counted lost or not sent */
+	unsigned int late;
+	/* time of previous sample */
+	double last;
+	/* intervals between samples */
+	unsigned int intervals;
+	double min;
+	double max;
+	double sum;
+	double sum2;
+} msp_capture_stat_t;
+
+static void msp_capture_sample(msp_capture_stat_t *st, double t)
+{
+	double dt = t - st->last;
+
+	if (st->samples++) {
+		if (!st->intervals || dt < st->min)
+			st->min = dt;
+		if (dt > st->max)
+			st->max = dt;
+		st->sum += dt;
+		st->sum2 += dt * dt;
+		st->intervals++;
+	}
+	st->last = t;
+}
+
+typedef struct msp_capture_req {
+	uint16_t cmd;
+	/* time request is counted lost, 0 if waiting for reply */
+	double lost;
+} msp_capture_req_t;
+
+typedef struct msp_capture_ring {
+	msp_capture_req_t req[MSP_CAPTURE_INFLIGHT];
+	/* oldest request */
+	unsigned int head;
+	unsigned int num;
+	/* waiting for reply */
+	unsigned int inflight;
+} msp_capture_ring_t;
+
+static msp_capture_req_t *msp_capture_req(msp_capture_ring_t *r, unsigned int i)
+{
+	return &r->req[(r->head + i) % MSP_CAPTURE_INFLIGHT];
+}
+
+/*
+ * Remove oldest request, it is lost if not counted yet
+ */
+static void msp_capture_pop(msp_capture_ring_t *r, msp_capture_stat_t *st)
+{
+	if (!msp_capture_req(r, 0)->lost) {
+		st->lost++;
+		r->inflight--;
+	}
+	r->head = (r->head + 1) % MSP_CAPTURE_INFLIGHT;
+	r->num--;
+}
+
+/*
+ * Requests of sample can be sent. Nothing is sent while lost requests
+ * are kept, reply of the same command can't tell which one it answers
+ */
+static bool msp_capture_room(const msp_capture_ring_t *r)
+{
+	return r->num == r->inflight &&
+	       r->inflight + MSP_CAPTURE_CMDS <= MSP_CAPTURE_INFLIGHT;
+}
+
+static void msp_capture_push(msp_capture_ring_t *r, uint16_t cmd)
+{
+	msp_capture_req_t *q;
+
+	q = msp_capture_req(r, r->num++);
+	q->cmd = cmd;
+	q->lost = 0;
+	r->inflight++;
+}
+
+/*
+ * Count requests waiting for reply lost, they are kept for rto to
+ * recognize their late replies
+ */
+static void msp_capture_lose(msp_capture_ring_t *r, msp_capture_stat_t *st, double t)
+{
+	msp_capture_req_t *q;
+	unsigned int i;
+
+	for (i = 0; i < r->num; i++) {
+		q = msp_capture_req(r, i);
+		if (!q->lost) {
+			q->lost = t;
+			st->lost++;
+		}
+	}
+	r->inflight = 0;
+}
+
+static void msp_capture_expire(msp_capture_ring_t *r, msp_capture_stat_t *st,
+			       double t, double rto)
+{
+	while (r->num && msp_capture_req(r, 0)->lost && t - msp_capture_req(r, 0)->lost > rto)
+		msp_capture_pop(r, st);
+}
+
+/*
+ * Match reply to the oldest request of the same command, requests before
+ * it are not answered by FC. Return true if reply is of request waiting
+ * for it, false for late reply or reply nobody asked for
+ */
+static bool msp_capture_match(msp_capture_ring_t *r, msp_capture_stat_t *st, uint16_t cmd)
+{
+	msp_capture_req_t *q;
+	unsigned int i;
+	bool lost;
+
+	for (i = 0; i < r->num; i++) {
+		if (msp_capture_req(r, i)->cmd == cmd)
+			break;
+	}
+	if (i == r->num) {
+		st->late++;
+		return false;
+	}
+
+	while (i--)
+		msp_capture_pop(r, st);
+
+	q = msp_capture_req(r, 0);
+	lost = q->lost;
+	if (lost)
+		st->late++;
+	else
+		r->inflight--;
+	r->head = (r->head + 1) % MSP_CAPTURE_INFLIGHT;
+	r->num--;
+
+	return !lost;
+}
+
+static void msp_capture_stat_printf(const msp_capture_stat_t *st, double time, int hz)
+{
+	double mean, var;
+
+	printf("IMU samples: %u in %.2f s, %.1f Hz", st->samples, time,
+	       time > 0 ? st->samples / time : 0);
+	if (hz)
+		printf(" of %d Hz requested", hz);
+	printf("\n");
+
+	if (st->intervals) {
+		mean = st->sum / st->intervals;
+		var = st->sum2 / st->intervals - mean * mean;
+		printf("Interval: mean %.2f ms, jitter %.2f ms, min %.2f ms, max %.2f ms\n",
+		       mean * 1000, sqrt(var > 0 ? var : 0) * 1000,
+		       st->min * 1000, st->max * 1000);
+	}
+	printf("Errors: %u, lost: %u, late: %u\n", st->errors, st->lost, st->late);
+}
+
+int msp_capture_imu(serial_handle fd, int hz, int seconds, const char *fname)
+{
+	uint8_t req[MSP_CAPTURE_CMDS * MSP_CAPTURE_REQ_SIZE];
+	msp_capture_stat_t st = {0};
+	msp_capture_ring_t ring = {0};
+	const msp_frame_t *f;
+	msp_parser_t parser;
+	uint8_t buf[MSP_PARSER_FRAME_MAX];
+	file_writer_t *fw;
+	double t0, t, end, next, period, last_rx, tmo;
+	int i, n, off, len, req_len = 0;
+	int err = 0;
+
+	if (hz < 0 || seconds <= 0 || seconds > MSP_CAPTURE_SECONDS_MAX) {
+		fprintf(stderr, "Invalid rate %d Hz or time %d s, up to %d s\n",
+			hz, seconds, MSP_CAPTURE_SECONDS_MAX);
+		return -1;
+	}
+
+	for (i = 0; i < MSP_CAPTURE_CMDS; i++)
+		req_len += msp_encode(&req[req_len], MSP_CAPTURE_REQ_SIZE, msp_capture_cmds[i],
+				      MSP_DIR_OUT, NULL, 0);
+
+	if (!(fw = file_writer_open(fname)))
+		return -1;
+
+	msp_parser_init(&parser);
+	period = hz ? 1.0 / hz : 0;
+	t0 = tstamp();
+	end = t0 + seconds;
+	next = t0;
+	last_rx = t0;
+
+	for (;;) {
+		t = tstamp();
+		if (t >= end && !ring.inflight)
+			break;
+
+		/* FC dropped requests, do not wait for them */
+		if (ring.inflight && t - last_rx > rtt_model(RTT_MSP)->rto) {
+			msp_capture_lose(&ring, &st, t);
+			msp_parser_init(&parser);
+			continue;
+		}
+		msp_capture_expire(&ring, &st, t, rtt_model(RTT_MSP)->rto);
+
+		if (t < end && t >= next && msp_capture_room(&ring)) {
+			if (transport_write(fd, req, req_len) != req_len) {
+				fprintf(stderr, "Can't send request\n");
+				err = -1;
+				break;
+			}
+			if (!ring.inflight)
+				last_rx = t;
+			for (i = 0; i < MSP_CAPTURE_CMDS; i++)
+				msp_capture_push(&ring, msp_capture_cmds[i]);
+			next += period;
+			/* late, no burst to catch up */
+			if (next < t)
+				next = t;
+			continue;
+		}
+
+		/* reply or time of next request, whichever comes first, serial
+		 * read waits for all bytes asked, so ask for what parser wants */
+		tmo = rtt_model(RTT_MSP)->rto;
+		if (t < end && msp_capture_room(&ring) && next - t < tmo)
+			tmo = next - t;
+		if (tmo < 0.001)
+			tmo = 0.001;
+		transport_set_timeout(fd, tmo);
+
+		if ((len = transport_read(fd, buf, msp_parser_want(&parser))) < 0) {
+			fprintf(stderr, "Can't read reply\n");
+			err = -1;
+			break;
+		}
+		if (!len)
+			continue;
+
+		t = tstamp();
+		last_rx = t;
+
+		for (off = 0; off < len && !err; off += n) {
+			n = msp_parser_feed(&parser, buf + off, len - off, &f);
+			if (!f || !msp_capture_match(&ring, &st, f->cmd))
+				continue;
+
+			if (f->dir != '>') {
+				st.errors++;
+				continue;
+			}
+
+			if (f->cmd == msp_capture_cmds[0])
+				msp_capture_sample(&st, t);
+
+			if (msp_codec_log(fw, t - t0, f->cmd, f->payload, f->size) < 0) {
+				fprintf(stderr, "Can't write %s\n", fname);
+				err = -1;
+			}
+		}
+		if (err)
+			break;
+	}
+
+	rtt_set_timeout(fd, RTT_MSP);
+
+	if (file_writer_close(fw) < 0)
+		err = -1;
+
+	msp_capture_stat_printf(&st, tstamp() - t0, hz);
+
+	return err;
+}
@@ -9,11 +9,14 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <ctype.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <time.h>
 
 #include "failure.h"
 #include "bf.h"
@@ -23,6 +26,26 @@
 #include "esc4way.h"
 #include "cmd_arg.h"
 #include "dump_hex.h"
+#include "file_io.h"
+#include "progress.h"
+#include "sha256.h"
+#include "rtt.h"
+#include "state.h"
+#include "tstamp.h"
+#include "esc_journal.h"
+#include "esc_archive.h"
+#include "bridge.h"
+#include "msp_proxy.h"
+#include "transport.h"
+#include "msp_snapshot.h"
+#include "msp_codec.h"
+#include "emit.h"
+#include "msp_capture.h"
+#include "msp_sweep.h"
+#include "msp_wave.h"
+#include "msp_rc.h"
+#include "msp_gps.h"
+#include "msp_osd.h"
 
 #define xstr(a) str(a)
 #define str(a) #a
@@ -31,25 +54,25 @@
 # define O_BINARY	0
 #endif
 
-/* Betaflight baudrates */
-static const uint32_t bf_baud_rates[] = {
-	0, 9600, 19200, 38400, 57600, 115200, 230400, 250000,
-	400000, 460800, 500000, 921600, 1000000, 1500000, 2000000, 2470000
-};
+#define MSP_PASSTHROUGH_PORT			0
+#define MSP_PASSTHROUGH_BAUD			420000
 
-#define ARRAYLEN(x)				(sizeof(x) / sizeof((x)[0]))
-#define BAUD_RATE_COUNT				ARRAYLEN(bf_baud_rates)
+#define MSP_UID_SIZE				12
+/* CLI lines of sendfile which are sent ahead of their prompts */
+#define MSP_CLI_WINDOW				4
 
-/*
- *
- */
-static const uint32_t bf_baud_rate(uint8_t index)
-{
-	if (index > BAUD_RATE_COUNT)
-		index = 0;
+/* requests per baud rate and errors allowed */
+#define AUTOBAUD_PROBES				16
+#define AUTOBAUD_MAX_ERRORS			0
+#define AUTOBAUD_DRAIN_TIMEOUT			0.05
+/* FC port is not set faster by default, the most of USB UART do it */
+#define AUTOBAUD_FC_MAX				921600
+/* FC answers after reboot, seconds */
+#define AUTOBAUD_REBOOT_TIMEOUT			5
+/* ports of FC serial config */
+#define AUTOBAUD_PORTS_MAX			16
 
-	return bf_baud_rates[index];
-}
+#define BAUD_RATE_COUNT				BF_BAUD_RATE_COUNT
 
 #ifdef __MINGW32__
 ssize_t getline(char **lineptr, size_t *n, FILE *stream) 
@@ -105,90 +128,22 @@ ssize_t getline(char **lineptr, size_t *n, FILE *stream)
 #endif
 
 /*
- *
- */
-static void dump_serial_config(const void *data, unsigned int data_len)
-{
-	int count;
-	int i;
-	const uint8_t *p = data;
-
-	count = *p++;
-	printf("Serial ports count: %d\n", count);
-	for (i = 0; i < count; i++) {
-		printf("Identifier: %u\n", *p++);
-		printf("Functions mask:\t\t\t0x%08x\n", *(uint32_t *)p);
-		p += 4;
-		printf("MSP baud rate index:\t\t%u, %u\n", *p, bf_baud_rate(*p));
-		p++;
-		printf("GPS baud rate index:\t\t%u, %u\n", *p, bf_baud_rate(*p));
-		p++;
-		printf("Telemetry baud rate index:\t%u, %u\n", *p, bf_baud_rate(*p));
-		p++;
-		printf("Black box baud rate index:\t%u, %u\n", *p, bf_baud_rate(*p));
-		p++;
-	}
-}
-
-/*
- *
- */
-static void dump_analog(const void *data, unsigned int data_len)
-{
-	const uint8_t *p = data;
-
-	printf("Analog data:\n");
-	printf("Battery V:\t\t%u\n", *p++);
-	printf("Battery mAh:\t\t%u\n", *(uint16_t *)p);
-	p += 2;
-	printf("RSSI:\t\t\t%u\n", *(uint16_t *)p);
-	p += 2;
-	printf("Current mA:\t\t%d\n", (int32_t)(*(int16_t *)p) * 10);
-	p += 2;
-	printf("Battery V:\t\t%u\n", *(uint16_t *)p);
-	p += 2;
-}
-
-/*
- *
- */
-static void dump_tx_info(const void *data, unsigned int data_len)
-{
-	const uint8_t *p = data;
-
-	printf("TX info:\n");
-	printf("RSSI source:\t\t%u\n", *p++);
-	printf("Date and time is set:\t%u\n", *p++);
-}
-
-/*
- *
+ * Write EEPROM once for all setters of command line, before FC leaves
+ * MSP mode or reboots and at the end
  */
-static void dump_motor_telemetry(int num, int motor, motor_tlm_t *tlm)
+static int msp_eeprom_commit(msp_t *msp)
 {
-	int i;
-	int from = 0, to = num;
+	if (!msp->eeprom_dirty)
+		return 0;
 
-	if (motor >= num) {
-		printf("Invalid motor number: %d\nRange from %d to %d, or -1 for all\n",
-				motor, 0, num - 1);
-		return;
-	}
-	if (motor >= 0) {
-		from = motor;
-		to = motor + 1;
-		tlm += from;
+	if (bf_eeprom_write(msp->fd) < 0) {
+		fprintf(stderr, "EEPROM write failed\n");
+		return -1;
 	}
 
-	for (i = from; i < to; i++) {
-		printf("TELEMETRY motor %d:\n", i);
-		printf("RPM: %d\n", tlm->rpm);
-		printf("ERR: %d\n", tlm->invalid_pkt);
-		printf("T: %d\n", tlm->esc_temperature);
-		printf("V: %d\n", tlm->esc_voltage);
-		printf("I: %d\n", tlm->esc_current);
-		tlm++;
-	}
+	msp->eeprom_dirty = false;
+	printf("EEPROM saved\n");
+	return 0;
 }
 
 /*
@@ -198,6 +153,9 @@ static int msp_enter_to_cli(msp_t *msp, const char *arg)
 {
 	char data[256];
 
+	if (msp_eeprom_commit(msp) < 0)
+		return -1;
+
 	return msp_cmd_transmit(msp->fd, "#", data, sizeof(data), 1);
 }
 
@@ -215,35 +173,59 @@ static int msp_send_cli_cmd(msp_t *msp, const char *cmd)
 }
 
 /*
- *
+ * Lines are sent ahead of their output up to window, each line which is
+ * not empty is answered by prompt, so FC input buffer holds a few lines
+ * at most
  */
 static int msp_send_cli_file(msp_t *msp, const char *file)
 {
+	msp_cli_t cli = {.pr = 1};
 	char data[1024];
 	FILE *fdr;
 	char *line = NULL;
 	size_t rd = 0;
-	int n;
+	int n, sent = 0;
 	int err = 0;
 
 	if ((fdr = fopen(file, "r")) == NULL)
 		failure(errno, "Can't open input file %s", file);
 
-	/* set polling mode */
-	serial_set_timeout(msp->fd, 0.);
-
 	while ((n = getline(&line, &rd, fdr)) > 0) {
-		if (msp_cmd_transmit(msp->fd, line, data, sizeof(data), 1) < 0) {
+		while (sent - cli.prompts >= MSP_CLI_WINDOW) {
+			/* no prompt, line is lost or FC is gone */
+			if ((err = msp_cli_read(msp->fd, &cli, MSP_CLI_DRAIN_TIMEOUT,
+						data, sizeof(data))) <= 0) {
+				sent = cli.prompts;
+				break;
+			}
+		}
+		if (err < 0)
+			break;
+
+		if (transport_write(msp->fd, line, n) != n) {
 			err = -1;
 			break;
 		}
+		if (strspn(line, "\r\n") != n)
+			sent++;
+
+		/* output which is in already */
+		while ((err = msp_cli_read(msp->fd, &cli, 0, data, sizeof(data))) > 0)
+			;
+		if (err < 0)
+			break;
 	}
-	if (n < 0)
+	if (n < 0 && !feof(fdr))
 		err = -1;
 
-	serial_set_timeout(msp->fd, 0.2);
-	/* new line is finish */
-	msp_cmd_transmit(msp->fd, "\n", data, sizeof(data), 1);
+	/* new line is finish, output of the last lines is waited for */
+	if (transport_write(msp->fd, "\n", 1) != 1)
+		err = -1;
+	while (msp_cli_read(msp->fd, &cli, cli.prompts >= sent && msp_cli_at_prompt(&cli) ?
+			    rtt_model(RTT_CLI)->rto : MSP_CLI_DRAIN_TIMEOUT,
+			    data, sizeof(data)) > 0)
+		;
+	printf("\n");
 
 	free(line);
 	fclose(fdr);
@@ -273,11 +255,204 @@ static int msp_set_motor(msp_t *msp, const char *arg)
 	return bf_set_motor(msp->fd, num, val);
 }
 
+/*
+ * Query message of codec table and print it in --format, record index
+ * or -1 for all
+ */
+static int msp_codec_query(msp_t *msp, uint16_t cmd, int index)
+{
+	const msp_codec_msg_t *m = msp_codec_find(cmd);
+	uint8_t data[256];
+	int len, num, i;
+
+	if ((len = msp_transmit(msp->fd, cmd, MSP_DIR_OUT, data, 0, data, sizeof(data))) < 0)
+		return -1;
+
+	if (!m && emit_format() != EMIT_TEXT) {
+		emit_map(NULL);
+		emit_int("cmd", cmd);
+		emit_array("payload");
+		for (i = 0; i < len; i++)
+			emit_int(NULL, data[i]);
+		emit_end();
+		emit_end();
+		return 0;
+	}
+
+	if (!m) {
+		dump_hex(data, len, 1);
+		return 0;
+	}
+
+	num = msp_codec_count(m, data, len);
+	if (index >= num) {
+		printf("Invalid index %d, range from 0 to %d, or -1 for all\n", index, num - 1);
+		return -1;
+	}
+
+	if (emit_format() != EMIT_TEXT)
+		msp_codec_emit(m, data, len, index);
+	else
+		msp_codec_printf(m, data, len, index);
+	return 0;
+}
+
+/*
+ * sweep <motors> <from> <to> <step> <dwell_ms>, motors as "all" or list
+ * "0,2-3", motor count is taken from FC
+ */
+static int msp_sweep(msp_t *msp, const char *arg)
+{
+	bool motors[BF_MOTOR_MAX_NUM];
+	int val[BF_MOTOR_MAX_NUM];
+	int num = BF_MOTOR_MAX_NUM;
+	char list[64];
+	int sw[4];
+	int i;
+
+	cmd_name_copy(arg, list, sizeof(list));
+	arg = cmd_arg_next(arg);
+	if (!arg || cmd_arg_to_int(arg, sw, 4) != 4) {
+		fprintf(stderr, "Motors, from, to, step and dwell time expected\n");
+		return -1;
+	}
+
+	if (bf_get_motor(msp->fd, &num, val) < 0)
+		return -1;
+	if (num > BF_MOTOR_MAX_NUM)
+		num = BF_MOTOR_MAX_NUM;
+
+	if (!strcmp(list, "all")) {
+		for (i = 0; i < BF_MOTOR_MAX_NUM; i++)
+			motors[i] = i < num;
+	} else if (cmd_arg_to_set(list, motors, BF_MOTOR_MAX_NUM) < 0) {
+		fprintf(stderr, "Invalid motors: %s\n", list);
+		return -1;
+	} else {
+		for (i = num; i < BF_MOTOR_MAX_NUM; i++) {
+			if (motors[i]) {
+				fprintf(stderr, "FC has %d motors\n", num);
+				return -1;
+			}
+		}
+	}
+
+	return msp_sweep_run(msp->fd, motors, num, sw[0], sw[1], sw[2], sw[3]);
+}
+
+/*
+ * waveform <hz> <file>, stream rows of motor values at fixed rate
+ */
+static int msp_waveform(msp_t *msp, const char *arg)
+{
+	int val[BF_MOTOR_MAX_NUM];
+	int num = BF_MOTOR_MAX_NUM;
+	char fname[256];
+	int hz;
+
+	hz = strtol(arg, NULL, 0);
+	arg = cmd_arg_next(arg);
+	if (!arg) {
+		fprintf(stderr, "Rate and waveform file name expected\n");
+		return -1;
+	}
+	cmd_name_copy(arg, fname, sizeof(fname));
+
+	if (bf_get_motor(msp->fd, &num, val) < 0)
+		return -1;
+
+	return msp_wave_run(msp->fd, fname, hz, num);
+}
+
+/*
+ * rcstream <hz> <file|-> [stall_ms], send stick frames to MSP_SET_RAW_RC
+ * at fixed rate, failsafe when input stalls
+ */
+static int msp_rcstream(msp_t *msp, const char *arg)
+{
+	int stall_ms = MSP_RC_STALL_MS_DEFAULT;
+	char src[256];
+	int hz;
+
+	hz = strtol(arg, NULL, 0);
+	arg = cmd_arg_next(arg);
+	if (!arg) {
+		fprintf(stderr, "Rate and input file name or - expected\n");
+		return -1;
+	}
+	cmd_name_copy(arg, src, sizeof(src));
+
+	arg = cmd_arg_next(arg);
+	if (arg)
+		stall_ms = strtol(arg, NULL, 0);
+
+	return msp_rc_stream(msp->fd, src, hz, stall_ms);
+}
+
+/*
+ * gpsreplay [-n|-l] <file> [speed], send fixes of NMEA or log track to
+ * MSP_SET_RAW_GPS at track times, format is found by start of the file
+ * unless -n or -l is given
+ */
+static int msp_gpsreplay(msp_t *msp, const char *arg)
+{
+	int format = MSP_GPS_FORMAT_AUTO;
+	double speed = 1;
+	char fname[256];
+
+	for (; arg && *arg == '-'; arg = cmd_arg_next(arg)) {
+		cmd_name_copy(arg, fname, sizeof(fname));
+		if (!strcmp(fname, "-n")) {
+			format = MSP_GPS_FORMAT_NMEA;
+		} else if (!strcmp(fname, "-l")) {
+			format = MSP_GPS_FORMAT_LOG;
+		} else {
+			fprintf(stderr, "Unknown option %s\n", fname);
+			return -1;
+		}
+	}
+
+	if (!arg || !*arg) {
+		fprintf(stderr, "Track file name expected\n");
+		return -1;
+	}
+	cmd_name_copy(arg, fname, sizeof(fname));
+
+	arg = cmd_arg_next(arg);
+	if (arg)
+		speed = strtod(arg, NULL);
+
+	return msp_gps_replay(msp->fd, fname, speed, format);
+}
+
+/*
+ * osdview [cols rows], mirror displayport OSD on the terminal
+ */
+static int msp_osdview(msp_t *msp, const char *arg)
+{
+	int cols = 0, rows = 0;
+
+	if (*arg) {
+		cols = strtol(arg, NULL, 0);
+		arg = cmd_arg_next(arg);
+		if (!arg) {
+			fprintf(stderr, "Canvas rows expected\n");
+			return -1;
+		}
+		rows = strtol(arg, NULL, 0);
+	}
+
+	return msp_osd_view(msp->fd, cols, rows);
+}
+
 static int msp_get_motor(msp_t *msp, const char *arg)
 {
 	int val[BF_MOTOR_MAX_NUM];
 	int num = BF_MOTOR_MAX_NUM;
 
+	if (emit_format() != EMIT_TEXT)
+		return msp_codec_query(msp, MSP_MOTOR, -1);
+
 	if (bf_get_motor(msp->fd, &num, val) < 0)
 		return -1;
 
@@ -285,9 +460,493 @@ static int msp_get_motor(msp_t *msp, const char *arg)
 	return 0;
 }
 
+/*
+ * Passthrough port runs at the rate autobaud has set FC port of the link
+ * to, if it is in use
+ */
 static int msp_set_passthrough(msp_t *msp, const char *arg)
 {
-	return msp_send_cli_cmd(msp, "serialpassthrough 0 420000");
+	int val[2] = {MSP_PASSTHROUGH_PORT, MSP_PASSTHROUGH_BAUD};
+	char cmd[64];
+
+	if (msp_eeprom_commit(msp) < 0)
+		return -1;
+
+	if (msp->dev && msp->baud && msp_baud_cached(msp->dev) == msp->baud)
+		val[1] = msp->baud;
+
+	cmd_arg_to_int(arg, val, 2);
+
+	snprintf(cmd, sizeof(cmd), "serialpassthrough %d %d", val[0], val[1]);
+	return msp_send_cli_cmd(msp, cmd);
+}
+
+/*
+ * bridge <pty|tcp:port> [<port> <baud>], with port and baud set serial
+ * passthrough first
+ */
+static int msp_bridge(msp_t *msp, const char *arg)
+{
+	const char *pass;
+	char spec[64];
+
+	cmd_name_copy(arg, spec, sizeof(spec));
+	if ((pass = cmd_arg_next(arg)) && msp_set_passthrough(msp, pass) < 0)
+		return -1;
+
+	return bridge_run(msp->fd, spec);
+}
+
+/*
+ * proxy <tcp:port|unix:path>[,...] [ttl_ms], several MSP clients over
+ * one FC link
+ */
+static int msp_proxy(msp_t *msp, const char *arg)
+{
+	const char *ttl;
+	char spec[256];
+
+	cmd_name_copy(arg, spec, sizeof(spec));
+	if (!spec[0]) {
+		fprintf(stderr, "Proxy address expected, tcp:<port> or unix:<path>\n");
+		return -1;
+	}
+
+	ttl = cmd_arg_next(arg);
+	return msp_proxy_run(msp->fd, spec, ttl ? atoi(ttl) : MSP_PROXY_TTL_DEFAULT);
+}
+
+/*
+ * snapshot <file>, binary backup of FC configuration
+ */
+static int msp_snapshot(msp_t *msp, const char *arg)
+{
+	char fname[256];
+
+	cmd_name_copy(arg, fname, sizeof(fname));
+	if (!fname[0]) {
+		fprintf(stderr, "Snapshot file name expected\n");
+		return -1;
+	}
+
+	return msp_snapshot_save(msp->fd, fname);
+}
+
+/*
+ * restore [-n] [-f] <file>, set sections of snapshot which differ from FC
+ * and write EEPROM once, -n shows them only, -f restores snapshot of other
+ * API version
+ */
+static int msp_restore(msp_t *msp, const char *arg)
+{
+	char token[256];
+	bool dry = false, force = false;
+	int num;
+
+	for (; arg; arg = cmd_arg_next(arg)) {
+		cmd_name_copy(arg, token, sizeof(token));
+		if (!strcmp(token, "-n"))
+			dry = true;
+		else if (!strcmp(token, "-f"))
+			force = true;
+		else
+			break;
+	}
+
+	if (!arg) {
+		fprintf(stderr, "Snapshot file name expected\n");
+		return -1;
+	}
+
+	if ((num = msp_snapshot_restore(msp->fd, token, dry, force)) < 0)
+		return -1;
+
+	printf("%d sections %s\n", num, dry ? "differ" : "written");
+	if (!dry && num)
+		msp->eeprom_dirty = true;
+	return 0;
+}
+
+/*
+ * mset <cmd> <bytes>, send MSP setter, EEPROM is written once at the end
+ * of command line or by commit
+ */
+static int msp_mset(msp_t *msp, const char *arg)
+{
+	uint8_t data[MSP_SNAPSHOT_SECT_MAX];
+	char token[32];
+	const char *p;
+	char *end;
+	long val, cmd = -1;
+	int len = 0;
+
+	/* nothing is sent if any token is not a number */
+	for (p = *arg ? arg : NULL; p; p = cmd_arg_next(p)) {
+		val = strtol(p, &end, 0);
+		if (end == p || (*end && *end != ' ')) {
+			cmd_name_copy(p, token, sizeof(token));
+			fprintf(stderr, "Invalid number %s\n", token);
+			return -1;
+		}
+
+		if (cmd < 0) {
+			if (val < 0 || val > 0xffff) {
+				fprintf(stderr, "Invalid MSP command %ld\n", val);
+				return -1;
+			}
+			cmd = val;
+			continue;
+		}
+
+		if (val < 0 || val > 0xff) {
+			fprintf(stderr, "Invalid byte %ld\n", val);
+			return -1;
+		}
+		if (len == sizeof(data)) {
+			fprintf(stderr, "Too many bytes, up to %zu\n", sizeof(data));
+			return -1;
+		}
+		data[len++] = val;
+	}
+
+	if (cmd < 0) {
+		fprintf(stderr, "MSP command expected\n");
+		return -1;
+	}
+
+	if (msp_transmit(msp->fd, cmd, MSP_DIR_OUT, data, len, data, sizeof(data)) < 0)
+		return -1;
+
+	msp->eeprom_dirty = true;
+	return 0;
+}
+
+static int msp_commit(msp_t *msp, const char *arg)
+{
+	return msp_eeprom_commit(msp);
+}
+
+/*****************************************************************************/
+
+struct msp_baud_cache {
+	uint8_t uid[MSP_UID_SIZE];
+	uint32_t baud;
+} __attribute__((__packed__));
+
+/*
+ * Drop bytes received at previous rate
+ */
+static void msp_drain(msp_t *msp)
+{
+	uint8_t data[256];
+
+	transport_set_timeout(msp->fd, AUTOBAUD_DRAIN_TIMEOUT);
+	while (transport_read(msp->fd, data, sizeof(data)) > 0)
+		;
+}
+
+/*
+ * Number of failed probes at baud rate, requests MSP_API_VERSION and
+ * all replies should be equal to the first one
+ */
+static int msp_probe_baud(msp_t *msp, uint32_t baud)
+{
+	uint8_t ref[16], data[16];
+	int ref_len = -1;
+	int i, len, errs = 0;
+
+	if (transport_setup(msp->fd, baud) < 0)
+		return -1;
+
+	msp_drain(msp);
+
+	for (i = 0; i < AUTOBAUD_PROBES; i++) {
+		len = msp_transmit(msp->fd, MSP_API_VERSION, MSP_DIR_OUT, data, 0,
+				   data, sizeof(data));
+		if (len > 0 && ref_len < 0) {
+			ref_len = len;
+			memcpy(ref, data, len);
+		}
+
+		if (len <= 0 || len != ref_len || memcmp(ref, data, len)) {
+			if (++errs > AUTOBAUD_MAX_ERRORS)
+				break;
+			msp_drain(msp);
+		}
+	}
+	return errs;
+}
+
+static int msp_baud_cache_path(const char *dev, char *path, int len)
+{
+	return state_path(path, len, dev, "baud");
+}
+
+static int msp_baud_cache_load(const char *dev, struct msp_baud_cache *cache)
+{
+	char path[512];
+	int fl, n;
+
+	if (msp_baud_cache_path(dev, path, sizeof(path)) < 0)
+		return -1;
+
+	fl = open(path, O_RDONLY | O_BINARY);
+	if (fl < 0)
+		return -1;
+
+	n = read(fl, cache, sizeof(*cache));
+	close(fl);
+
+	return n == sizeof(*cache) ? 0 : -1;
+}
+
+/*
+ * Baud rate found for device by autobaud, or 0
+ */
+unsigned int msp_baud_cached(const char *dev)
+{
+	struct msp_baud_cache cache;
+
+	if (msp_baud_cache_load(dev, &cache) < 0)
+		return 0;
+
+	return cache.baud;
+}
+
+/*
+ * Cached baud rate is of FC which answers with the same UID at it, other
+ * FC on the device path does not get it
+ */
+static int msp_baud_check(msp_t *msp)
+{
+	struct msp_baud_cache cache;
+	uint8_t uid[MSP_UID_SIZE];
+	rtt_t model = *rtt_model(RTT_MSP);
+	int len;
+
+	if (msp_baud_cache_load(msp->dev, &cache) < 0 || cache.baud != msp->baud)
+		return 0;
+
+	len = msp_transmit(msp->fd, MSP_UID, MSP_DIR_OUT, uid, 0, uid, sizeof(uid));
+	if (len == sizeof(uid) && !memcmp(uid, cache.uid, sizeof(uid)))
+		return 0;
+
+	/* no reply at wrong rate says nothing about the link */
+	if (len < 0)
+		*rtt_model(RTT_MSP) = model;
+
+	fprintf(stderr, "Baud rate %u of %s is cached for other FC, using %u\n",
+		msp->baud, msp->dev, msp->baud_check);
+	if (transport_setup(msp->fd, msp->baud_check) < 0)
+		return -1;
+	msp->baud = msp->baud_check;
+	msp_drain(msp);
+	rtt_set_timeout(msp->fd, RTT_MSP);
+	return 0;
+}
+
+static int msp_baud_cache_save(const char *dev, const uint8_t *uid, uint32_t baud)
+{
+	struct msp_baud_cache cache;
+	char path[512];
+	int fl, n;
+
+	if (msp_baud_cache_path(dev, path, sizeof(path)) < 0)
+		return -1;
+
+	memcpy(cache.uid, uid, MSP_UID_SIZE);
+	cache.baud = baud;
+
+	fl = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+	if (fl < 0)
+		return -1;
+
+	n = write(fl, &cache, sizeof(cache));
+	close(fl);
+
+	return n == sizeof(cache) ? 0 : -1;
+}
+
+/*
+ * Step through betaflight baud rates from the fastest, return the first
+ * one without errors or 0
+ */
+static uint32_t msp_autobaud_scan(msp_t *msp, const rtt_t *model)
+{
+	int i, errs;
+
+	for (i = BAUD_RATE_COUNT - 1; i > 0; i--) {
+		errs = msp_probe_baud(msp, bf_baud_rates[i]);
+		if (errs < 0) {
+			printf("Baud rate %u: not supported by host\n", bf_baud_rates[i]);
+			continue;
+		}
+
+		printf("Baud rate %u: %d errors\n", bf_baud_rates[i], errs);
+		if (errs <= AUTOBAUD_MAX_ERRORS)
+			return bf_baud_rates[i];
+		/* timeouts of wrong rates say nothing about the link */
+		*rtt_model(RTT_MSP) = *model;
+	}
+	return 0;
+}
+
+/*
+ * FC port of the link is the only port with MSP at baud rate, which is
+ * not VCP, return its index in serial config or -1
+ */
+static int msp_autobaud_port(msp_t *msp, uint32_t baud, msp_serial_config_t *cfg, int size)
+{
+	uint8_t data[1 + AUTOBAUD_PORTS_MAX * sizeof(msp_serial_config_t)];
+	int i, num, len, port = -1;
+
+	len = msp_transmit(msp->fd, MSP2_COMMON_SERIAL_CONFIG, MSP_DIR_OUT, NULL, 0,
+			   data, sizeof(data));
+	if (len < 1)
+		return -1;
+
+	num = data[0];
+	if (num > size || len < 1 + num * (int)sizeof(*cfg))
+		return -1;
+	memcpy(cfg, data + 1, num * sizeof(*cfg));
+
+	for (i = 0; i < num; i++) {
+		if (cfg[i].id == BF_SERIAL_PORT_VCP ||
+		    !(cfg[i].functions & BF_SERIAL_FUNCTION_MSP) ||
+		    bf_baud_rate(cfg[i].msp_baud) != baud)
+			continue;
+		if (port >= 0)
+			return -1;
+		port = i;
+	}
+	return port;
+}
+
+/*
+ * FC port is set to rate, saved and FC is rebooted, host follows and
+ * waits for FC to answer, return number of failed probes or -1
+ */
+static int msp_autobaud_set_fc(msp_t *msp, msp_serial_config_t *port, int index)
+{
+	uint8_t data[1 + sizeof(*port)];
+	uint8_t ver[16];
+	double start;
+
+	port->msp_baud = index;
+	data[0] = 1;
+	memcpy(data + 1, port, sizeof(*port));
+
+	if (msp_transmit(msp->fd, MSP2_COMMON_SET_SERIAL_CONFIG, MSP_DIR_OUT, data,
+			 sizeof(data), NULL, 0) < 0 ||
+	    bf_eeprom_write(msp->fd) < 0 || bf_reboot(msp->fd, MSP_REBOOT_FIRMWARE) < 0)
+		return -1;
+
+	if (transport_setup(msp->fd, bf_baud_rates[index]) < 0)
+		return -1;
+
+	start = tstamp();
+	while (msp_transmit(msp->fd, MSP_API_VERSION, MSP_DIR_OUT, ver, 0,
+			    ver, sizeof(ver)) <= 0) {
+		if (tstamp() - start > AUTOBAUD_REBOOT_TIMEOUT)
+			return AUTOBAUD_PROBES;
+	}
+
+	return msp_probe_baud(msp, bf_baud_rates[index]);
+}
+
+/*
+ * Rate FC port answers at is found first. VCP answers at any rate and has
+ * no rate to set. UART port of FC is set to the fastest rate host has up
+ * to max, FC is rebooted and the link is probed at the new rate, if it
+ * fails there FC port is searched again.
+ */
+static int msp_autobaud(msp_t *msp, const char *arg)
+{
+	msp_serial_config_t cfg[AUTOBAUD_PORTS_MAX];
+	uint8_t uid[MSP_UID_SIZE];
+	rtt_t model = *rtt_model(RTT_MSP);
+	uint32_t baud, max = AUTOBAUD_FC_MAX;
+	char *end;
+	int i, port, errs;
+
+	if (strcmp(transport_name(msp->fd), "serial")) {
+		printf("No baud rate on %s link\n", transport_name(msp->fd));
+		return 0;
+	}
+
+	if (*arg) {
+		max = strtoul(arg, &end, 0);
+		if (end == arg || (*end && *end != ' ') || max < bf_baud_rates[1]) {
+			fprintf(stderr, "Invalid baud rate %s\n", arg);
+			return -1;
+		}
+	}
+
+	if (!(baud = msp_autobaud_scan(msp, &model))) {
+		fprintf(stderr, "No working baud rate found, back to %u\n", msp->baud);
+		*rtt_model(RTT_MSP) = model;
+		if (transport_setup(msp->fd, msp->baud) == 0)
+			msp_drain(msp);
+		rtt_set_timeout(msp->fd, RTT_MSP);
+		return -1;
+	}
+
+	if (baud != bf_baud_rates[1] && msp_probe_baud(msp, bf_baud_rates[1]) == 0) {
+		printf("FC answers at any baud rate, the link is VCP, nothing is cached\n");
+		*rtt_model(RTT_MSP) = model;
+		if (transport_setup(msp->fd, msp->baud) == 0)
+			msp_drain(msp);
+		rtt_set_timeout(msp->fd, RTT_MSP);
+		return 0;
+	}
+	*rtt_model(RTT_MSP) = model;
+	if (transport_setup(msp->fd, baud) < 0)
+		return -1;
+	msp_drain(msp);
+
+	port = msp_autobaud_port(msp, baud, cfg, sizeof(cfg) / sizeof(cfg[0]));
+	if (port < 0)
+		printf("FC port of the link is not found in serial config, its rate is kept\n");
+
+	/* the fastest rate which host has, FC is told at the current one */
+	for (i = BAUD_RATE_COUNT - 1; port >= 0 && i > 0; i--) {
+		if (bf_baud_rates[i] <= max && transport_setup(msp->fd, bf_baud_rates[i]) == 0)
+			break;
+	}
+	if (port >= 0 && transport_setup(msp->fd, baud) < 0)
+		return -1;
+	if (port >= 0 && bf_baud_rates[i] > baud) {
+		printf("Setting FC port %u to %u, FC reboots\n", cfg[port].id, bf_baud_rates[i]);
+		errs = msp_autobaud_set_fc(msp, &cfg[port], i);
+		if (errs >= 0 && errs <= AUTOBAUD_MAX_ERRORS) {
+			baud = bf_baud_rates[i];
+		} else {
+			fprintf(stderr, "FC port %u fails at %u, searching it again\n",
+				cfg[port].id, bf_baud_rates[i]);
+			*rtt_model(RTT_MSP) = model;
+			if (!(baud = msp_autobaud_scan(msp, &model))) {
+				fprintf(stderr, "FC does not answer, set its port rate over USB\n");
+				*rtt_model(RTT_MSP) = model;
+				return -1;
+			}
+		}
+	}
+	if (transport_setup(msp->fd, baud) < 0)
+		return -1;
+	msp_drain(msp);
+
+	msp->baud = baud;
+	printf("Selected baud rate %u\n", baud);
+
+	/* rate is cached for this FC only */
+	if (msp_transmit(msp->fd, MSP_UID, MSP_DIR_OUT, uid, 0, uid, sizeof(uid)) !=
+	    sizeof(uid))
+		fprintf(stderr, "Can't get device UID, baud rate is not saved\n");
+	else if (msp->dev && msp_baud_cache_save(msp->dev, uid, baud) < 0)
+		fprintf(stderr, "Can't save baud rate of %s\n", msp->dev);
+
+	rtt_set_timeout(msp->fd, RTT_MSP);
+	return 0;
 }
 
 
@@ -344,6 +1003,10 @@ static int esc_write(esc4way_t *esc, const char *arg)
 	addr = val[1];
 	byte = val[2];
 
+	/* raw write must not be overwritten by pending settings */
+	if (esc4way_settings_commit(esc, chan) < 0)
+		return -1;
+
 	if (esc4way_select_chan(esc, 0, chan) < 0)
 		return -1;
 
@@ -353,7 +1016,12 @@ static int esc_write(esc4way_t *esc, const char *arg)
 	printf("Write %02x to %04x\n", byte, addr);
 	data[addr & 0xff] = byte;
 
-	return esc4way_write_flash(esc, addr & ~0xff, data, sizeof(data));
+	if (esc4way_write_flash(esc, addr & ~0xff, data, sizeof(data)) < 0)
+		return -1;
+
+	if ((addr & ~0xff) == esc->set.addr)
+		esc4way_settings_invalidate(esc, chan);
+	return 0;
 }
 
 static esc_set_val_t esc_conv_kv(esc_set_val_t val, int set)
@@ -618,46 +1286,289 @@ static void esc_settings_printf(uint8_t *set, int chan)
 	}
 }
 
-static int esc_sset(esc4way_t *esc, const char *arg)
+/*
+ * FC UID and number of esc of last passthrough on device, esc in 4way
+ * mode do not answer MSP, so later runs take them from here
+ */
+struct esc_pass_state {
+	uint8_t uid[ESC4WAY_UID_SIZE];
+	uint8_t chans;
+} __attribute__((__packed__));
+
+static int esc_pass_path(const char *dev, char *path, int len)
 {
-	char name[256];
-	int chan = strtol(arg, NULL, 0);
-	esc_set_val_t  val;
-	uint8_t *set = esc->set.data.byte;
-	const struct esc_set *es;
-	int index;
+	return state_path(path, len, dev, "esc");
+}
 
-	arg = cmd_arg_next(arg);
-	if (!arg)
+static int esc_pass_load(esc4way_t *esc)
+{
+	struct esc_pass_state st;
+	char path[512];
+	int fl, n;
+
+	if (!esc->dev || esc_pass_path(esc->dev, path, sizeof(path)) < 0)
 		return -1;
 
-	if (esc_parse_set(arg, name, sizeof(name), &val) < 0)
+	fl = open(path, O_RDONLY | O_BINARY);
+	if (fl < 0)
 		return -1;
 
-	if (esc4way_select_chan(esc, 0, chan) < 0)
+	n = read(fl, &st, sizeof(st));
+	close(fl);
+
+	if (n != sizeof(st))
 		return -1;
 
-	if (esc4way_settings_cache(esc) < 0)
+	memcpy(esc->uid, st.uid, ESC4WAY_UID_SIZE);
+	esc->chans = st.chans;
+	return 0;
+}
+
+static int esc_pass_save(esc4way_t *esc)
+{
+	struct esc_pass_state st;
+	char path[512];
+	int fl, n;
+
+	if (!esc->dev || esc_pass_path(esc->dev, path, sizeof(path)) < 0)
 		return -1;
 
-	if (!(es = esc_find_set(name, &index))) {
+	memcpy(st.uid, esc->uid, ESC4WAY_UID_SIZE);
+	st.chans = esc->chans;
+
+	fl = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+	if (fl < 0)
+		return -1;
+
+	n = write(fl, &st, sizeof(st));
+	close(fl);
+
+	return n == sizeof(st) ? 0 : -1;
+}
+
+/*
+ * Number of esc, from passthrough of this run or of the last one
+ */
+static int esc_chans_num(esc4way_t *esc)
+{
+	if (!esc->chans)
+		esc_pass_load(esc);
+	if (!esc->chans) {
+		fprintf(stderr, "Number of esc is unknown, set esc_pass first\n");
+		return -1;
+	}
+	if (esc->chans > ESC4WAY_CHAN_MAX)
+		return ESC4WAY_CHAN_MAX;
+	return esc->chans;
+}
+
+/*
+ * Channels list: "all", "2", "0,2", "0-3" or mixed "0,2-3"
+ */
+static int esc_parse_chans(esc4way_t *esc, const char *arg, bool *chans)
+{
+	char list[64];
+	int from, to, n = 0;
+
+	cmd_name_copy(arg, list, sizeof(list));
+
+	if (!strcmp(list, "all")) {
+		memset(chans, 0, ESC4WAY_CHAN_MAX * sizeof(chans[0]));
+		if ((to = esc_chans_num(esc)) < 0)
+			return -1;
+		for (from = 0; from < to; from++, n++)
+			chans[from] = true;
+		return n;
+	}
+
+	if ((n = cmd_arg_to_set(list, chans, ESC4WAY_CHAN_MAX)) > 0)
+		return n;
+
+	fprintf(stderr, "Invalid esc channels: %s\n", list);
+	return -1;
+}
+
+/* maximum number of settings changed by one sset */
+#define ESC_SSET_MAX		32
+
+typedef struct {
+	const struct esc_set *es;
+	int index;
+	int len;
+	uint8_t data[ESC_SET_DEVICE_NAME_SIZE];
+} esc_set_change_t;
+
+/*
+ * Value in settings bytes, limits of setting are checked against stored
+ * value, as they are printed by sdump
+ */
+static int esc_set_change(const char *name, const char *value, esc_set_change_t *c)
+{
+	esc_set_val_t val;
+	char *end, *fend;
+
+	if (!(c->es = esc_find_set(name, &c->index)) || !name[0]) {
 		fprintf(stderr, "Invalid setting name: %s\n", name);
 		return -1;
 	}
 
+	if (c->es->type == ESC_DATA_STR) {
+		c->len = c->es->ext + 1;
+		if (c->len > sizeof(c->data))
+			c->len = sizeof(c->data);
+		memset(c->data, 0, sizeof(c->data));
+		strncpy((char *)c->data, value, c->len);
+		return 0;
+	}
+
+	val.d = strtol(value, &end, 0);
+	val.f = strtof(value, &fend);
+	/* float setting takes fraction, nothing may follow the number */
+	if (c->es->type == ESC_DATA_FLT)
+		end = fend;
+	if (end == value || *end) {
+		fprintf(stderr, "Invalid value of %s: %s\n", name, value);
+		return -1;
+	}
+
+	if (c->es->conv)
+		val = c->es->conv(val, 1);
+
+	if (val.d < 0 || val.d > 255 ||
+	    (c->es->min >= 0 && c->es->max > 0 && val.d != c->es->disable &&
+	     (val.d < c->es->min || val.d > c->es->max))) {
+		fprintf(stderr, "Value of %s out of range: %s\n", name, value);
+		return -1;
+	}
+
+	c->len = 1;
+	c->data[0] = val.d;
+	return 0;
+}
+
+static void esc_set_value_printf(const struct esc_set *es, const uint8_t *data)
+{
+	esc_set_val_t val;
+
+	if (es->type == ESC_DATA_STR) {
+		printf("\"%.*s\"", es->ext + 1, data);
+		return;
+	}
+
+	val.d = data[0];
 	if (es->conv)
-		val = es->conv(val, 1);
+		val = es->conv(val, 0);
 
-	printf("Set %s to value %d\n", es->name, val.d);
-	set[index] = val.d;
+	if (es->type == ESC_DATA_FLT)
+		printf("%.3f", val.f);
+	else
+		printf("%d", val.d);
+}
+
+/*
+ * Stage changes of one channel, with dry run only print them
+ */
+static int esc_sset_chan(esc4way_t *esc, int chan, const esc_set_change_t *c, int num,
+			 bool dry)
+{
+	esc_set_cache_t *sc;
+	int i, diff = 0;
+
+	if (!(sc = esc4way_settings(esc, chan)))
+		return -1;
+
+	for (i = 0; i < num; i++, c++) {
+		const uint8_t *old = &sc->data.byte[c->index];
+
+		if (!memcmp(old, c->data, c->len))
+			continue;
+
+		printf("ESC %d %s: ", chan, c->es->name);
+		esc_set_value_printf(c->es, old);
+		printf(" -> ");
+		esc_set_value_printf(c->es, c->data);
+		printf("\n");
+		diff++;
+
+		if (!dry && esc4way_settings_set(esc, chan, c->index, c->data, c->len) < 0)
+			return -1;
+	}
+
+	if (!diff)
+		printf("ESC %d: no changes\n", chan);
+
+	if (dry)
+		return 0;
+
+	return esc4way_settings_commit(esc, chan);
+}
+
+/*
+ * sset [-n] <channels> name=value [name=value ...]
+ * sset <channel> <name> <value>
+ */
+static int esc_sset(esc4way_t *esc, const char *arg)
+{
+	esc_set_change_t change[ESC_SSET_MAX];
+	bool chans[ESC4WAY_CHAN_MAX];
+	char token[256];
+	char *value;
+	bool dry = false;
+	int num = 0;
+	int chan;
+
+	cmd_name_copy(arg, token, sizeof(token));
+	if (!strcmp(token, "-n")) {
+		dry = true;
+		arg = cmd_arg_next(arg);
+		if (!arg)
+			return -1;
+	}
+
+	if (esc_parse_chans(esc, arg, chans) < 0)
+		return -1;
+
+	while ((arg = cmd_arg_next(arg))) {
+		char name[256];
+
+		if (num == ESC_SSET_MAX) {
+			fprintf(stderr, "Too many settings, maximum is %d\n", ESC_SSET_MAX);
+			return -1;
+		}
+
+		cmd_name_copy(arg, token, sizeof(token));
+		if ((value = strchr(token, '='))) {
+			*value++ = '\0';
+			strcpy(name, token);
+		} else {
+			/* old form: <name> <value> */
+			strcpy(name, token);
+			if (!(arg = cmd_arg_next(arg)))
+				return -1;
+			cmd_name_copy(arg, token, sizeof(token));
+			value = token;
+		}
+
+		if (esc_set_change(name, value, &change[num]) < 0)
+			return -1;
+		num++;
+	}
 
-	return esc4way_write_flash(esc, esc->set.addr, set, esc->set.size);
+	if (!num)
+		return -1;
+
+	for (chan = 0; chan < ESC4WAY_CHAN_MAX; chan++) {
+		if (chans[chan] && esc_sset_chan(esc, chan, change, num, dry) < 0)
+			return -1;
+	}
+
+	return 0;
 }
 
 static int esc_sfset(esc4way_t *esc, const char *arg)
 {
-	uint8_t *set = esc->set.data.byte;
-	unsigned int size = sizeof(esc->set.data.name);
+	uint8_t set[ESC_FLASH_SETTINGS_SIZE];
+	unsigned int size = sizeof(struct settings);
 	char name[256];
 	const struct esc_set *es;
 	esc_set_val_t  val;
@@ -690,18 +1601,56 @@ static int esc_sfset(esc4way_t *esc, const char *arg)
 	return esc_set_write_to_file(fname, set, size);
 }
 
+/* settings bytes described by esc_settings[] */
+#define ESC_SETTINGS_USED	(sizeof(esc_settings) / sizeof(esc_settings[0]))
+
+/*
+ * Settings by name with values converted as in text dump
+ */
+static void esc_set_emit(const uint8_t *set)
+{
+	const struct esc_set *es;
+	esc_set_val_t val;
+	int i;
+
+	emit_map("settings");
+	for (i = 0; i < ESC_SETTINGS_USED; i++) {
+		es = &esc_settings[i];
+		if (es->name[0]) {
+			if (es->type == ESC_DATA_STR) {
+				emit_str(es->name, (const char *)&set[i], es->ext + 1);
+			} else {
+				val.d = set[i];
+				if (es->conv)
+					val = es->conv(val, 0);
+				if (es->type == ESC_DATA_FLT)
+					emit_float(es->name, val.f);
+				else
+					emit_int(es->name, val.d);
+			}
+		}
+		i += es->ext;
+	}
+	emit_end();
+}
+
 static int esc_sdump(esc4way_t *esc, const char *arg)
 {
 	int chan = strtol(arg, NULL, 0);
-	uint8_t *set = esc->set.data.byte;
+	esc_set_cache_t *sc;
 
-	if (esc4way_select_chan(esc, 0, chan) < 0)
+	if (!(sc = esc4way_settings(esc, chan)))
 		return -1;
 
-	if (esc4way_settings_cache(esc) < 0)
-		return -1;
+	if (emit_format() != EMIT_TEXT) {
+		emit_map(NULL);
+		emit_int("channel", chan);
+		esc_set_emit(sc->data.byte);
+		emit_end();
+		return 0;
+	}
 
-	esc_settings_printf(set, chan);
+	esc_settings_printf(sc->data.byte, chan);
 
 	return 0;
 }
@@ -709,8 +1658,8 @@ static int esc_sdump(esc4way_t *esc, const char *arg)
 static int esc_sfdump(esc4way_t *esc, const char *arg)
 {
 	const char *fname;
-	uint8_t *set = esc->set.data.byte;
-	unsigned int size = sizeof(esc->set.data.name);
+	uint8_t set[ESC_FLASH_SETTINGS_SIZE];
+	unsigned int size = sizeof(struct settings);
 
 	fname = arg;
 
@@ -722,30 +1671,236 @@ static int esc_sfdump(esc4way_t *esc, const char *arg)
 	return 0;
 }
 
-static int esc_read_from_flash_to_file(esc4way_t *esc, int chan, int addr, int len, const char *fname)
+static void esc_set_csv_printf(const uint8_t *set, const int *chans, int num)
 {
-	uint8_t data[256];
-	int fl;
-	int offt, size = len;
-	int n;
+	const struct esc_set *es;
+	int i, k;
+
+	if (!set) {
+		printf("channels");
+		for (i = 0; i < ESC_SETTINGS_USED; i++) {
+			es = &esc_settings[i];
+			if (es->name[0])
+				printf(",%s", es->name);
+			i += es->ext;
+		}
+		printf("\n");
+		return;
+	}
 
-	if (!strlen(fname)) {
-		printf("Invalid file name: <%s>\n", fname);
+	for (i = 0; i < num; i++)
+		printf("%s%d", i ? " " : "", chans[i]);
+
+	for (i = 0; i < ESC_SETTINGS_USED; i++) {
+		es = &esc_settings[i];
+		if (es->name[0]) {
+			esc_set_val_t val;
+
+			printf(",");
+			if (es->type == ESC_DATA_STR) {
+				/* quoted, double quote doubled */
+				printf("\"");
+				for (k = 0; k <= es->ext && set[i + k]; k++) {
+					if (set[i + k] == '"')
+						printf("\"");
+					printf("%c", set[i + k]);
+				}
+				printf("\"");
+			} else {
+				val.d = set[i];
+				if (es->conv)
+					val = es->conv(val, 0);
+				if (es->type == ESC_DATA_FLT)
+					printf("%.3f", val.f);
+				else
+					printf("%d", val.d);
+			}
+		}
+		i += es->ext;
+	}
+	printf("\n");
+}
+
+/*
+ * Settings of all esc in one pass, esc with equal settings share a record
+ */
+static int esc_sdumpall(esc4way_t *esc, const char *arg)
+{
+	uint8_t set[ESC4WAY_CHAN_MAX][ESC_SETTINGS_USED];
+	int group[ESC4WAY_CHAN_MAX];
+	int chans[ESC4WAY_CHAN_MAX];
+	int format = emit_format();
+	bool json = true;
+	int num, chan, i, n;
+
+	if (!strcmp(arg, "csv"))
+		json = false;
+	else if (strlen(arg) && strcmp(arg, "json")) {
+		fprintf(stderr, "Invalid format: %s\n", arg);
 		return -1;
 	}
 
-	fl = open(fname, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
-	if (fl < 0) {
-		fprintf(stderr, "Can't open file %s, %s\n", fname, strerror(errno));
+	if ((num = esc_chans_num(esc)) < 0)
+		return -1;
+
+	for (chan = 0; chan < num; chan++) {
+		if (esc4way_settings_read(esc, chan, set[chan], sizeof(set[chan])) < 0)
+			return -1;
+
+		group[chan] = chan;
+		for (i = 0; i < chan; i++) {
+			if (!memcmp(set[i], set[chan], sizeof(set[chan]))) {
+				group[chan] = i;
+				break;
+			}
+		}
+	}
+
+	/* json of sdumpall is there without --format too */
+	if (json) {
+		if (format == EMIT_TEXT)
+			emit_set_format(EMIT_JSON);
+		emit_array(NULL);
+	} else {
+		esc_set_csv_printf(NULL, NULL, 0);
+	}
+
+	for (chan = 0; chan < num; chan++) {
+		if (group[chan] != chan)
+			continue;
+
+		for (i = chan, n = 0; i < num; i++) {
+			if (group[i] == chan)
+				chans[n++] = i;
+		}
+
+		if (json) {
+			emit_map(NULL);
+			emit_array("channels");
+			for (i = 0; i < n; i++)
+				emit_int(NULL, chans[i]);
+			emit_end();
+			esc_set_emit(set[chan]);
+			emit_end();
+		} else {
+			esc_set_csv_printf(set[chan], chans, n);
+		}
+	}
+
+	if (json) {
+		emit_end();
+		emit_set_format(format);
+	}
+
+	return 0;
+}
+
+/* head, layout, version and device name */
+#define ESC_INVENTORY_SIZE	(offsetof(struct settings, device_name) + ESC_SET_DEVICE_NAME_SIZE)
+
+/*
+ * Firmware of every esc by one short read of settings head
+ */
+static int esc_inventory(esc4way_t *esc, const char *arg)
+{
+	bool chans[ESC4WAY_CHAN_MAX];
+	struct settings set;
+	double t;
+	int chan, k;
+
+	if (esc_parse_chans(esc, strlen(arg) ? arg : "all", chans) < 0)
+		return -1;
+
+	if (emit_format() != EMIT_TEXT)
+		emit_array(NULL);
+	else
+		printf("ESC  boot  layout  version  name          time\n");
+
+	for (chan = 0; chan < ESC4WAY_CHAN_MAX; chan++) {
+		if (!chans[chan])
+			continue;
+
+		t = tstamp();
+		if (esc4way_settings_read(esc, chan, &set, ESC_INVENTORY_SIZE) < 0) {
+			if (emit_format() != EMIT_TEXT) {
+				emit_map(NULL);
+				emit_int("channel", chan);
+				emit_str("error", "not responding", -1);
+				emit_end();
+			} else {
+				printf("%-3d  not responding\n", chan);
+			}
+			continue;
+		}
+		t = tstamp() - t;
+
+		if (emit_format() != EMIT_TEXT) {
+			emit_map(NULL);
+			emit_int("channel", chan);
+			emit_int("boot", set.head);
+			emit_int("layout", set.layout_version);
+			emit_int("major", set.version.major);
+			emit_int("minor", set.version.minor);
+			/* erased flash is 0xff, printable part only */
+			for (k = 0; k < ESC_SET_DEVICE_NAME_SIZE && isprint(set.device_name[k]); k++)
+				;
+			emit_str("name", (const char *)set.device_name, k);
+			emit_float("time_ms", t * 1000);
+			emit_end();
+			continue;
+		}
+
+		printf("%-3d  %-4d  %-6d  %2d.%-2d    ", chan, set.head,
+		       set.layout_version, set.version.major, set.version.minor);
+		for (k = 0; k < ESC_SET_DEVICE_NAME_SIZE; k++)
+			printf("%c", isprint(set.device_name[k]) ? set.device_name[k] : ' ');
+		printf("  %.1fms\n", t * 1000);
+	}
+
+	if (emit_format() != EMIT_TEXT)
+		emit_end();
+	return 0;
+}
+
+/*
+ * Retries per block, many of them point to bad wiring
+ */
+static void esc_stat_printf(esc4way_t *esc)
+{
+	int i;
+
+	printf("ESC transfer retries: %u\n", esc->stat.total);
+	for (i = 0; i < ESC4WAY_STAT_BLOCKS; i++) {
+		if (esc->stat.retries[i])
+			printf("\tblock %04x: %u\n", i << 8, esc->stat.retries[i]);
+	}
+}
+
+static int esc_stats(esc4way_t *esc, const char *arg)
+{
+	esc_stat_printf(esc);
+	return 0;
+}
+
+static int esc_read_from_flash_to_file(esc4way_t *esc, int chan, int addr, int len, const char *fname)
+{
+	uint8_t data[256];
+	file_writer_t *fw;
+	progress_t pr;
+	int offt, size = len;
+	int n;
+
+	fw = file_writer_open(fname);
+	if (!fw)
 		return -1;
-	}
 
 	if (esc4way_select_chan(esc, 0, chan) < 0) {
 		fprintf(stderr, "esc4way init flash on channel %d failure\n", chan);
-		close(fl);
+		file_writer_close(fw);
 		return -1;
 	}
 
+	progress_start(&pr, size, addr);
 	offt = 0;
 	while (len) {
 		n = len;
@@ -754,80 +1909,165 @@ static int esc_read_from_flash_to_file(esc4way_t *esc, int chan, int addr, int l
 
 		if (esc4way_read_flash(esc, addr + offt, data, n) < 0) {
 			fprintf(stderr, "esc4way read flash error\n");
-			close(fl);
+			file_writer_close(fw);
 			return -1;
 		}
 
-		if (write(fl, data, n) < 0) {
+		if (file_writer_write(fw, data, n) < 0) {
 			fprintf(stderr, "esc4way write to flash file error, %s\n", strerror(errno));
+			file_writer_close(fw);
 			return -1;
 		}
 
 		offt += n;
 		len -= n;
-		printf("Progress %d%%\taddr: %d\r", (offt * 100) / size, addr + offt);
-		fflush(stdout);
-		fflush(stderr);
+		progress_update(&pr, offt);
 	}
-	printf("\nSuccess\n");
 
-	close(fl);
+	if (file_writer_close(fw) < 0) {
+		fprintf(stderr, "esc4way write to flash file error, %s\n", strerror(errno));
+		return -1;
+	}
+	progress_done(&pr, offt);
+	if (esc->stat.total)
+		esc_stat_printf(esc);
+	printf("Success\n");
+
 	return 0;
 }
 
-static int esc_write_file_to_flash(esc4way_t *esc, int chan, int addr, const char *fname)
+/*
+ * Write image to flash, blocks recorded in journal are verified and
+ * written only if differ
+ */
+static int esc_write_map_to_flash(esc4way_t *esc, int chan, int addr,
+				  const file_map_t *map, esc_journal_t *j)
 {
-	uint8_t data[256];
-	int len;
-	int fl;
+	progress_t pr;
+	int len, blk;
 	int offt;
-	struct stat stat;
+	int verified = 0;
+	int err;
 
-	if (!strlen(fname)) {
-		printf("Invalid file name: <%s>\n", fname);
+	if (esc4way_select_chan(esc, 0, chan) < 0) {
+		fprintf(stderr, "esc4way init flash on channel %d failure\n", chan);
 		return -1;
 	}
 
-	fl = open(fname, O_RDONLY | O_BINARY);
-	if (fl < 0) {
-		fprintf(stderr, "Can't open file %s, %s\n", fname, strerror(errno));
-		return -1;
-	}
+	progress_start(&pr, map->size, addr);
+	for (offt = 0; offt < map->size; offt += len) {
+		len = map->size - offt;
+		if (len > ESC_JOURNAL_BLOCK_SIZE)
+			len = ESC_JOURNAL_BLOCK_SIZE;
 
-	if (fstat(fl, &stat) < 0) {
-		fprintf(stderr, "Can't get file %s size, %s\n", fname, strerror(errno));
-		close(fl);
-		return -1;
-	}
+		blk = offt / ESC_JOURNAL_BLOCK_SIZE;
 
-	if (esc4way_select_chan(esc, 0, chan) < 0) {
-		fprintf(stderr, "esc4way init flash on channel %d failure\n", chan);
-		close(fl);
-		return -1;
-	}
+		if (j && esc_journal_block(j, blk)) {
+			err = esc4way_verify_flash(esc, addr + offt, map->data + offt, len);
+			if (err < 0) {
+				fprintf(stderr, "\nesc4way verify flash error\n");
+				esc_journal_save(j);
+				return -1;
+			}
+			if (err > 0) {
+				verified++;
+				progress_update(&pr, offt + len);
+				continue;
+			}
+		}
 
-	offt = 0;
-	while ((len = read(fl, data, sizeof(data))) > 0) {
-		if (esc4way_write_flash(esc, addr + offt, data, len) < 0) {
-			fprintf(stderr, "esc4way write flash error\n");
-			close(fl);
+		if (esc4way_write_flash(esc, addr + offt, map->data + offt, len) < 0) {
+			fprintf(stderr, "\nesc4way write flash error\n");
+			if (j)
+				esc_journal_save(j);
 			return -1;
 		}
 
-		offt += len;
-		printf("Progress %ld%%\taddr: %d\r", (offt * 100) / stat.st_size, addr + offt);
-		fflush(stdout);
-		fflush(stderr);
+		if (j) {
+			esc_journal_set_block(j, blk);
+			if ((blk % ESC_JOURNAL_SAVE_BLOCKS) == ESC_JOURNAL_SAVE_BLOCKS - 1)
+				esc_journal_save(j);
+		}
+		progress_update(&pr, offt + len);
 	}
-	printf("\nSuccess\n");
+	progress_done(&pr, offt);
+	if (esc->stat.total)
+		esc_stat_printf(esc);
+
+	if (verified)
+		printf("%d blocks were already written\n", verified);
+	printf("Success\n");
 
-	close(fl);
 	return 0;
 }
 
+/*
+ * Open flash journal of image, NULL if journal is not available. Journal
+ * is keyed by UID of FC and device info of esc, so it is not resumed on
+ * other esc connected to the same port
+ */
+static esc_journal_t *esc_journal_start(esc4way_t *esc, int chan, int addr,
+					const file_map_t *map, esc_journal_t *j)
+{
+	uint8_t uid[ESC_JOURNAL_UID_SIZE];
+	uint8_t hash[SHA256_SIZE];
+	int err;
+
+	if (!esc->dev)
+		return NULL;
+
+	/* FC UID from passthrough of this run or of the last one */
+	if (!esc->chans)
+		esc_pass_load(esc);
+
+	if (esc4way_select_chan(esc, 0, chan) < 0)
+		return NULL;
+
+	memset(uid, 0, sizeof(uid));
+	memcpy(uid, esc->uid, ESC4WAY_UID_SIZE);
+	memcpy(uid + ESC4WAY_UID_SIZE, esc->sel.dev_info,
+	       ESC_JOURNAL_UID_SIZE - ESC4WAY_UID_SIZE);
+
+	sha256(map->data, map->size, hash);
+
+	err = esc_journal_open(j, esc->dev, chan, uid, hash, addr, map->size);
+	if (err < 0) {
+		printf("Warning: flash journal is not available\n");
+		return NULL;
+	}
+	if (err > 0)
+		printf("Resume interrupted flash of channel %d\n", chan);
+
+	return j;
+}
+
+static int esc_write_file_to_flash(esc4way_t *esc, int chan, int addr,
+				   const char *fname, bool resume)
+{
+	esc_journal_t journal, *j = NULL;
+	file_map_t map;
+	int err;
+
+	if (file_map(fname, &map) < 0)
+		return -1;
+
+	if (resume)
+		j = esc_journal_start(esc, chan, addr, &map, &journal);
+
+	err = esc_write_map_to_flash(esc, chan, addr, &map, j);
+	if (err == 0 && j)
+		esc_journal_remove(j);
+
+	file_unmap(&map);
+	return err;
+}
+
 static int esc_init(esc4way_t *esc, const char *arg)
 {
 	int chan = strtol(arg, NULL, 0);
+
+	/* explicit init is always sent */
+	esc4way_invalidate(esc);
 	return esc4way_select_chan(esc, 0, chan);
 }
 
@@ -857,10 +2097,7 @@ static int esc_version(esc4way_t *esc, const char *arg)
 	major = val[1];
 	minor = val[2];
 
-	if (esc4way_select_chan(esc, 0, chan) < 0)
-		return -1;
-
-	return esc4way_set_version(esc, major, minor);
+	return esc4way_set_version(esc, chan, major, minor);
 }
 
 static int esc_swrite(esc4way_t *esc, const char *arg)
@@ -872,7 +2109,9 @@ static int esc_swrite(esc4way_t *esc, const char *arg)
 
 	fname = end;
 
-	return esc_write_file_to_flash(esc, chan, esc->set.addr, fname);
+	/* file replaces settings, pending changes are lost */
+	esc4way_settings_invalidate(esc, chan);
+	return esc_write_file_to_flash(esc, chan, esc->set.addr, fname, false);
 }
 
 static int esc_sread(esc4way_t *esc, const char *arg)
@@ -884,6 +2123,9 @@ static int esc_sread(esc4way_t *esc, const char *arg)
 
 	fname = end;
 
+	if (esc4way_settings_commit(esc, chan) < 0)
+		return -1;
+
 	return esc_read_from_flash_to_file(esc, chan, esc->set.addr, esc->set.size, fname);
 }
 
@@ -896,74 +2138,393 @@ static int esc_flash(esc4way_t *esc, const char *arg)
 
 	fname = end;
 
-	return esc_write_file_to_flash(esc, chan, esc->fw.addr, fname);
+	return esc_write_file_to_flash(esc, chan, esc->fw.addr, fname, true);
 }
 
-static int esc_set_passthrough(serial_handle fd, int chan)
+/*
+ * FC UID is asked before passthrough is entered, esc archive is keyed by
+ * it. FC which is in passthrough already does not answer, its 4way
+ * interface drops the frame, it has no 4way start byte, and UID and
+ * number of esc of the last passthrough are taken from device state.
+ */
+static int esc_set_passthrough(serial_handle fd, int chan, esc4way_t *esc)
 {
 	int len;
 	uint8_t data[8];
+	uint8_t uid[ESC4WAY_UID_SIZE];
+	rtt_t model = *rtt_model(RTT_MSP);
+
+	memset(uid, 0, sizeof(uid));
+	if (esc && msp_transmit(fd, MSP_UID, MSP_DIR_OUT, uid, 0, uid, sizeof(uid)) < 0) {
+		/* no reply of FC in 4way mode says nothing about the link */
+		*rtt_model(RTT_MSP) = model;
+		if (esc_pass_load(esc) == 0) {
+			printf("FC does not answer MSP, passthrough is set already, "
+			       "esc has %d channels\n", esc->chans);
+			return esc->chans;
+		}
+		fprintf(stderr, "Can't get device UID\n");
+	}
 
 	data[0] = MSP_PASSTHROUGH_ESC_4WAY;
 	data[1] = chan;
 	len = msp_transmit(fd, MSP_SET_PASSTHROUGH, MSP_DIR_OUT, data, 2, data, sizeof(data));
+	if (len < 0)
+		*rtt_model(RTT_MSP) = model;
 #ifdef DEBUG
 	if (len > 0) {
 		printf("esc passthrough reply: %d bytes\n", len);
 		dump_hex(data, len, 1);
 	}
 #endif
-	if (len > 0)
+	if (len > 0) {
 		printf("Passthrough mode set success, esc has %d channels\n", data[0]);
-	else
+		if (esc) {
+			memcpy(esc->uid, uid, ESC4WAY_UID_SIZE);
+			esc->chans = data[0];
+			esc_pass_save(esc);
+		}
+	} else
 		printf("Passthrough mode set failed, maybe already set\n");
 	return len;
 }
 
 #define MARK_FAIL		"FLASH FAIL  "
 #define MARK_NOT_READY		"NOT READY   "
+
+/*
+ * Set boot flag and name mark of channel, version is cleared with
+ * first mark. Settings are read back from esc, so steps recorded in
+ * journal are written again if esc does not have them
+ */
+static int esc_flashall_mark(esc4way_t *esc, int chan, esc_journal_t *j,
+			     uint32_t marks, int boot, const char *name)
+{
+	esc4way_settings_invalidate(esc, chan);
+
+	if (esc4way_boot_flash(esc, chan, boot) < 0)
+		return -1;
+	if (esc4way_mark_flash(esc, chan, name) < 0)
+		return -1;
+	if ((marks & ESC_JOURNAL_VERSION) && esc4way_set_version(esc, chan, 0, 0) < 0)
+		return -1;
+
+	if (esc_journal_done(j, marks) && esc4way_settings_dirty(esc, chan))
+		printf("Channel %d settings differ from journal, write again\n", chan);
+
+	if (esc4way_settings_commit(esc, chan) < 0)
+		return -1;
+
+	esc_journal_mark(j, marks);
+	return 0;
+}
+
+static int esc_flashall_steps(esc4way_t *esc, int chan, const file_map_t *map,
+			      esc_journal_t *j)
+{
+	/* boot clear, fail mark and version go in one settings write */
+	if (esc_flashall_mark(esc, chan, j, ESC_JOURNAL_BOOT_CLEAR |
+			      ESC_JOURNAL_MARK_FAIL | ESC_JOURNAL_VERSION,
+			      0, MARK_FAIL) < 0)
+		return -1;
+
+	/* journaled blocks are verified, not skipped */
+	if (esc_write_map_to_flash(esc, chan, esc->fw.addr, map, j) < 0)
+		return -1;
+	esc_journal_mark(j, ESC_JOURNAL_FLASHED);
+
+	if (esc_flashall_mark(esc, chan, j, ESC_JOURNAL_MARK_NOT_READY |
+			      ESC_JOURNAL_BOOT_SET, 1, MARK_NOT_READY) < 0)
+		return -1;
+
+	return 0;
+}
+
 static int esc_flashall(esc4way_t *esc, const char *arg)
 {
+	esc_journal_t journal, *j;
+	file_map_t map;
 	char *end, *fname;
 	int chan = strtol(arg, &end, 0);
+	int err;
 
 	while (*end == ' ' && *end != '\0') end++;
 	fname = end;
 
-	//esc_set_passthrough(esc->fd, chan);
-	if (esc_interface_name(esc, arg) < 0)
+	if (file_map(fname, &map) < 0)
+		return -1;
+
+	//esc_set_passthrough(esc->fd, chan, esc);
+	if (esc_interface_name(esc, arg) < 0) {
+		file_unmap(&map);
 		return -1;
+	}
 
 	usleep(500000);
+	if (esc4way_select_chan(esc, 0, chan) < 0) {
+		file_unmap(&map);
+		return -1;
+	}
+
+	j = esc_journal_start(esc, chan, esc->fw.addr, &map, &journal);
+
+	err = esc_flashall_steps(esc, chan, &map, j);
+	file_unmap(&map);
+	if (err < 0)
+		return -1;
+
+	if (j)
+		esc_journal_remove(j);
+
+	return esc4way_exit(esc);
+}
+
+static void esc_archive_hash_str(const uint8_t *hash, char *str)
+{
+	char full[SHA256_SIZE * 2 + 1];
+
+	sha256_str(hash, full);
+	memcpy(str, full, 12);
+	str[12] = '\0';
+}
+
+/*
+ * backup <file> [channels]
+ */
+static int esc_backup(esc4way_t *esc, const char *arg)
+{
+	static uint8_t fw[ESC_FLASH_FIRMWARE_SIZE];
+	uint8_t set[ESC_FLASH_SETTINGS_SIZE];
+	bool chans[ESC4WAY_CHAN_MAX];
+	esc_archive_entry_t e;
+	esc_archive_t *a;
+	char fname[256];
+	char hfw[16], hset[16];
+	int chan, sfw, sset;
+	time_t now = time(NULL);
+
+	cmd_name_copy(arg, fname, sizeof(fname));
+	arg = cmd_arg_next(arg);
+
+	/* UID and number of esc */
+	if (esc_chans_num(esc) < 0)
+		return -1;
+
+	if (esc_parse_chans(esc, arg ? arg : "all", chans) < 0)
+		return -1;
+
+	if (!(a = esc_archive_open(fname, true)))
+		return -1;
+
+	for (chan = 0; chan < ESC4WAY_CHAN_MAX; chan++) {
+		if (!chans[chan])
+			continue;
+
+		if (esc4way_settings_commit(esc, chan) < 0 ||
+		    esc4way_select_chan(esc, 0, chan) < 0 ||
+		    esc4way_read_flash(esc, esc->fw.addr, fw, sizeof(fw)) < 0 ||
+		    esc4way_settings_read(esc, chan, set, sizeof(set)) < 0)
+			goto err;
+
+		memset(&e, 0, sizeof(e));
+		memcpy(e.uid, esc->uid, ESC_ARCHIVE_UID_SIZE);
+		e.chan = chan;
+		e.time = now;
+
+		e.kind = ESC_ARCHIVE_FIRMWARE;
+		e.addr = esc->fw.addr;
+		e.size = sizeof(fw);
+		if ((sfw = esc_archive_put(a, &e, fw)) < 0)
+			goto err;
+		esc_archive_hash_str(e.hash, hfw);
+
+		e.kind = ESC_ARCHIVE_SETTINGS;
+		e.addr = esc->set.addr;
+		e.size = sizeof(set);
+		if ((sset = esc_archive_put(a, &e, set)) < 0)
+			goto err;
+		esc_archive_hash_str(e.hash, hset);
+
+		printf("ESC %d firmware %s %s, settings %s %s\n", chan,
+		       hfw, sfw ? "stored" : "exists", hset, sset ? "stored" : "exists");
+	}
+
+	printf("Backup time %llu\n", (unsigned long long)now);
+	esc_archive_close(a);
+	return 0;
+err:
+	esc_archive_close(a);
+	return -1;
+}
+
+/*
+ * Write blocks of image which differ from esc flash, return number of
+ * written blocks
+ */
+static int esc_restore_image(esc4way_t *esc, int addr, const uint8_t *data, int size,
+			     bool *differ, bool check)
+{
+	int offt, n, blocks = 0;
+
+	for (offt = 0; offt < size; offt += 256) {
+		n = size - offt > 256 ? 256 : size - offt;
+
+		if (check) {
+			int eq = esc4way_verify_flash(esc, addr + offt, data + offt, n);
+
+			if (eq < 0)
+				return -1;
+			differ[offt / 256] = !eq;
+			continue;
+		}
+
+		if (!differ[offt / 256])
+			continue;
+
+		if (esc4way_write_flash(esc, addr + offt, data + offt, n) < 0)
+			return -1;
+		blocks++;
+	}
+	return blocks;
+}
+
+static int esc_restore_chan(esc4way_t *esc, esc_archive_t *a, int chan, uint64_t time)
+{
+	static uint8_t fw[ESC_FLASH_FIRMWARE_SIZE];
+	uint8_t set[ESC_FLASH_SETTINGS_SIZE];
+	bool fw_diff[ESC_FLASH_FIRMWARE_SIZE / 256 + 1];
+	bool set_diff[1];
+	const esc_archive_entry_t *efw, *eset;
+	int nfw, nset, i, blocks = 0;
+
+	efw = esc_archive_find(a, esc->uid, chan, ESC_ARCHIVE_FIRMWARE, time);
+	eset = esc_archive_find(a, esc->uid, chan, ESC_ARCHIVE_SETTINGS, time);
+	if (!efw || !eset) {
+		fprintf(stderr, "No backup of ESC %d\n", chan);
+		return -1;
+	}
+
+	if ((nfw = esc_archive_get(a, efw->hash, fw, sizeof(fw))) < 0 ||
+	    (nset = esc_archive_get(a, eset->hash, set, sizeof(set))) < 0)
+		return -1;
+
+	/* settings are replaced, pending changes are lost */
+	esc4way_settings_invalidate(esc, chan);
 	if (esc4way_select_chan(esc, 0, chan) < 0)
 		return -1;
 
-	if (esc4way_boot_flash(esc, 0) < 0)
+	if (esc_restore_image(esc, efw->addr, fw, nfw, fw_diff, true) < 0 ||
+	    esc_restore_image(esc, eset->addr, set, nset, set_diff, true) < 0)
 		return -1;
 
-	if (esc4way_mark_flash(esc, MARK_FAIL) < 0)
+	for (i = 0; i < (nfw + 255) / 256; i++)
+		blocks += fw_diff[i];
+
+	/* firmware is not bootable until settings with boot byte are written */
+	if (blocks) {
+		if (esc4way_boot_flash(esc, chan, 0) < 0 ||
+		    esc4way_settings_commit(esc, chan) < 0)
+			return -1;
+		esc4way_settings_invalidate(esc, chan);
+		set_diff[0] = true;
+	}
+
+	if (esc_restore_image(esc, efw->addr, fw, nfw, fw_diff, false) < 0 ||
+	    esc_restore_image(esc, eset->addr, set, nset, set_diff, false) < 0)
 		return -1;
 
-	if (esc4way_set_version(esc, 0, 0) < 0)
+	printf("ESC %d restored from %llu: firmware %d of %d blocks written, settings %s\n",
+	       chan, (unsigned long long)efw->time, blocks, (nfw + 255) / 256,
+	       set_diff[0] ? "written" : "equal");
+	return 0;
+}
+
+/*
+ * restore <file> [channels] [time]
+ */
+static int esc_restore(esc4way_t *esc, const char *arg)
+{
+	bool chans[ESC4WAY_CHAN_MAX];
+	esc_archive_t *a;
+	char fname[256];
+	const char *list;
+	uint64_t time = 0;
+	int chan, err = 0;
+
+	cmd_name_copy(arg, fname, sizeof(fname));
+	list = cmd_arg_next(arg);
+	if (list && (arg = cmd_arg_next(list)))
+		time = strtoull(arg, NULL, 0);
+
+	if (esc_chans_num(esc) < 0)
 		return -1;
 
-	if (esc_write_file_to_flash(esc, chan, esc->fw.addr, fname) < 0)
+	if (esc_parse_chans(esc, list ? list : "all", chans) < 0)
 		return -1;
 
-	if (esc4way_mark_flash(esc, MARK_NOT_READY) < 0)
+	if (!(a = esc_archive_open(fname, false)))
 		return -1;
 
-	if (esc4way_boot_flash(esc, 1) < 0)
+	for (chan = 0; chan < ESC4WAY_CHAN_MAX && !err; chan++) {
+		if (chans[chan])
+			err = esc_restore_chan(esc, a, chan, time);
+	}
+
+	esc_archive_close(a);
+	return err;
+}
+
+/*
+ * List archive manifest
+ */
+static int esc_archive_list(esc4way_t *esc, const char *arg)
+{
+	const esc_archive_entry_t *e;
+	esc_archive_t *a;
+	char hash[16];
+	int i, k;
+
+	if (!(a = esc_archive_open(arg, false)))
 		return -1;
 
-	return esc4way_exit(esc);
+	printf("time        uid                       esc  kind      size   hash\n");
+	for (i = 0; i < a->entries; i++) {
+		e = &a->entry[i];
+		printf("%-10llu  ", (unsigned long long)e->time);
+		for (k = 0; k < ESC_ARCHIVE_UID_SIZE; k++)
+			printf("%02x", e->uid[k]);
+		esc_archive_hash_str(e->hash, hash);
+		printf("  %-3d  %-8s  %-5u  %s\n", e->chan,
+		       e->kind == ESC_ARCHIVE_FIRMWARE ? "firmware" : "settings",
+		       e->size, hash);
+	}
+	printf("%d entries, %d images\n", a->entries, a->blobs);
+
+	esc_archive_close(a);
+	return 0;
+}
+
+static int esc_commit(esc4way_t *esc, const char *arg)
+{
+	if (strlen(arg))
+		return esc4way_settings_commit(esc, strtol(arg, NULL, 0));
+
+	return esc4way_settings_commit_all(esc);
 }
 
 static int msp_set_esc_passthrough(msp_t *msp, const char *arg)
 {
 	int chan = strtol(arg, NULL, 0);
+	esc4way_t *esc = msp->esc;
+
+	if (msp_eeprom_commit(msp) < 0)
+		return -1;
 
-	return esc_set_passthrough(msp->fd, chan);
+	if (esc) {
+		esc4way_invalidate(esc);
+		esc4way_settings_invalidate(esc, -1);
+	}
+	return esc_set_passthrough(msp->fd, chan, esc);
 }
 
 static int esc_send(esc4way_t *esc, const char *arg)
@@ -987,6 +2548,8 @@ static int esc_send(esc4way_t *esc, const char *arg)
 	for (i = 0; i < len; i++)
 		data[i + 1] = val[i + 1];
 
+	/* raw command may change anything */
+	esc4way_invalidate(esc);
 	len = esc4way_send(esc, cmd, addr, &data[1], len, data, sizeof(data));
 
 	if (len > 0) {
@@ -1009,10 +2572,7 @@ static int esc_boot(esc4way_t *esc, const char *arg)
 	chan = val[0];
 	byte = val[1];
 
-	if (esc4way_select_chan(esc, 0, chan) < 0)
-		return -1;
-
-	return esc4way_boot_flash(esc, byte);
+	return esc4way_boot_flash(esc, chan, byte);
 }
 
 static int esc_mark(esc4way_t *esc, const char *arg)
@@ -1023,10 +2583,7 @@ static int esc_mark(esc4way_t *esc, const char *arg)
 	if (!arg)
 		return -1;
 
-	if (esc4way_select_chan(esc, 0, chan) < 0)
-		return -1;
-
-	return esc4way_mark_flash(esc, arg);
+	return esc4way_mark_flash(esc, chan, arg);
 }
 
 static int esc_dump(esc4way_t *esc, const char *arg)
@@ -1072,10 +2629,13 @@ struct esc_command {
 };
 
 static const struct esc_command esc_commands[] = {
-	{"sset", "<channel> <name> <value> set esc setting", esc_sset},
+	{"sset", "[-n] <channels> <name>=<value> ... set esc settings, channels as 0,2-3 "
+		 "or all, -n shows changes without write", esc_sset},
 	{"sfset", "<file> <name> <value> set esc setting in bin file", esc_sfset, true},
 	{"sdump", "<channel> esc settings dump", esc_sdump},
 	{"sfdump", "<file> esc settings dump from bin file", esc_sfdump, true},
+	{"inventory", "[channels] boot byte, version and name of esc, all by default", esc_inventory},
+	{"sdumpall", "[json|csv] settings of all esc, equal settings are one record", esc_sdumpall},
 	{"swrite", "<channel> <file> flash settings bin file to esc", esc_swrite},
 	{"sread", "<channel> <file> read settings to bin file from esc", esc_sread},
 	{"iname", "esc interface name", esc_interface_name},
@@ -1092,6 +2652,12 @@ static const struct esc_command esc_commands[] = {
 		xstr(ESC_FLASH_SETTINGS_OFFT), esc_dump},
 	{"mark", "<channel> <string> esc set device_info to string", esc_mark},
 	{"boot", "<channel> <byte> write byte at 0 position of settings, 1 is valid firmware", esc_boot},
+	{"stats", "print transfer retries per flash block", esc_stats, true},
+	{"backup", "<file> [channels] add firmware and settings of esc to archive", esc_backup},
+	{"restore", "<file> [channels] [time] write blocks of esc which differ from archive, "
+		    "latest backup by default", esc_restore},
+	{"archive", "<file> list esc archive", esc_archive_list, true},
+	{"commit", "<channel or empty to all> write changed settings to esc", esc_commit},
 	{"help", "help usage", esc_usage, true},
 	{NULL} /* last */
 };
@@ -1120,12 +2686,6 @@ static int esc_command_handle(esc4way_t *esc, const char *cmd, const char *arg)
 			if (!ec->no_need_dev && esc->fd < 0)
 				return -2;
 
-			if (!ec->no_need_dev) {
-				/* For esc ops set timeout of serial port to 1s */
-				if (serial_set_timeout(esc->fd, 1.0) < 0)
-					failure(errno, "Can't set serial port timeout");
-			}
-
 			err = ec->handle(esc, arg);
 			if (err < 0)
 				return -1;
@@ -1154,18 +2714,12 @@ static int esc_command(msp_t *msp, const char *args)
 
 static int msp_get_motor_telemetry(msp_t *msp, const char *arg)
 {
-	motor_tlm_t tlm[BF_MOTOR_MAX_NUM];
-	int num = BF_MOTOR_MAX_NUM;
 	int motor = -1;
 
-	if (bf_get_motor_telemetry(msp->fd, &num, tlm) < 0)
-		return -1;
-
 	if (strlen(arg))
 		motor = strtol(arg, NULL, 0);
 
-	dump_motor_telemetry(num, motor, tlm);
-	return 0;
+	return msp_codec_query(msp, MSP_MOTOR_TELEMETRY, motor);
 }
 
 static int msp_board_info(msp_t *msp, const char *arg)
@@ -1175,47 +2729,84 @@ static int msp_board_info(msp_t *msp, const char *arg)
 
 static int msp_print_serial_config(msp_t *msp, const char *arg)
 {
-	int len;
-	uint8_t data[256];
-
-	if ((len = msp_transmit(msp->fd, MSP2_COMMON_SERIAL_CONFIG, 1,
-				data, 0, data, sizeof(data)) < 0))
-		return -1;
-
-	dump_serial_config(data, len);
-	return 0;
+	return msp_codec_query(msp, MSP2_COMMON_SERIAL_CONFIG, -1);
 }
 
 static int msp_print_analog(msp_t *msp, const char *arg)
 {
-	int len;
-	uint8_t data[256];
+	return msp_codec_query(msp, MSP_ANALOG, -1);
+}
 
-	if ((len = msp_transmit(msp->fd, MSP_ANALOG, 1, data, 0,
-				data, sizeof(data))) < 0)
-		return -1;
+static int msp_tx_info(msp_t *msp, const char *arg)
+{
+	return msp_codec_query(msp, MSP_TX_INFO, -1);
+}
 
-	dump_analog(data, len);
-	return 0;
+/*
+ * get <name|cmd>, query any message, decoded if it is in codec table
+ */
+static int msp_get(msp_t *msp, const char *arg)
+{
+	const msp_codec_msg_t *m;
+	char name[64];
+	char *end;
+	long cmd;
+
+	cmd_name_copy(arg, name, sizeof(name));
+	if ((m = msp_codec_find_name(name))) {
+		cmd = m->cmd;
+	} else {
+		cmd = strtol(name, &end, 0);
+		if (!name[0] || *end) {
+			fprintf(stderr, "Unknown message %s, try:", name);
+			for (m = msp_codec_msgs; m < &msp_codec_msgs[MSP_CODEC_ID_COUNT]; m++)
+				fprintf(stderr, " %s", m->name);
+			fprintf(stderr, "\n");
+			return -1;
+		}
+	}
+
+	return msp_codec_query(msp, cmd, -1);
 }
 
-static int msp_tx_info(msp_t *msp, const char *arg)
+/*
+ * imucapture <hz> <seconds> <file>, log of raw IMU and attitude, hz 0 for
+ * as fast as FC answers
+ */
+static int msp_imucapture(msp_t *msp, const char *arg)
 {
-	int len;
-	uint8_t data[256];
+	char token[256];
+	int val[2];
+	int i;
+
+	for (i = 0; i < 2 && arg; i++, arg = cmd_arg_next(arg)) {
+		cmd_name_copy(arg, token, sizeof(token));
+		val[i] = strtol(token, NULL, 0);
+	}
 
-	if ((len = msp_transmit(msp->fd, MSP_TX_INFO, 1, data, 0, data, sizeof(data))) < 0)
+	if (!arg) {
+		fprintf(stderr, "Rate, time and log file name expected\n");
 		return -1;
+	}
+	cmd_name_copy(arg, token, sizeof(token));
 
-	dump_tx_info(data, len);
-	return 0;
+	return msp_capture_imu(msp->fd, val[0], val[1], token);
 }
 
 static int msp_reboot(msp_t *msp, const char *arg)
 {
+	if (msp_eeprom_commit(msp) < 0)
+		return -1;
+
 	return bf_reboot(msp->fd, atoi(arg));
 }
 
+static int msp_rtt(msp_t *msp, const char *arg)
+{
+	rtt_printf();
+	return 0;
+}
+
 static int msp_exit_from_cli(msp_t *msp, const char *arg)
 {
 	return msp_send_cli_cmd(msp, "exit");
@@ -1259,10 +2850,41 @@ static const struct msp_command msp_commands[] = {
 	{"gmotor", "get motors values", msp_get_motor},
 	{"smotor", "<values>, set motor values, maximum number of motors is "
 		   xstr(BF_MOTOR_MAX_NUM), msp_set_motor},
-	{"pass", "set passthrough serial mode", msp_set_passthrough},
+	{"pass", "<port> <baud> set passthrough serial mode, default port "
+		 xstr(MSP_PASSTHROUGH_PORT) " at rate set by autobaud or " xstr(MSP_PASSTHROUGH_BAUD),
+		 msp_set_passthrough},
+	{"bridge", "<pty|tcp:port> [<port> <baud>] serial port to pty or tcp on loopback, "
+		   "with port and baud set passthrough first", msp_bridge},
+	{"proxy", "<tcp:port|unix:path>[,...] [ttl_ms] share FC with several MSP clients, "
+		  "getters are cached for ttl_ms, default " xstr(MSP_PROXY_TTL_DEFAULT),
+		  msp_proxy},
+	{"snapshot", "<file> save FC configuration to binary snapshot", msp_snapshot},
+	{"restore", "[-n] [-f] <file> set configuration of snapshot which differs from FC, "
+		    "-n shows differences only, -f ignores API version", msp_restore},
+	{"get", "<name|cmd> query and decode message, name of codec table or number",
+		msp_get},
+	{"sweep", "<motors> <from> <to> <step> <dwell_ms> step motors, all or list as 0,2-3, "
+		  "and print telemetry statistics of each step", msp_sweep},
+	{"waveform", "<hz> <file> stream motor values of CSV or .bin file rows at fixed rate",
+		     msp_waveform},
+	{"rcstream", "<hz> <file|-> [stall_ms] send RC channel frames of file or stdin "
+		     "at fixed rate, failsafe when input stalls", msp_rcstream},
+	{"gpsreplay", "[-n|-l] <file> [speed] send fixes of NMEA or log track to FC at track "
+		      "times, speed times faster, -n or -l sets format", msp_gpsreplay},
+	{"osdview", "[cols rows] mirror displayport OSD on the terminal, canvas is set if given",
+		    msp_osdview},
+	{"imucapture", "<hz> <seconds> <file> log raw IMU and attitude with receive time, "
+		       "hz 0 for as fast as FC answers", msp_imucapture},
+	{"mset", "<cmd> <bytes> send MSP setter, EEPROM is written once at the end or by commit",
+		 msp_mset},
+	{"commit", "write EEPROM now if setters changed configuration", msp_commit},
+	{"autobaud", "[max] set FC port and host to the fastest baud rate both have, "
+		     "up to " xstr(AUTOBAUD_FC_MAX) " by default, and use it by default",
+		     msp_autobaud},
 	{"tlm", "<motor or empty to all> get motor telemetry", msp_get_motor_telemetry},
 	{"esc_pass", "<channel or 255 for all> set esc passthrough", msp_set_esc_passthrough},
 	{"esc", "esc commands, try help to view available commands", esc_command, true},
+	{"rtt", "print link round trip times and timeouts", msp_rtt, true},
 	{NULL} /* last */
 };
 
@@ -1290,6 +2912,17 @@ static int msp_command_handle(msp_t *msp, const char *cmd, const char *arg)
 			if (!mc->no_need_dev && msp->fd < 0)
 				return -2;
 
+			/*
+			 * esc of the last passthrough answer 4way, not MSP,
+			 * autobaud finds the rate itself
+			 */
+			if (msp->baud_check && mc->handle != msp_usage) {
+				if (mc->handle != esc_command && mc->handle != msp_autobaud &&
+				    msp_baud_check(msp) < 0)
+					return -1;
+				msp->baud_check = 0;
+			}
+
 			err = mc->handle(msp, arg);
 			if (err < 0)
 				return err;
@@ -1323,6 +2956,16 @@ int msp_exec_cmd(msp_t *msp, const char *cmd)
 			exit(EXIT_FAILURE);
 		}
 	}
+
+	/* FC setters of command line go in one EEPROM write */
+	if (msp_eeprom_commit(msp) < 0)
+		exit(EXIT_FAILURE);
+
+	/* settings changed by command line go in one write per esc */
+	if (msp->esc && esc4way_settings_commit_all(msp->esc) < 0) {
+		printf("esc settings write error\n");
+		exit(EXIT_FAILURE);
+	}
 	return 0;
 }
 
@@ -0,0 +1,255 @@
+/*
+ * msp codec
+ *
+ * Messages are described once in msp_codec_def.h, records, size checks,
+ * field tables, printers and binary log come from the description, so
+ * new message needs no hand written parser. Values are read with memcpy,
+ * records are packed and unaligned.
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "bf.h"
+#include "emit.h"
+#include "msp_codec.h"
+
+/* field tables, msp_codec_analog_fields etc */
+#define MSP_MSG(msg, cmd, kind, title)				\
+	static const msp_codec_field_t msp_codec_##msg##_fields[] = {
+#define MSP_FIELD(msg, type, name, label, fmt, scale)		\
+	{#name, label, MSP_CODEC_##type, MSP_CODEC_##fmt, offsetof(msp_##msg##_t, name), scale},
+#define MSP_MSG_END(msg, size)					};
+#include "msp_codec_def.h"
+#undef MSP_MSG
+#undef MSP_FIELD
+#undef MSP_MSG_END
+
+#define ARRAYLEN(x)				(sizeof(x) / sizeof((x)[0]))
+
+#define MSP_MSG(msg, cmd, kind, title)				\
+	{#msg, title, cmd, MSP_CODEC_##kind, sizeof(msp_##msg##_t),	\
+	 msp_codec_##msg##_fields, ARRAYLEN(msp_codec_##msg##_fields)},
+#define MSP_FIELD(msg, type, name, label, fmt, scale)
+#define MSP_MSG_END(msg, size)
+const msp_codec_msg_t msp_codec_msgs[] = {
+#include "msp_codec_def.h"
+};
+#undef MSP_MSG
+#undef MSP_FIELD
+#undef MSP_MSG_END
+
+const msp_codec_msg_t *msp_codec_find(uint16_t cmd)
+{
+	int i;
+
+	for (i = 0; i < MSP_CODEC_ID_COUNT; i++) {
+		if (msp_codec_msgs[i].cmd == cmd)
+			return &msp_codec_msgs[i];
+	}
+	return NULL;
+}
+
+const msp_codec_msg_t *msp_codec_find_name(const char *name)
+{
+	int i;
+
+	for (i = 0; i < MSP_CODEC_ID_COUNT; i++) {
+		if (!strcmp(msp_codec_msgs[i].name, name))
+			return &msp_codec_msgs[i];
+	}
+	return NULL;
+}
+
+int msp_codec_count(const msp_codec_msg_t *m, const void *data, int len)
+{
+	const uint8_t *p = data;
+	int n;
+
+	switch (m->kind) {
+	case MSP_CODEC_ONE:
+		return len >= m->size ? 1 : 0;
+	case MSP_CODEC_COUNT:
+		if (len < 1)
+			return 0;
+		/* firmware may report more than it sends */
+		n = (len - 1) / m->size;
+		return p[0] < n ? p[0] : n;
+	}
+	return len / m->size;
+}
+
+const void *msp_codec_rec(const msp_codec_msg_t *m, const void *data, int len, int i)
+{
+	const uint8_t *p = data;
+
+	if (i < 0 || i >= msp_codec_count(m, data, len))
+		return NULL;
+
+	if (m->kind == MSP_CODEC_COUNT)
+		p++;
+	return p + i * m->size;
+}
+
+int64_t msp_codec_value(const msp_codec_field_t *f, const void *rec)
+{
+	const uint8_t *p = (const uint8_t *)rec + f->offt;
+	int64_t v = 0;
+
+	switch (f->type) {
+	case MSP_CODEC_U8:
+		v = *p;
+		break;
+	case MSP_CODEC_I8:
+		v = (int8_t)*p;
+		break;
+	case MSP_CODEC_U16: {
+		uint16_t u;
+		memcpy(&u, p, sizeof(u));
+		v = u;
+		break;
+	}
+	case MSP_CODEC_I16: {
+		int16_t s;
+		memcpy(&s, p, sizeof(s));
+		v = s;
+		break;
+	}
+	case MSP_CODEC_U32: {
+		uint32_t u;
+		memcpy(&u, p, sizeof(u));
+		v = u;
+		break;
+	}
+	case MSP_CODEC_I32: {
+		int32_t s;
+		memcpy(&s, p, sizeof(s));
+		v = s;
+		break;
+	}
+	}
+	return v * f->scale;
+}
+
+static void msp_codec_value_printf(const msp_codec_field_t *f, const void *rec)
+{
+	int64_t v = msp_codec_value(f, rec);
+
+	switch (f->fmt) {
+	case MSP_CODEC_HEX:
+		printf("0x%08" PRIx64, v);
+		break;
+	case MSP_CODEC_BAUD:
+		printf("%" PRId64 ", %u", v, bf_baud_rate(v));
+		break;
+	default:
+		printf("%" PRId64, v);
+		break;
+	}
+}
+
+static void msp_codec_rec_printf(const msp_codec_msg_t *m, const void *rec)
+{
+	char label[64];
+	int i;
+
+	for (i = 0; i < m->fields; i++) {
+		snprintf(label, sizeof(label), "%s:", m->field[i].label);
+		printf("\t%-24s", label);
+		msp_codec_value_printf(&m->field[i], rec);
+		printf("\n");
+	}
+}
+
+void msp_codec_printf(const msp_codec_msg_t *m, const void *data, int len, int index)
+{
+	int i, num = msp_codec_count(m, data, len);
+
+	if (m->kind == MSP_CODEC_ONE) {
+		printf("%s:\n", m->title);
+		if (num)
+			msp_codec_rec_printf(m, data);
+		return;
+	}
+
+	printf("%s: %d\n", m->title, num);
+
+	/* array of values in one line */
+	if (m->fields == 1) {
+		for (i = 0; i < num; i++) {
+			if (index < 0 || index == i) {
+				msp_codec_value_printf(m->field, msp_codec_rec(m, data, len, i));
+				printf(" ");
+			}
+		}
+		printf("\n");
+		return;
+	}
+
+	for (i = 0; i < num; i++) {
+		if (index >= 0 && index != i)
+			continue;
+		printf("%d:\n", i);
+		msp_codec_rec_printf(m, msp_codec_rec(m, data, len, i));
+	}
+}
+
+static void msp_codec_rec_emit(const msp_codec_msg_t *m, const void *rec)
+{
+	int i;
+
+	if (m->kind != MSP_CODEC_ONE && m->fields == 1) {
+		emit_int(NULL, msp_codec_value(m->field, rec));
+		return;
+	}
+
+	emit_map(NULL);
+	for (i = 0; i < m->fields; i++)
+		emit_int(m->field[i].name, msp_codec_value(&m->field[i], rec));
+	emit_end();
+}
+
+void msp_codec_emit(const msp_codec_msg_t *m, const void *data, int len, int index)
+{
+	int i, num = msp_codec_count(m, data, len);
+
+	emit_map(NULL);
+	emit_str("msg", m->name, -1);
+	emit_int("cmd", m->cmd);
+
+	if (m->kind == MSP_CODEC_ONE) {
+		if (num) {
+			emit_map("data");
+			for (i = 0; i < m->fields; i++)
+				emit_int(m->field[i].name, msp_codec_value(&m->field[i], data));
+			emit_end();
+		}
+	} else {
+		emit_array("data");
+		for (i = 0; i < num; i++) {
+			if (index < 0 || index == i)
+				msp_codec_rec_emit(m, msp_codec_rec(m, data, len, i));
+		}
+		emit_end();
+	}
+	emit_end();
+}
+
+/*
+ * Payload as it came with time and command, any message can be logged
+ * and decoded later with the same table
+ */
+int msp_codec_log(file_writer_t *fw, double t, uint16_t cmd, const void *data, int len)
+{
+	msp_codec_log_rec_t rec = {.time = t, .cmd = cmd, .size = len};
+
+	if (file_writer_write(fw, &rec, sizeof(rec)) < 0 ||
+	    file_writer_write(fw, data, len) < 0)
+		return -1;
+	return 0;
+}
@@ -0,0 +1,371 @@
+/*
+ * gps replay
+ *
+ * GPS rescue tests are driven by a recorded track sent to MSP_SET_RAW_GPS.
+ * Track is read line by line or record by record while it is replayed,
+ * so a long one is neither loaded nor converted beforehand. Fixes are sent
+ * at times of the track from the first one divided by speed, a fix which
+ * is late because of the link is sent at once, the rest stays in time.
+ * Position is kept while there is no fix, FC sees the fix lost, not a jump.
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <signal.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "msp_protocol.h"
+#include "msp_serial.h"
+#include "msp_codec.h"
+#include "msp_gps.h"
+#include "tstamp.h"
+
+typedef struct msp_gps_stat {
+	unsigned int sent;
+	unsigned int no_fix;
+	unsigned int errors;
+	/* sentences or records which are not taken */
+	unsigned int invalid;
+	double late_max;
+} msp_gps_stat_t;
+
+typedef struct msp_gps_epoch {
+	/* seconds, UTC of the day for NMEA */
+	double time;
+	bool valid;
+	msp_set_raw_gps_t gps;
+} msp_gps_epoch_t;
+
+static volatile sig_atomic_t msp_gps_stop;
+
+static void msp_gps_signal(int sig)
+{
+	msp_gps_stop = 1;
+}
+
+/*
+ * Split sentence in place, checksum is verified if it is there, return
+ * number of fields, talker and type is the first one, or -1
+ */
+static int msp_gps_nmea_split(char *s, char **f, int max)
+{
+	char *p, *star;
+	uint8_t sum = 0;
+	int n = 0;
+
+	s[strcspn(s, "\r\n")] = 0;
+	if (*s++ != '$')
+		return -1;
+
+	if ((star = strchr(s, '*'))) {
+		for (p = s; p < star; p++)
+			sum ^= *p;
+		if (strtoul(star + 1, NULL, 16) != sum)
+			return -1;
+		*star = 0;
+	}
+
+	for (p = s; n < max; p++) {
+		f[n++] = p;
+		if (!(p = strchr(p, ',')))
+			break;
+		*p = 0;
+	}
+
+	return n;
+}
+
+/* hhmmss.ss */
+static bool msp_gps_nmea_time(const char *s, double *t)
+{
+	double v;
+
+	if (strlen(s) < 6)
+		return false;
+
+	v = strtod(s, NULL);
+	*t = floor(v / 10000) * 3600 + fmod(floor(v / 100), 100) * 60 + fmod(v, 100);
+	return true;
+}
+
+/* dddmm.mmmm and hemisphere to 1e-7 deg */
+static bool msp_gps_nmea_coord(const char *s, const char *hemi, double range, int32_t *out)
+{
+	double v, deg;
+
+	if (!*s)
+		return false;
+
+	v = strtod(s, NULL);
+	deg = floor(v / 100);
+	v = deg + (v - deg * 100) / 60;
+	if (v > range)
+		return false;
+
+	if (*hemi == 'S' || *hemi == 'W')
+		v = -v;
+	*out = lround(v * 1e7);
+	return true;
+}
+
+static void msp_gps_nmea_pos(msp_set_raw_gps_t *gps, char **f)
+{
+	int32_t lat, lon;
+
+	if (msp_gps_nmea_coord(f[0], f[1], 90, &lat) &&
+	    msp_gps_nmea_coord(f[2], f[3], 180, &lon)) {
+		gps->lat = lat;
+		gps->lon = lon;
+	}
+}
+
+/*
+ * $GPGGA,time,lat,N,lon,E,quality,sats,hdop,alt,M,...
+ * $GPRMC,time,status,lat,N,lon,E,knots,course,date,...
+ */
+static int msp_gps_nmea_apply(msp_set_raw_gps_t *gps, char **f, int n)
+{
+	double v;
+
+	if (!strcmp(f[0] + 2, "GGA") && n > 9) {
+		gps->fix = atoi(f[6]) > 0 ? MSP_GPS_FIX_3D : 0;
+		gps->num_sat = atoi(f[7]);
+		msp_gps_nmea_pos(gps, &f[2]);
+		if (*f[9]) {
+			v = strtod(f[9], NULL);
+			gps->alt = v < 0 ? 0 : v > UINT16_MAX ? UINT16_MAX : lround(v);
+		}
+		return 0;
+	}
+
+	if (!strcmp(f[0] + 2, "RMC") && n > 7) {
+		if (*f[2] != 'A') {
+			gps->fix = 0;
+			return 0;
+		}
+		msp_gps_nmea_pos(gps, &f[3]);
+		/* knots to cm/s */
+		v = strtod(f[7], NULL) * 51.444;
+		gps->speed = v > UINT16_MAX ? UINT16_MAX : lround(v);
+		return 0;
+	}
+
+	return -1;
+}
+
+/*
+ * Sentences are gathered in pending until time changes, return 1 when
+ * epoch is filled, 0 at the end of file
+ */
+static int msp_gps_nmea_next(FILE *f, msp_gps_epoch_t *pending, msp_gps_epoch_t *ep,
+			     msp_gps_stat_t *st)
+{
+	char line[MSP_GPS_LINE_MAX];
+	char *field[MSP_GPS_FIELDS_MAX];
+	bool done = false;
+	int n;
+	double t;
+
+	while (!done && fgets(line, sizeof(line), f)) {
+		if (line[0] == '\r' || line[0] == '\n')
+			continue;
+
+		n = msp_gps_nmea_split(line, field, MSP_GPS_FIELDS_MAX);
+		if (n < 2 || strlen(field[0]) != 5) {
+			st->invalid++;
+			continue;
+		}
+		if (strcmp(field[0] + 2, "GGA") && strcmp(field[0] + 2, "RMC"))
+			continue;
+		if (!msp_gps_nmea_time(field[1], &t)) {
+			st->invalid++;
+			continue;
+		}
+
+		if (pending->valid && pending->time != t) {
+			*ep = *pending;
+			done = true;
+		}
+		pending->time = t;
+		pending->valid = true;
+		if (msp_gps_nmea_apply(&pending->gps, field, n) < 0)
+			st->invalid++;
+	}
+
+	if (done)
+		return 1;
+
+	if (!pending->valid)
+		return 0;
+	*ep = *pending;
+	pending->valid = false;
+	return 1;
+}
+
+/* records of msp_codec_log() */
+static int msp_gps_bin_next(FILE *f, msp_gps_epoch_t *ep, msp_gps_stat_t *st)
+{
+	msp_codec_log_rec_t rec;
+	uint8_t data[256];
+
+	while (fread(&rec, sizeof(rec), 1, f) == 1) {
+		if (rec.size > sizeof(data)) {
+			if (fseek(f, rec.size, SEEK_CUR) < 0)
+				return 0;
+			continue;
+		}
+		if (fread(data, 1, rec.size, f) != rec.size)
+			return 0;
+
+		if (rec.cmd != MSP_RAW_GPS && rec.cmd != MSP_SET_RAW_GPS)
+			continue;
+		if (rec.size < sizeof(ep->gps)) {
+			st->invalid++;
+			continue;
+		}
+
+		ep->time = rec.time;
+		memcpy(&ep->gps, data, sizeof(ep->gps));
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Format of track by its start. NMEA is $, talker and type and a comma
+ * after blank lines, a single $ tells nothing as binary log starts with
+ * double time. Log record is finite time from the start of capture.
+ */
+static int msp_gps_format(FILE *f)
+{
+	msp_codec_log_rec_t rec;
+	char head[8];
+	int c, i, n;
+
+	while ((c = fgetc(f)) == '\r' || c == '\n')
+		;
+	head[0] = c;
+	n = 1 + fread(&head[1], 1, sizeof(head) - 1, f);
+	rewind(f);
+
+	for (i = 1; i < n && isalnum((unsigned char)head[i]); i++)
+		;
+	if (head[0] == '$' && i >= 5 && i < n && head[i] == ',')
+		return MSP_GPS_FORMAT_NMEA;
+
+	if (fread(&rec, sizeof(rec), 1, f) == 1 && isfinite(rec.time) && rec.time >= 0) {
+		rewind(f);
+		return MSP_GPS_FORMAT_LOG;
+	}
+
+	return -1;
+}
+
+static void msp_gps_stat_printf(const msp_gps_stat_t *st, double track, double time)
+{
+	printf("GPS fixes %u, no fix %u, track %.1f s in %.1f s, late max %.1f ms, "
+	       "invalid %u, errors %u\n", st->sent, st->no_fix, track, time,
+	       st->late_max * 1000, st->invalid, st->errors);
+	fflush(stdout);
+}
+
+int msp_gps_replay(serial_handle fd, const char *fname, double speed, int format)
+{
+	msp_gps_epoch_t pending = {0}, ep = {0};
+	msp_gps_stat_t st = {0};
+	double t0 = 0, first = 0, prev = 0, day = 0, t, due, now, report = 0;
+	void (*sig)(int);
+	bool nmea;
+	FILE *f;
+	int n;
+
+	if (!(speed > 0 && speed <= MSP_GPS_SPEED_MAX)) {
+		fprintf(stderr, "Invalid speed %g, up to %d\n", speed, MSP_GPS_SPEED_MAX);
+		return -1;
+	}
+
+	if (!(f = fopen(fname, "rb"))) {
+		fprintf(stderr, "Can't open %s\n", fname);
+		return -1;
+	}
+
+	if (format == MSP_GPS_FORMAT_AUTO && (format = msp_gps_format(f)) < 0) {
+		fprintf(stderr, "Unknown track format of %s, use -n for NMEA or -l for log\n",
+			fname);
+		fclose(f);
+		return -1;
+	}
+	nmea = format == MSP_GPS_FORMAT_NMEA;
+
+	msp_gps_stop = 0;
+	sig = signal(SIGINT, msp_gps_signal);
+
+	printf("GPS replay of %s %s, speed %g, Ctrl-C stops\n",
+	       nmea ? "NMEA" : "log", fname, speed);
+	fflush(stdout);
+
+	while (!msp_gps_stop) {
+		if (nmea)
+			n = msp_gps_nmea_next(f, &pending, &ep, &st);
+		else
+			n = msp_gps_bin_next(f, &ep, &st);
+		if (n <= 0)
+			break;
+
+		/* NMEA time of the day wraps at midnight */
+		if (nmea && st.sent && ep.time + day < prev - 43200)
+			day += 86400;
+		t = ep.time + day;
+
+		if (!st.sent) {
+			t0 = tstamp();
+			first = t;
+			report = t0 + MSP_GPS_REPORT_SEC;
+		}
+
+		due = t0 + (t - first) / speed;
+		while ((now = tstamp()) < due && !msp_gps_stop)
+			usleep(due - now < 0.1 ? (due - now) * 1e6 : 100000);
+		if (msp_gps_stop)
+			break;
+
+		if (now - due > st.late_max)
+			st.late_max = now - due;
+
+		if (msp_transmit(fd, MSP_SET_RAW_GPS, MSP_DIR_OUT, &ep.gps, sizeof(ep.gps),
+				 NULL, 0) < 0)
+			st.errors++;
+		st.sent++;
+		prev = t;
+		if (!ep.gps.fix)
+			st.no_fix++;
+
+		if (now >= report) {
+			msp_gps_stat_printf(&st, t - first, now - t0);
+			report += MSP_GPS_REPORT_SEC;
+		}
+	}
+
+	signal(SIGINT, sig);
+	fclose(f);
+
+	msp_gps_stat_printf(&st, prev - first, st.sent ? tstamp() - t0 : 0);
+	if (msp_gps_stop) {
+		fprintf(stderr, "GPS replay stopped\n");
+		return -1;
+	}
+	if (!st.sent) {
+		fprintf(stderr, "No fixes in %s\n", fname);
+		return -1;
+	}
+
+	return st.errors ? -1 : 0;
+}
@@ -0,0 +1,356 @@
+/*
+ * osd view
+ *
+ * Displayport OSD of FC is mirrored on the terminal for bench work without
+ * goggles. Writes of FC go to a grid, at draw screen the grid is compared
+ * with what terminal shows and only changed cells are sent. Cursor is
+ * moved only if reprinting a short gap is longer, color is set only when
+ * it changes, so a steady OSD costs a few bytes per draw whatever its rate.
+ *
+ * Linux only.
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "serial.h"
+#include "msp_osd.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <unistd.h>
+
+#include "msp_protocol.h"
+#include "msp_serial.h"
+#include "msp_parser.h"
+#include "transport.h"
+#include "tstamp.h"
+
+/* space of font page 0 */
+#define MSP_OSD_BLANK		' '
+/* cursor move, color and character of each cell at worst */
+#define MSP_OSD_OUT_SIZE	(MSP_OSD_ROWS_MAX * MSP_OSD_COLS_MAX * 24 + 256)
+/* status line is refreshed, seconds */
+#define MSP_OSD_STATUS_SEC	1
+/* no displayport, seconds */
+#define MSP_OSD_IDLE_SEC	2
+
+typedef struct msp_osd {
+	/* cell is attribute << 8 | character */
+	uint16_t grid[MSP_OSD_ROWS_MAX][MSP_OSD_COLS_MAX];
+	uint16_t shown[MSP_OSD_ROWS_MAX][MSP_OSD_COLS_MAX];
+	int cols;
+	int rows;
+	/* attribute terminal draws with */
+	int attr;
+	bool dirty;
+	bool draw;
+	/* terminal is cleared, grid is drawn from scratch */
+	bool redraw;
+	unsigned int draws;
+	unsigned long bytes;
+	/* per second, of the last status period */
+	double draw_rate;
+	double byte_rate;
+	double last_data;
+	int len;
+	char out[MSP_OSD_OUT_SIZE];
+} msp_osd_t;
+
+static volatile sig_atomic_t msp_osd_stop;
+
+static void msp_osd_signal(int sig)
+{
+	msp_osd_stop = 1;
+}
+
+static void msp_osd_printf(msp_osd_t *o, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(o->out + o->len, sizeof(o->out) - o->len, fmt, ap);
+	va_end(ap);
+
+	if (n > 0)
+		o->len += n < (int)sizeof(o->out) - o->len ? n : (int)sizeof(o->out) - o->len - 1;
+}
+
+static void msp_osd_putc(msp_osd_t *o, char c)
+{
+	if (o->len < (int)sizeof(o->out))
+		o->out[o->len++] = c;
+}
+
+static int msp_osd_flush(msp_osd_t *o)
+{
+	int off, n;
+
+	for (off = 0; off < o->len; off += n) {
+		if ((n = write(STDOUT_FILENO, o->out + off, o->len - off)) < 0) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			return -1;
+		}
+	}
+	o->bytes += o->len;
+	o->len = 0;
+	return 0;
+}
+
+/* symbols of OSD font have no terminal glyph */
+static char msp_osd_glyph(uint16_t cell)
+{
+	uint8_t c = cell & 0xff;
+
+	return c >= 0x20 && c < 0x7f ? c : c ? '.' : ' ';
+}
+
+/* normal, info, warning and critical font pages */
+static void msp_osd_sgr(msp_osd_t *o, int attr)
+{
+	static const char *const color[] = {"", ";36", ";33", ";1;31"};
+
+	msp_osd_printf(o, "\033[0%s%sm", color[attr & MSP_OSD_ATTR_PAGE_MASK],
+		       attr & MSP_OSD_ATTR_BLINK ? ";5" : "");
+	o->attr = attr;
+}
+
+static void msp_osd_clear(msp_osd_t *o)
+{
+	int r, c;
+
+	for (r = 0; r < MSP_OSD_ROWS_MAX; r++)
+		for (c = 0; c < MSP_OSD_COLS_MAX; c++)
+			o->grid[r][c] = MSP_OSD_BLANK;
+}
+
+/*
+ * Reprint unchanged cells from cursor up to column, if the gap is short
+ * and of the current attribute
+ */
+static bool msp_osd_gap(msp_osd_t *o, int r, int from, int to)
+{
+	int c;
+
+	if (to - from > MSP_OSD_GAP_MAX)
+		return false;
+
+	for (c = from; c < to; c++) {
+		if ((o->shown[r][c] >> 8) != o->attr)
+			return false;
+	}
+	for (c = from; c < to; c++)
+		msp_osd_putc(o, msp_osd_glyph(o->shown[r][c]));
+	return true;
+}
+
+static void msp_osd_draw(msp_osd_t *o)
+{
+	int r, c, cr = -1, cc = -1;
+	uint16_t cell;
+
+	if (o->redraw) {
+		msp_osd_printf(o, "\033[0m\033[2J");
+		o->attr = 0;
+		for (r = 0; r < MSP_OSD_ROWS_MAX; r++)
+			for (c = 0; c < MSP_OSD_COLS_MAX; c++)
+				o->shown[r][c] = MSP_OSD_BLANK;
+		o->redraw = false;
+	}
+
+	for (r = 0; r < o->rows; r++) {
+		for (c = 0; c < o->cols; c++) {
+			cell = o->grid[r][c];
+			if (cell == o->shown[r][c])
+				continue;
+
+			if (r != cr || !msp_osd_gap(o, r, cc, c))
+				msp_osd_printf(o, "\033[%d;%dH", r + 1, c + 1);
+			if ((cell >> 8) != o->attr)
+				msp_osd_sgr(o, cell >> 8);
+
+			msp_osd_putc(o, msp_osd_glyph(cell));
+			o->shown[r][c] = cell;
+			cr = r;
+			cc = c + 1;
+		}
+	}
+
+	o->dirty = false;
+	o->draw = false;
+}
+
+static void msp_osd_status(msp_osd_t *o, double t)
+{
+	msp_osd_printf(o, "\033[%d;1H\033[0m\033[K", o->rows + 2);
+	o->attr = 0;
+
+	if (t - o->last_data > MSP_OSD_IDLE_SEC)
+		msp_osd_printf(o, "Waiting for displayport, Ctrl-C exits");
+	else
+		msp_osd_printf(o, "OSD %dx%d, %.1f draws/s, %.0f B/s to terminal, Ctrl-C exits",
+			       o->cols, o->rows, o->draw_rate, o->byte_rate);
+}
+
+static void msp_osd_write(msp_osd_t *o, const uint8_t *p, int len)
+{
+	int row = p[0], col = p[1], attr, i;
+
+	attr = p[2] & (MSP_OSD_ATTR_PAGE_MASK | MSP_OSD_ATTR_BLINK);
+	if (row >= MSP_OSD_ROWS_MAX)
+		return;
+
+	for (i = 3; i < len && p[i] && col < MSP_OSD_COLS_MAX; i++, col++)
+		o->grid[row][col] = attr << 8 | p[i];
+
+	/* status line moves below the grid */
+	if (row >= o->rows || col > o->cols) {
+		if (row >= o->rows)
+			o->rows = row + 1;
+		if (col > o->cols)
+			o->cols = col;
+		o->redraw = true;
+	}
+	o->dirty = true;
+}
+
+static void msp_osd_frame(msp_osd_t *o, const msp_frame_t *f, double t)
+{
+	if (f->cmd != MSP_DISPLAYPORT || !f->size)
+		return;
+
+	o->last_data = t;
+	switch (f->payload[0]) {
+	case MSP_OSD_CLEAR_SCREEN:
+		msp_osd_clear(o);
+		o->dirty = true;
+		break;
+	case MSP_OSD_WRITE_STRING:
+		if (f->size > 4)
+			msp_osd_write(o, f->payload + 1, f->size - 1);
+		break;
+	case MSP_OSD_DRAW_SCREEN:
+		o->draws++;
+		o->draw = true;
+		break;
+	}
+}
+
+int msp_osd_view(serial_handle fd, int cols, int rows)
+{
+	struct sigaction sa, old_int, old_term;
+	static msp_osd_t o;
+	const msp_frame_t *f;
+	msp_parser_t parser;
+	double t, drawn, status;
+	uint8_t buf[512], canvas[2];
+	int len, off, n, err = 0;
+	bool redraw;
+
+	if (cols < 0 || cols > MSP_OSD_COLS_MAX || rows < 0 || rows > MSP_OSD_ROWS_MAX) {
+		fprintf(stderr, "Invalid canvas %dx%d, up to %dx%d\n", cols, rows,
+			MSP_OSD_COLS_MAX, MSP_OSD_ROWS_MAX);
+		return -1;
+	}
+
+	memset(&o, 0, sizeof(o));
+	if (cols && rows) {
+		canvas[0] = cols;
+		canvas[1] = rows;
+		if (msp_transmit(fd, MSP_SET_OSD_CANVAS, MSP_DIR_OUT, canvas, sizeof(canvas),
+				 NULL, 0) < 0) {
+			fprintf(stderr, "Can't set canvas %dx%d\n", cols, rows);
+			return -1;
+		}
+		o.cols = cols;
+		o.rows = rows;
+	}
+
+	msp_osd_clear(&o);
+	o.redraw = true;
+	msp_parser_init(&parser);
+	/* replies are read as they come */
+	transport_set_timeout(fd, 0);
+
+	msp_osd_stop = 0;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = msp_osd_signal;
+	sigaction(SIGINT, &sa, &old_int);
+	sigaction(SIGTERM, &sa, &old_term);
+
+	/* cursor is hidden while drawing */
+	msp_osd_printf(&o, "\033[?25l");
+	drawn = status = tstamp();
+	o.last_data = status - MSP_OSD_IDLE_SEC - 1;
+
+	while (!msp_osd_stop) {
+		if ((n = transport_poll(fd, MSP_OSD_DRAW_MS / 1000.0)) < 0 && errno != EINTR) {
+			fprintf(stderr, "Link is closed\n");
+			err = -1;
+			break;
+		}
+		if (n > 0) {
+			if ((len = transport_read(fd, buf, sizeof(buf))) < 0) {
+				fprintf(stderr, "Link is closed\n");
+				err = -1;
+				break;
+			}
+
+			t = tstamp();
+			for (off = 0; off < len; off += n) {
+				n = msp_parser_feed(&parser, buf + off, len - off, &f);
+				if (f)
+					msp_osd_frame(&o, f, t);
+			}
+		}
+
+		t = tstamp();
+		redraw = o.redraw;
+		if (o.draw || o.redraw || (o.dirty && t - drawn >= MSP_OSD_DRAW_MS / 1000.0)) {
+			msp_osd_draw(&o);
+			drawn = t;
+		}
+		if (t - status >= MSP_OSD_STATUS_SEC) {
+			o.draw_rate = o.draws / (t - status);
+			o.byte_rate = o.bytes / (t - status);
+			o.draws = 0;
+			o.bytes = 0;
+			status = t;
+			msp_osd_status(&o, t);
+		} else if (redraw) {
+			msp_osd_status(&o, t);
+		}
+		if (o.len && msp_osd_flush(&o) < 0) {
+			err = -1;
+			break;
+		}
+	}
+
+	msp_osd_printf(&o, "\033[0m\033[%d;1H\033[?25h\n", o.rows + 3);
+	msp_osd_flush(&o);
+
+	sigaction(SIGINT, &old_int, NULL);
+	sigaction(SIGTERM, &old_term, NULL);
+
+	return err;
+}
+
+#else
+
+int msp_osd_view(serial_handle fd, int cols, int rows)
+{
+	fprintf(stderr, "osdview is supported on Linux only\n");
+	return -1;
+}
+
+#endif
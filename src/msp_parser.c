@@ -0,0 +1,189 @@
+/*
+ * msp stream parser
+ *
+ * Byte stream to MSP v1 and v2 frames of any direction. Bytes are fed
+ * as they come, broken frames are counted and parser resyncs on next '$'.
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#include <string.h>
+
+#include "msp.h"
+#include "crc.h"
+#include "msp_parser.h"
+
+enum {
+	MSP_PARSER_IDLE = 0,
+	MSP_PARSER_PROTO,
+	MSP_PARSER_DIR,
+	MSP_PARSER_HEADER,
+	MSP_PARSER_PAYLOAD,
+};
+
+void msp_parser_init(msp_parser_t *p)
+{
+	memset(p, 0, sizeof(msp_parser_t));
+}
+
+static void msp_parser_reset(msp_parser_t *p)
+{
+	p->state = MSP_PARSER_IDLE;
+	p->len = 0;
+	p->need = 0;
+}
+
+/*
+ * Header is complete, find out payload size
+ */
+static int msp_parser_header(msp_parser_t *p)
+{
+	msp_frame_t *f = &p->frame;
+
+	if (f->version == 1) {
+		mspHeaderV1_t *h = (mspHeaderV1_t *)&p->buf[3];
+
+		f->flags = 0;
+		f->cmd = h->cmd;
+		f->size = h->size;
+	} else {
+		mspHeaderV2_t *h = (mspHeaderV2_t *)&p->buf[3];
+
+		f->flags = h->flags;
+		f->cmd = h->cmd;
+		f->size = h->size;
+	}
+
+	if (f->size > MSP_PARSER_PAYLOAD_MAX)
+		return -1;
+
+	/* payload and crc */
+	p->need = f->size + 1;
+	return 0;
+}
+
+static int msp_parser_check(msp_parser_t *p)
+{
+	msp_frame_t *f = &p->frame;
+	const uint8_t *h = &p->buf[3];
+	uint8_t crc = 0;
+	int i, hlen;
+
+	if (f->version == 1) {
+		hlen = sizeof(mspHeaderV1_t);
+		for (i = 0; i < hlen + f->size; i++)
+			crc ^= h[i];
+	} else {
+		hlen = sizeof(mspHeaderV2_t);
+		crc = crc8_cal_buf(h, hlen + f->size, MSP_CRC_POLY);
+	}
+
+	if (crc != h[hlen + f->size])
+		return -1;
+
+	f->payload = h + hlen;
+	f->raw = p->buf;
+	f->raw_len = p->len;
+	return 0;
+}
+
+/*
+ * Feed bytes to parser, return number of bytes used. When frame is
+ * complete, *frame points to it and it is valid until next call.
+ */
+int msp_parser_feed(msp_parser_t *p, const uint8_t *data, int len, const msp_frame_t **frame)
+{
+	msp_frame_t *f = &p->frame;
+	int i, n;
+
+	*frame = NULL;
+
+	for (i = 0; i < len; ) {
+		uint8_t c = data[i];
+
+		switch (p->state) {
+		case MSP_PARSER_IDLE:
+			i++;
+			if (c != '$')
+				continue;
+			p->buf[0] = c;
+			p->len = 1;
+			p->state = MSP_PARSER_PROTO;
+			continue;
+		case MSP_PARSER_PROTO:
+			i++;
+			if (c != 'M' && c != 'X') {
+				p->errors++;
+				msp_parser_reset(p);
+				continue;
+			}
+			f->version = c == 'M' ? 1 : 2;
+			p->buf[p->len++] = c;
+			p->state = MSP_PARSER_DIR;
+			continue;
+		case MSP_PARSER_DIR:
+			i++;
+			if (c != '<' && c != '>' && c != '!') {
+				p->errors++;
+				msp_parser_reset(p);
+				continue;
+			}
+			f->dir = c;
+			p->buf[p->len++] = c;
+			p->need = f->version == 1 ? sizeof(mspHeaderV1_t) : sizeof(mspHeaderV2_t);
+			p->state = MSP_PARSER_HEADER;
+			continue;
+		}
+
+		/* header and payload are copied in one go */
+		n = len - i;
+		if (n > p->need)
+			n = p->need;
+		memcpy(&p->buf[p->len], &data[i], n);
+		p->len += n;
+		p->need -= n;
+		i += n;
+
+		if (p->need)
+			continue;
+
+		if (p->state == MSP_PARSER_HEADER) {
+			if (msp_parser_header(p) < 0) {
+				p->errors++;
+				msp_parser_reset(p);
+				continue;
+			}
+			p->state = MSP_PARSER_PAYLOAD;
+			continue;
+		}
+
+		if (msp_parser_check(p) < 0) {
+			p->errors++;
+			msp_parser_reset(p);
+			continue;
+		}
+
+		p->frames++;
+		p->state = MSP_PARSER_IDLE;
+		*frame = f;
+		return i;
+	}
+	return i;
+}
+
+/*
+ * Bytes to end of frame start, header or frame, whatever comes next. For
+ * readers which wait for exact count, frame is taken as soon as it is in.
+ */
+int msp_parser_want(const msp_parser_t *p)
+{
+	switch (p->state) {
+	case MSP_PARSER_IDLE:
+		return 3;
+	case MSP_PARSER_PROTO:
+		return 2;
+	case MSP_PARSER_DIR:
+		return 1;
+	}
+	return p->need;
+}
@@ -0,0 +1,722 @@
+/*
+ * msp proxy
+ *
+ * Owns FC serial port and serves MSP v1/v2 requests of several local
+ * clients on tcp ("tcp:5761", loopback only) and unix sockets
+ * ("unix:/tmp/bfctl.sock"). Requests are queued in arrival order and
+ * sent one at a time, reply is matched by version and command of the
+ * request on the link and routed to the client which sent it.
+ *
+ * Replies of read only requests (getters without payload) are cached for
+ * a short time, equal requests of several clients queued at the same time
+ * share one link transaction.
+ *
+ * Linux only.
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "serial.h"
+#include "transport.h"
+#include "msp_proxy.h"
+
+#ifdef __linux__
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "msp.h"
+#include "msp_protocol.h"
+#include "msp_parser.h"
+#include "crc.h"
+#include "rtt.h"
+#include "tstamp.h"
+
+#define MSP_PROXY_LISTEN		2
+
+typedef struct msp_proxy_client {
+	int fd;
+	msp_parser_t parser;
+	int out_len;
+	uint8_t out[MSP_PROXY_OUT_SIZE];
+} msp_proxy_client_t;
+
+typedef struct msp_proxy_req {
+	uint8_t version;
+	uint16_t cmd;
+	bool cacheable;
+	/* clients waiting for reply, bit per client */
+	uint32_t waiters;
+	int len;
+	uint8_t frame[MSP_PARSER_FRAME_MAX];
+} msp_proxy_req_t;
+
+typedef struct msp_proxy_cache {
+	uint8_t version;
+	uint16_t cmd;
+	bool valid;
+	double time;
+	int len;
+	uint8_t frame[MSP_PARSER_FRAME_MAX];
+} msp_proxy_cache_t;
+
+typedef struct msp_proxy {
+	int epfd;
+	int serial;
+	int listen[MSP_PROXY_LISTEN];
+	char unix_path[108];
+	double ttl;
+	msp_parser_t link;
+	msp_proxy_client_t client[MSP_PROXY_CLIENTS];
+	/* fifo of requests, head one is on the link when inflight */
+	msp_proxy_req_t queue[MSP_PROXY_QUEUE];
+	int head;
+	int count;
+	bool inflight;
+	double sent;
+	msp_proxy_cache_t cache[MSP_PROXY_CACHE];
+	struct {
+		unsigned long requests;
+		unsigned long transactions;
+		unsigned long hits;
+		unsigned long shared;
+		unsigned long timeouts;
+		unsigned long unmatched;
+	} stat;
+} msp_proxy_t;
+
+static volatile sig_atomic_t msp_proxy_stop;
+
+static void msp_proxy_signal(int sig)
+{
+	msp_proxy_stop = 1;
+}
+
+/*
+ * Getters without side effects, their replies may be shared, anything
+ * else flushes the cache
+ */
+static bool msp_proxy_readonly(const msp_frame_t *f)
+{
+	if (f->size)
+		return false;
+
+	switch (f->cmd) {
+	case MSP_API_VERSION:
+	case MSP_FC_VARIANT:
+	case MSP_FC_VERSION:
+	case MSP_BOARD_INFO:
+	case MSP_BUILD_INFO:
+	case MSP_NAME:
+	case MSP_BATTERY_CONFIG:
+	case MSP_MODE_RANGES:
+	case MSP_MODE_RANGES_EXTRA:
+	case MSP_FEATURE_CONFIG:
+	case MSP_BOARD_ALIGNMENT_CONFIG:
+	case MSP_CURRENT_METER_CONFIG:
+	case MSP_MIXER_CONFIG:
+	case MSP_RX_CONFIG:
+	case MSP_LED_COLORS:
+	case MSP_LED_STRIP_CONFIG:
+	case MSP_LED_STRIP_MODECOLOR:
+	case MSP_RSSI_CONFIG:
+	case MSP_ADJUSTMENT_RANGES:
+	case MSP_CF_SERIAL_CONFIG:
+	case MSP_VOLTAGE_METER_CONFIG:
+	case MSP_ARMING_CONFIG:
+	case MSP_RX_MAP:
+	case MSP_DATAFLASH_SUMMARY:
+	case MSP_FAILSAFE_CONFIG:
+	case MSP_RXFAIL_CONFIG:
+	case MSP_SDCARD_SUMMARY:
+	case MSP_BLACKBOX_CONFIG:
+	case MSP_TRANSPONDER_CONFIG:
+	case MSP_OSD_CONFIG:
+	case MSP_VTX_CONFIG:
+	case MSP_ADVANCED_CONFIG:
+	case MSP_FILTER_CONFIG:
+	case MSP_PID_ADVANCED:
+	case MSP_SENSOR_CONFIG:
+	case MSP_OSD_VIDEO_CONFIG:
+	case MSP_BEEPER_CONFIG:
+	case MSP_TX_INFO:
+	case MSP_OSD_CANVAS:
+	case MSP_STATUS:
+	case MSP_STATUS_EX:
+	case MSP_RAW_IMU:
+	case MSP_SERVO:
+	case MSP_MOTOR:
+	case MSP_RC:
+	case MSP_RAW_GPS:
+	case MSP_COMP_GPS:
+	case MSP_ATTITUDE:
+	case MSP_ALTITUDE:
+	case MSP_ANALOG:
+	case MSP_RC_TUNING:
+	case MSP_PID:
+	case MSP_BOXNAMES:
+	case MSP_PIDNAMES:
+	case MSP_BOXIDS:
+	case MSP_SERVO_CONFIGURATIONS:
+	case MSP_SERVO_MIX_RULES:
+	case MSP_MOTOR_3D_CONFIG:
+	case MSP_RC_DEADBAND:
+	case MSP_SENSOR_ALIGNMENT:
+	case MSP_VOLTAGE_METERS:
+	case MSP_CURRENT_METERS:
+	case MSP_BATTERY_STATE:
+	case MSP_MOTOR_CONFIG:
+	case MSP_GPS_CONFIG:
+	case MSP_COMPASS_CONFIG:
+	case MSP_ESC_SENSOR_DATA:
+	case MSP_GPS_RESCUE:
+	case MSP_GPS_RESCUE_PIDS:
+	case MSP_MOTOR_TELEMETRY:
+	case MSP_SIMPLIFIED_TUNING:
+	case MSP_UID:
+	case MSP_GPSSVINFO:
+	case MSP_GPSSTATISTICS:
+	case MSP_ACC_TRIM:
+	case MSP_RTC:
+	case MSP_DEBUG:
+	case MSP2_COMMON_SERIAL_CONFIG:
+	case MSP2_MOTOR_OUTPUT_REORDERING:
+	case MSP2_GET_VTX_DEVICE_STATUS:
+	case MSP2_GET_OSD_WARNINGS:
+		return true;
+	}
+	return false;
+}
+
+static int msp_proxy_error_frame(uint8_t version, uint16_t cmd, uint8_t *buf)
+{
+	if (version == 1) {
+		buf[0] = '$';
+		buf[1] = 'M';
+		buf[2] = '!';
+		buf[3] = 0;
+		buf[4] = cmd;
+		buf[5] = cmd;
+		return 6;
+	} else {
+		mspHeaderV2_t *h = (mspHeaderV2_t *)&buf[3];
+
+		buf[0] = '$';
+		buf[1] = 'X';
+		buf[2] = '!';
+		h->flags = 0;
+		h->cmd = cmd;
+		h->size = 0;
+		buf[3 + sizeof(*h)] = crc8_cal_buf(h, sizeof(*h), MSP_CRC_POLY);
+		return 3 + sizeof(*h) + 1;
+	}
+}
+
+static void msp_proxy_drop_client(msp_proxy_t *px, int id)
+{
+	msp_proxy_client_t *c = &px->client[id];
+	int i;
+
+	epoll_ctl(px->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	c->fd = -1;
+
+	for (i = 0; i < px->count; i++)
+		px->queue[(px->head + i) % MSP_PROXY_QUEUE].waiters &= ~(1u << id);
+}
+
+static void msp_proxy_client_events(msp_proxy_t *px, int id)
+{
+	msp_proxy_client_t *c = &px->client[id];
+	struct epoll_event e;
+
+	e.events = EPOLLIN | (c->out_len ? EPOLLOUT : 0);
+	e.data.u32 = id;
+	epoll_ctl(px->epfd, EPOLL_CTL_MOD, c->fd, &e);
+}
+
+static int msp_proxy_flush(msp_proxy_t *px, int id)
+{
+	msp_proxy_client_t *c = &px->client[id];
+	ssize_t n;
+
+	if (!c->out_len)
+		return 0;
+
+	n = write(c->fd, c->out, c->out_len);
+	if (n < 0)
+		return errno == EAGAIN || errno == EINTR ? 0 : -1;
+
+	memmove(c->out, c->out + n, c->out_len - n);
+	c->out_len -= n;
+	msp_proxy_client_events(px, id);
+	return 0;
+}
+
+/*
+ * Client which does not read its replies is dropped when its buffer
+ * is full
+ */
+static void msp_proxy_send(msp_proxy_t *px, int id, const uint8_t *data, int len)
+{
+	msp_proxy_client_t *c = &px->client[id];
+
+	if (c->fd < 0)
+		return;
+
+	if (c->out_len + len > MSP_PROXY_OUT_SIZE) {
+		fprintf(stderr, "Client %d is too slow, dropped\n", id);
+		msp_proxy_drop_client(px, id);
+		return;
+	}
+
+	memcpy(c->out + c->out_len, data, len);
+	c->out_len += len;
+
+	if (msp_proxy_flush(px, id) < 0)
+		msp_proxy_drop_client(px, id);
+}
+
+static void msp_proxy_reply(msp_proxy_t *px, uint32_t waiters, const uint8_t *data, int len)
+{
+	int id;
+
+	for (id = 0; id < MSP_PROXY_CLIENTS; id++) {
+		if (waiters & (1u << id))
+			msp_proxy_send(px, id, data, len);
+	}
+}
+
+static msp_proxy_cache_t *msp_proxy_cache_find(msp_proxy_t *px, uint8_t version, uint16_t cmd)
+{
+	msp_proxy_cache_t *ce;
+	int i;
+
+	for (i = 0; i < MSP_PROXY_CACHE; i++) {
+		ce = &px->cache[i];
+		if (ce->valid && ce->version == version && ce->cmd == cmd)
+			return ce;
+	}
+	return NULL;
+}
+
+static void msp_proxy_cache_put(msp_proxy_t *px, const msp_frame_t *f)
+{
+	msp_proxy_cache_t *ce, *old = NULL;
+	int i;
+
+	if (!(ce = msp_proxy_cache_find(px, f->version, f->cmd))) {
+		/* free or the oldest entry */
+		for (i = 0; i < MSP_PROXY_CACHE; i++) {
+			ce = &px->cache[i];
+			if (!ce->valid)
+				break;
+			if (!old || ce->time < old->time)
+				old = ce;
+		}
+		if (i == MSP_PROXY_CACHE)
+			ce = old;
+	}
+
+	ce->valid = true;
+	ce->version = f->version;
+	ce->cmd = f->cmd;
+	ce->time = tstamp();
+	ce->len = f->raw_len;
+	memcpy(ce->frame, f->raw, f->raw_len);
+}
+
+/*
+ * Any request which is not a known getter may change FC state, cached
+ * replies are dropped
+ */
+static void msp_proxy_cache_flush(msp_proxy_t *px)
+{
+	int i;
+
+	for (i = 0; i < MSP_PROXY_CACHE; i++)
+		px->cache[i].valid = false;
+}
+
+static void msp_proxy_next(msp_proxy_t *px)
+{
+	msp_proxy_req_t *r;
+
+	while (!px->inflight && px->count) {
+		r = &px->queue[px->head];
+
+		/* all clients of request are gone */
+		if (!r->waiters) {
+			px->head = (px->head + 1) % MSP_PROXY_QUEUE;
+			px->count--;
+			continue;
+		}
+
+		if (transport_write(px->serial, r->frame, r->len) != r->len) {
+			fprintf(stderr, "Serial write error\n");
+			msp_proxy_stop = 1;
+			return;
+		}
+		px->inflight = true;
+		px->sent = tstamp();
+		px->stat.transactions++;
+	}
+}
+
+static void msp_proxy_done(msp_proxy_t *px)
+{
+	px->inflight = false;
+	px->head = (px->head + 1) % MSP_PROXY_QUEUE;
+	px->count--;
+	msp_proxy_next(px);
+}
+
+static void msp_proxy_request(msp_proxy_t *px, int id, const msp_frame_t *f)
+{
+	msp_proxy_cache_t *ce;
+	msp_proxy_req_t *r;
+	uint8_t err[16];
+	bool cacheable = msp_proxy_readonly(f);
+	int i;
+
+	px->stat.requests++;
+
+	if (cacheable) {
+		ce = msp_proxy_cache_find(px, f->version, f->cmd);
+		if (ce && tstamp() - ce->time < px->ttl) {
+			px->stat.hits++;
+			msp_proxy_send(px, id, ce->frame, ce->len);
+			return;
+		}
+
+		/* the same request is waiting already, share its reply */
+		for (i = 0; i < px->count; i++) {
+			r = &px->queue[(px->head + i) % MSP_PROXY_QUEUE];
+			if (r->cacheable && r->version == f->version && r->cmd == f->cmd &&
+			    !(i == 0 && px->inflight)) {
+				r->waiters |= 1u << id;
+				px->stat.shared++;
+				return;
+			}
+		}
+	} else {
+		msp_proxy_cache_flush(px);
+	}
+
+	if (px->count == MSP_PROXY_QUEUE) {
+		msp_proxy_send(px, id, err, msp_proxy_error_frame(f->version, f->cmd, err));
+		return;
+	}
+
+	r = &px->queue[(px->head + px->count) % MSP_PROXY_QUEUE];
+	r->version = f->version;
+	r->cmd = f->cmd;
+	r->cacheable = cacheable;
+	r->waiters = 1u << id;
+	r->len = f->raw_len;
+	memcpy(r->frame, f->raw, f->raw_len);
+	px->count++;
+
+	msp_proxy_next(px);
+}
+
+static void msp_proxy_link_frame(msp_proxy_t *px, const msp_frame_t *f)
+{
+	msp_proxy_req_t *r = &px->queue[px->head];
+
+	if (f->dir == '<' || !px->inflight || r->version != f->version || r->cmd != f->cmd) {
+		px->stat.unmatched++;
+		return;
+	}
+
+	rtt_update(rtt_model(RTT_MSP), tstamp() - px->sent);
+
+	if (r->cacheable && f->dir == '>')
+		msp_proxy_cache_put(px, f);
+
+	msp_proxy_reply(px, r->waiters, f->raw, f->raw_len);
+	msp_proxy_done(px);
+}
+
+static void msp_proxy_timeout(msp_proxy_t *px)
+{
+	msp_proxy_req_t *r = &px->queue[px->head];
+	uint8_t err[16];
+
+	px->stat.timeouts++;
+	rtt_backoff(rtt_model(RTT_MSP));
+	msp_proxy_reply(px, r->waiters, err, msp_proxy_error_frame(r->version, r->cmd, err));
+	msp_proxy_done(px);
+}
+
+static int msp_proxy_read(msp_proxy_t *px, int fd, msp_parser_t *p, int id)
+{
+	const msp_frame_t *f;
+	uint8_t buf[4096];
+	ssize_t len;
+	int n, off = 0;
+
+	/* link is read through transport, what is there already */
+	if (id < 0) {
+		if ((len = transport_read(fd, buf, sizeof(buf))) < 0)
+			return -1;
+		if (len == 0)
+			return 1;
+	} else {
+		len = read(fd, buf, sizeof(buf));
+		if (len < 0)
+			return errno == EAGAIN || errno == EINTR ? 1 : -1;
+		if (len == 0)
+			return 0;
+	}
+
+	while (off < len) {
+		n = msp_parser_feed(p, buf + off, len - off, &f);
+		off += n;
+		if (!f)
+			continue;
+
+		if (id < 0)
+			msp_proxy_link_frame(px, f);
+		else if (f->dir == '<')
+			msp_proxy_request(px, id, f);
+
+		/* client may be dropped on reply */
+		if (id >= 0 && px->client[id].fd < 0)
+			return 1;
+	}
+	return 1;
+}
+
+static int msp_proxy_add(msp_proxy_t *px, int fd, uint32_t id)
+{
+	struct epoll_event e = {.events = EPOLLIN, .data.u32 = id};
+
+	return epoll_ctl(px->epfd, EPOLL_CTL_ADD, fd, &e);
+}
+
+static void msp_proxy_accept(msp_proxy_t *px, int lfd)
+{
+	msp_proxy_client_t *c;
+	int fd, id, on = 1;
+
+	fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK);
+	if (fd < 0)
+		return;
+
+	for (id = 0; id < MSP_PROXY_CLIENTS; id++) {
+		if (px->client[id].fd < 0)
+			break;
+	}
+
+	if (id == MSP_PROXY_CLIENTS) {
+		fprintf(stderr, "Too many clients\n");
+		close(fd);
+		return;
+	}
+
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+	c = &px->client[id];
+	msp_parser_init(&c->parser);
+	c->out_len = 0;
+	c->fd = fd;
+	if (msp_proxy_add(px, fd, id) < 0) {
+		close(fd);
+		c->fd = -1;
+	}
+}
+
+/* epoll ids of serial port and listening sockets */
+#define MSP_PROXY_ID_SERIAL		0x100
+#define MSP_PROXY_ID_LISTEN		0x200
+
+static int msp_proxy_listen(msp_proxy_t *px, const char *spec, int n)
+{
+	struct sockaddr_un un;
+	struct sockaddr_in in;
+	struct sockaddr *sa;
+	socklen_t len;
+	int fd, on = 1;
+
+	if (!strncmp(spec, "tcp:", 4)) {
+		memset(&in, 0, sizeof(in));
+		in.sin_family = AF_INET;
+		in.sin_port = htons(strtol(&spec[4], NULL, 0));
+		in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		sa = (struct sockaddr *)&in;
+		len = sizeof(in);
+		fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+		if (fd >= 0)
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	} else if (!strncmp(spec, "unix:", 5)) {
+		memset(&un, 0, sizeof(un));
+		un.sun_family = AF_UNIX;
+		snprintf(un.sun_path, sizeof(un.sun_path), "%s", &spec[5]);
+		snprintf(px->unix_path, sizeof(px->unix_path), "%s", &spec[5]);
+		unlink(un.sun_path);
+		sa = (struct sockaddr *)&un;
+		len = sizeof(un);
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	} else {
+		fprintf(stderr, "Invalid proxy address: %s, tcp:<port> or unix:<path>\n", spec);
+		return -1;
+	}
+
+	if (fd < 0 || bind(fd, sa, len) < 0 || listen(fd, MSP_PROXY_CLIENTS) < 0) {
+		fprintf(stderr, "Can't listen %s, %s\n", spec, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	px->listen[n] = fd;
+	printf("MSP proxy on %s\n", spec);
+	return msp_proxy_add(px, fd, MSP_PROXY_ID_LISTEN + n);
+}
+
+static int msp_proxy_loop(msp_proxy_t *px)
+{
+	struct epoll_event ev[MSP_PROXY_CLIENTS + MSP_PROXY_LISTEN + 1];
+	int i, n, timeout;
+	double left;
+
+	while (!msp_proxy_stop) {
+		timeout = -1;
+		if (px->inflight) {
+			left = rtt_model(RTT_MSP)->rto - (tstamp() - px->sent);
+			if (left <= 0) {
+				msp_proxy_timeout(px);
+				continue;
+			}
+			timeout = left * 1000 + 1;
+		}
+
+		n = epoll_wait(px->epfd, ev, sizeof(ev) / sizeof(ev[0]), timeout);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		for (i = 0; i < n; i++) {
+			uint32_t id = ev[i].data.u32;
+
+			if (id == MSP_PROXY_ID_SERIAL) {
+				if (ev[i].events & (EPOLLERR | EPOLLHUP) ||
+				    msp_proxy_read(px, px->serial, &px->link, -1) <= 0) {
+					fprintf(stderr, "Serial port closed\n");
+					return -1;
+				}
+			} else if (id >= MSP_PROXY_ID_LISTEN) {
+				msp_proxy_accept(px, px->listen[id - MSP_PROXY_ID_LISTEN]);
+			} else if (px->client[id].fd >= 0) {
+				if ((ev[i].events & EPOLLOUT) && msp_proxy_flush(px, id) < 0) {
+					msp_proxy_drop_client(px, id);
+					continue;
+				}
+				if ((ev[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) &&
+				    msp_proxy_read(px, px->client[id].fd,
+						   &px->client[id].parser, id) <= 0)
+					msp_proxy_drop_client(px, id);
+			}
+		}
+	}
+	return 0;
+}
+
+int msp_proxy_run(serial_handle fd, const char *spec, int ttl_ms)
+{
+	struct sigaction sa;
+	msp_proxy_t *px;
+	char list[256], *p, *next;
+	int i, n = 0, err = -1;
+
+	px = calloc(1, sizeof(msp_proxy_t));
+	if (!px)
+		return -1;
+
+	px->serial = fd;
+	px->ttl = ttl_ms / 1000.0;
+	for (i = 0; i < MSP_PROXY_CLIENTS; i++)
+		px->client[i].fd = -1;
+	for (i = 0; i < MSP_PROXY_LISTEN; i++)
+		px->listen[i] = -1;
+	msp_parser_init(&px->link);
+
+	px->epfd = epoll_create1(0);
+	if (px->epfd < 0)
+		goto out;
+
+	if (msp_proxy_add(px, transport_fd(fd), MSP_PROXY_ID_SERIAL) < 0)
+		goto out;
+	/* replies are read as they come, timeouts are kept by the loop */
+	transport_set_timeout(fd, 0);
+
+	/* tcp:<port>,unix:<path> */
+	snprintf(list, sizeof(list), "%s", spec);
+	for (p = list; p && *p; p = next) {
+		if ((next = strchr(p, ',')))
+			*next++ = '\0';
+		if (n == MSP_PROXY_LISTEN) {
+			fprintf(stderr, "Too many proxy addresses\n");
+			goto out;
+		}
+		if (msp_proxy_listen(px, p, n++) < 0)
+			goto out;
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = msp_proxy_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	printf("Press Ctrl-C to stop\n");
+	fflush(stdout);
+
+	err = msp_proxy_loop(px);
+
+	printf("\nRequests %lu, link transactions %lu, cache hits %lu, shared %lu, "
+	       "timeouts %lu, unmatched replies %lu, link errors %u\n",
+	       px->stat.requests, px->stat.transactions, px->stat.hits, px->stat.shared,
+	       px->stat.timeouts, px->stat.unmatched, px->link.errors);
+out:
+	for (i = 0; i < MSP_PROXY_CLIENTS; i++) {
+		if (px->client[i].fd >= 0)
+			close(px->client[i].fd);
+	}
+	for (i = 0; i < MSP_PROXY_LISTEN; i++) {
+		if (px->listen[i] >= 0)
+			close(px->listen[i]);
+	}
+	if (px->unix_path[0])
+		unlink(px->unix_path);
+	if (px->epfd >= 0)
+		close(px->epfd);
+	free(px);
+	return err;
+}
+
+#else
+
+int msp_proxy_run(serial_handle fd, const char *spec, int ttl_ms)
+{
+	fprintf(stderr, "proxy is supported on Linux only\n");
+	return -1;
+}
+
+#endif
@@ -0,0 +1,426 @@
+/*
+ * rc stream
+ *
+ * Stick input of bench and HIL runs is injected by MSP_SET_RAW_RC. Frames
+ * are sent at absolute tick times, link and input are polled until the
+ * next tick, replies are never waited for. Reply latency is taken from a
+ * ring of send times, FC answers in order. Input to send latency is the
+ * age of a new frame when it is sent first. Everything lives in fixed
+ * buffers, nothing is allocated while streaming, counters are 64 bit for
+ * runs of many hours.
+ *
+ * Linux only.
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "serial.h"
+#include "msp_rc.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "msp.h"
+#include "msp_protocol.h"
+#include "msp_serial.h"
+#include "msp_parser.h"
+#include "file_io.h"
+#include "transport.h"
+#include "tstamp.h"
+
+typedef struct msp_rc_stat {
+	uint64_t sent;
+	uint64_t overruns;
+	/* valid and invalid input lines */
+	uint64_t frames;
+	uint64_t invalid;
+	uint64_t acks;
+	uint64_t errors;
+	unsigned int failsafes;
+	/* input to send latency of new frames */
+	uint64_t lat_n;
+	double lat_sum;
+	double lat_max;
+	/* reply latency */
+	uint64_t rtt_n;
+	double rtt_sum;
+	double rtt_max;
+} msp_rc_stat_t;
+
+typedef struct msp_rc {
+	serial_handle fd;
+	int in;
+	/* regular file, one line per tick */
+	bool replay;
+	bool eof;
+	file_map_t map;
+	size_t map_off;
+	/* partial line of pipe */
+	char line[MSP_RC_LINE_MAX];
+	int line_len;
+	bool line_long;
+	/* latest frame */
+	uint16_t ch[MSP_RC_CHANNELS_MAX];
+	int chans;
+	/* arrival of latest frame, 0 when it is sent already */
+	double fresh;
+	double last_input;
+	/* send times of frames waiting for reply */
+	double sent_at[MSP_RC_INFLIGHT];
+	unsigned int head;
+	unsigned int tail;
+	msp_parser_t parser;
+	msp_rc_stat_t st;
+} msp_rc_t;
+
+static volatile sig_atomic_t msp_rc_stop;
+
+static void msp_rc_signal(int sig)
+{
+	msp_rc_stop = 1;
+}
+
+/*
+ * Channel values separated by comma, semicolon or spaces, return number
+ * of them, 0 for empty line or # comment, -1 if line is invalid
+ */
+static int msp_rc_parse(const char *s, int len, uint16_t *ch)
+{
+	uint32_t v;
+	int i = 0, n = 0;
+
+	while (i < len) {
+		if (s[i] == ' ' || s[i] == '\t' || s[i] == '\r' || s[i] == ',' || s[i] == ';') {
+			i++;
+			continue;
+		}
+		if (s[i] == '#')
+			break;
+		if (s[i] < '0' || s[i] > '9' || n == MSP_RC_CHANNELS_MAX)
+			return -1;
+
+		for (v = 0; i < len && s[i] >= '0' && s[i] <= '9' && v <= MSP_RC_VALUE_MAX; i++)
+			v = v * 10 + s[i] - '0';
+		if (v < MSP_RC_VALUE_MIN || v > MSP_RC_VALUE_MAX)
+			return -1;
+		ch[n++] = v;
+	}
+
+	return n && n < MSP_RC_CHANNELS_MIN ? -1 : n;
+}
+
+static int msp_rc_input(msp_rc_t *rc, const char *s, int len, double t)
+{
+	uint16_t ch[MSP_RC_CHANNELS_MAX];
+	int n;
+
+	if ((n = msp_rc_parse(s, len, ch)) <= 0) {
+		if (n < 0)
+			rc->st.invalid++;
+		return n;
+	}
+
+	memcpy(rc->ch, ch, n * sizeof(ch[0]));
+	rc->chans = n;
+	rc->fresh = t;
+	rc->last_input = t;
+	rc->st.frames++;
+	return n;
+}
+
+/* next frame of regular file */
+static void msp_rc_next(msp_rc_t *rc, double t)
+{
+	const char *p, *nl;
+	size_t len;
+
+	while (rc->map_off < rc->map.size) {
+		p = (const char *)rc->map.data + rc->map_off;
+		len = rc->map.size - rc->map_off;
+		if ((nl = memchr(p, '\n', len)))
+			len = nl - p;
+		rc->map_off += len + 1;
+
+		if (len < MSP_RC_LINE_MAX && msp_rc_input(rc, p, len, t) > 0)
+			return;
+	}
+	rc->eof = true;
+}
+
+/* lines of pipe as they come */
+static void msp_rc_read(msp_rc_t *rc, double t)
+{
+	char buf[512];
+	int i, len;
+
+	if ((len = read(rc->in, buf, sizeof(buf))) <= 0) {
+		if (!len || (errno != EAGAIN && errno != EINTR))
+			rc->eof = true;
+		return;
+	}
+
+	for (i = 0; i < len; i++) {
+		if (buf[i] != '\n') {
+			if (rc->line_len < MSP_RC_LINE_MAX)
+				rc->line[rc->line_len++] = buf[i];
+			else
+				rc->line_long = true;
+			continue;
+		}
+
+		if (rc->line_long)
+			rc->st.invalid++;
+		else
+			msp_rc_input(rc, rc->line, rc->line_len, t);
+		rc->line_len = 0;
+		rc->line_long = false;
+	}
+}
+
+static void msp_rc_replies(msp_rc_t *rc, double t)
+{
+	const msp_frame_t *f;
+	uint8_t buf[256];
+	int len, off, n;
+	double rtt;
+
+	if ((len = transport_read(rc->fd, buf, sizeof(buf))) <= 0)
+		return;
+
+	for (off = 0; off < len; off += n) {
+		n = msp_parser_feed(&rc->parser, buf + off, len - off, &f);
+		if (!f || f->cmd != MSP_SET_RAW_RC)
+			continue;
+
+		if (f->dir == '>')
+			rc->st.acks++;
+		else
+			rc->st.errors++;
+
+		if (rc->tail == rc->head)
+			continue;
+		rtt = t - rc->sent_at[rc->tail++ % MSP_RC_INFLIGHT];
+		rc->st.rtt_n++;
+		rc->st.rtt_sum += rtt;
+		if (rtt > rc->st.rtt_max)
+			rc->st.rtt_max = rtt;
+	}
+}
+
+static int msp_rc_send(msp_rc_t *rc, const uint16_t *ch, int chans, double t)
+{
+	uint8_t frame[3 + sizeof(mspHeaderV2_t) + MSP_RC_CHANNELS_MAX * 2 + 1];
+	int len;
+
+	len = msp_encode(frame, sizeof(frame), MSP_SET_RAW_RC, MSP_DIR_OUT, ch,
+			 chans * sizeof(ch[0]));
+	if (transport_write(rc->fd, frame, len) != len) {
+		fprintf(stderr, "Can't send rc frame\n");
+		return -1;
+	}
+
+	rc->st.sent++;
+	rc->sent_at[rc->head++ % MSP_RC_INFLIGHT] = t;
+	/* replies are lost, oldest send times are overwritten */
+	if (rc->head - rc->tail > MSP_RC_INFLIGHT)
+		rc->tail = rc->head - MSP_RC_INFLIGHT;
+	return 0;
+}
+
+/* sticks centered, throttle and aux low, AETR */
+static int msp_rc_failsafe(msp_rc_t *rc, double t)
+{
+	uint16_t ch[MSP_RC_CHANNELS_MAX];
+	int i;
+
+	for (i = 0; i < rc->chans; i++)
+		ch[i] = i < 4 && i != 2 ? 1500 : 1000;
+
+	return msp_rc_send(rc, ch, rc->chans, t);
+}
+
+static void msp_rc_stat_printf(const msp_rc_stat_t *st, double time)
+{
+	printf("RC frames %" PRIu64 " in %.1f s, %.1f Hz, overruns %" PRIu64
+	       ", input %" PRIu64 ", invalid %" PRIu64 ", failsafes %u\n",
+	       st->sent, time, time > 0 ? st->sent / time : 0, st->overruns,
+	       st->frames, st->invalid, st->failsafes);
+	printf("Input to send: mean %.2f ms, max %.2f ms\n",
+	       st->lat_n ? st->lat_sum / st->lat_n * 1000 : 0, st->lat_max * 1000);
+	printf("Reply: mean %.2f ms, max %.2f ms, replies %" PRIu64 ", errors %" PRIu64 "\n",
+	       st->rtt_n ? st->rtt_sum / st->rtt_n * 1000 : 0, st->rtt_max * 1000,
+	       st->acks, st->errors);
+	fflush(stdout);
+}
+
+static int msp_rc_loop(msp_rc_t *rc, int hz, int stall_ms)
+{
+	double t0, t, deadline, report, stall_start = 0, lat;
+	double period = 1.0 / hz, stall = stall_ms / 1000.0;
+	struct pollfd pfd[2];
+	struct timespec ts;
+	bool active, control = false;
+	uint64_t tick = 0, skip;
+	int n;
+
+	t0 = tstamp();
+	deadline = t0;
+	report = t0 + MSP_RC_REPORT_SEC;
+	rc->last_input = t0;
+	/* replies are read as they come */
+	transport_set_timeout(rc->fd, 0);
+
+	for (;;) {
+		t = tstamp();
+		if (t < deadline) {
+			pfd[0].fd = transport_fd(rc->fd);
+			pfd[0].events = POLLIN;
+			pfd[1].fd = rc->in;
+			pfd[1].events = POLLIN;
+			n = !rc->replay && !rc->eof ? 2 : 1;
+
+			ts.tv_sec = deadline - t;
+			ts.tv_nsec = (deadline - t - ts.tv_sec) * 1e9;
+			if (ppoll(pfd, n, &ts, NULL) <= 0)
+				continue;
+
+			t = tstamp();
+			if (pfd[0].revents & POLLIN)
+				msp_rc_replies(rc, t);
+			if (n > 1 && pfd[1].revents & (POLLIN | POLLHUP))
+				msp_rc_read(rc, t);
+			continue;
+		}
+
+		if (rc->replay && !rc->eof && !msp_rc_stop)
+			msp_rc_next(rc, t);
+
+		active = rc->chans && !msp_rc_stop && !rc->eof && t - rc->last_input <= stall;
+		if (active) {
+			if (stall_start)
+				fprintf(stderr, "RC input resumed\n");
+			stall_start = 0;
+			control = true;
+
+			if (msp_rc_send(rc, rc->ch, rc->chans, t) < 0)
+				return -1;
+			if (rc->fresh) {
+				lat = t - rc->fresh;
+				rc->st.lat_n++;
+				rc->st.lat_sum += lat;
+				if (lat > rc->st.lat_max)
+					rc->st.lat_max = lat;
+				rc->fresh = 0;
+			}
+		} else if (control) {
+			if (!stall_start) {
+				stall_start = t;
+				rc->st.failsafes++;
+				if (!msp_rc_stop && !rc->eof)
+					fprintf(stderr, "RC input stalled, failsafe\n");
+			}
+
+			if (t - stall_start < MSP_RC_RELEASE_MS / 1000.0) {
+				if (msp_rc_failsafe(rc, t) < 0)
+					return -1;
+			} else {
+				control = false;
+			}
+		}
+
+		if (!control && (msp_rc_stop || rc->eof))
+			return 0;
+
+		/* ticks which are due already are skipped, schedule stays */
+		tick++;
+		deadline = t0 + tick * period;
+		if (deadline <= t) {
+			skip = (t - t0) / period + 1 - tick;
+			rc->st.overruns += skip;
+			tick += skip;
+			deadline = t0 + tick * period;
+		}
+
+		if (t >= report) {
+			msp_rc_stat_printf(&rc->st, t - t0);
+			report += MSP_RC_REPORT_SEC;
+		}
+	}
+}
+
+int msp_rc_stream(serial_handle fd, const char *src, int hz, int stall_ms)
+{
+	struct sigaction sa, old_int, old_term;
+	static msp_rc_t rc;
+	struct stat st;
+	double t;
+	int err;
+
+	if (hz <= 0 || hz > MSP_RC_HZ_MAX || stall_ms <= 0) {
+		fprintf(stderr, "Invalid rate %d Hz, up to %d, or stall time %d ms\n",
+			hz, MSP_RC_HZ_MAX, stall_ms);
+		return -1;
+	}
+
+	memset(&rc, 0, sizeof(rc));
+	rc.fd = fd;
+	msp_parser_init(&rc.parser);
+
+	if (!strcmp(src, "-")) {
+		rc.in = STDIN_FILENO;
+	} else if (!stat(src, &st) && S_ISREG(st.st_mode)) {
+		if (file_map(src, &rc.map) < 0)
+			return -1;
+		rc.replay = true;
+		rc.in = -1;
+	} else if ((rc.in = open(src, O_RDONLY)) < 0) {
+		fprintf(stderr, "Can't open %s, %s\n", src, strerror(errno));
+		return -1;
+	}
+
+	msp_rc_stop = 0;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = msp_rc_signal;
+	sigaction(SIGINT, &sa, &old_int);
+	sigaction(SIGTERM, &sa, &old_term);
+
+	printf("RC stream at %d Hz, %s, failsafe after %d ms, Ctrl-C stops\n", hz,
+	       rc.replay ? "line per tick" : "latest line", stall_ms);
+	fflush(stdout);
+
+	t = tstamp();
+	err = msp_rc_loop(&rc, hz, stall_ms);
+	msp_rc_stat_printf(&rc.st, tstamp() - t);
+
+	sigaction(SIGINT, &old_int, NULL);
+	sigaction(SIGTERM, &old_term, NULL);
+
+	if (rc.replay)
+		file_unmap(&rc.map);
+	else if (rc.in != STDIN_FILENO)
+		close(rc.in);
+
+	return err;
+}
+
+#else
+
+int msp_rc_stream(serial_handle fd, const char *src, int hz, int stall_ms)
+{
+	fprintf(stderr, "rcstream is supported on Linux only\n");
+	return -1;
+}
+
+#endif
@@ -0,0 +1,289 @@
+/*
+ * msp configuration snapshot
+ *
+ * Binary backup of FC configuration without CLI: replies of configuration
+ * getters are stored as they come in tagged records, restore compares
+ * them with live FC and replays setters of sections which differ only.
+ *
+ * Only sections with setter which accepts reply of getter as is are in
+ * the table, tables of ranges are set one element at a time with index
+ * in front. VTX, OSD, blackbox and motor config setters take different
+ * layout than getters return, they are not in snapshot. PID and rates
+ * are of current profile.
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "msp.h"
+#include "msp_protocol.h"
+#include "msp_serial.h"
+#include "file_io.h"
+#include "msp_snapshot.h"
+
+#ifndef O_BINARY
+# define O_BINARY	0
+#endif
+
+typedef struct msp_snapshot_sect {
+	const char *name;
+	uint16_t get;
+	uint16_t set;
+	/* 0 setter takes whole reply, or size of element of table */
+	uint8_t elem;
+} msp_snapshot_sect_t;
+
+/* in restore order */
+static const msp_snapshot_sect_t msp_snapshot_sects[] = {
+	{"name", MSP_NAME, MSP_SET_NAME},
+	{"feature", MSP_FEATURE_CONFIG, MSP_SET_FEATURE_CONFIG},
+	{"mixer", MSP_MIXER_CONFIG, MSP_SET_MIXER_CONFIG},
+	{"motor_order", MSP2_MOTOR_OUTPUT_REORDERING, MSP2_SET_MOTOR_OUTPUT_REORDERING},
+	{"motor_3d", MSP_MOTOR_3D_CONFIG, MSP_SET_MOTOR_3D_CONFIG},
+	{"board_alignment", MSP_BOARD_ALIGNMENT_CONFIG, MSP_SET_BOARD_ALIGNMENT_CONFIG},
+	{"sensor", MSP_SENSOR_CONFIG, MSP_SET_SENSOR_CONFIG},
+	{"rx", MSP_RX_CONFIG, MSP_SET_RX_CONFIG},
+	{"rx_map", MSP_RX_MAP, MSP_SET_RX_MAP},
+	{"rssi", MSP_RSSI_CONFIG, MSP_SET_RSSI_CONFIG},
+	{"rc_deadband", MSP_RC_DEADBAND, MSP_SET_RC_DEADBAND},
+	{"rxfail", MSP_RXFAIL_CONFIG, MSP_SET_RXFAIL_CONFIG, 3},
+	{"failsafe", MSP_FAILSAFE_CONFIG, MSP_SET_FAILSAFE_CONFIG},
+	{"arming", MSP_ARMING_CONFIG, MSP_SET_ARMING_CONFIG},
+	{"mode_ranges", MSP_MODE_RANGES, MSP_SET_MODE_RANGE, 4},
+	{"adjustment_ranges", MSP_ADJUSTMENT_RANGES, MSP_SET_ADJUSTMENT_RANGE, 6},
+	{"battery", MSP_BATTERY_CONFIG, MSP_SET_BATTERY_CONFIG},
+	{"beeper", MSP_BEEPER_CONFIG, MSP_SET_BEEPER_CONFIG},
+	{"gps", MSP_GPS_CONFIG, MSP_SET_GPS_CONFIG},
+	{"compass", MSP_COMPASS_CONFIG, MSP_SET_COMPASS_CONFIG},
+	{"advanced", MSP_ADVANCED_CONFIG, MSP_SET_ADVANCED_CONFIG},
+	{"filter", MSP_FILTER_CONFIG, MSP_SET_FILTER_CONFIG},
+	{"pid_advanced", MSP_PID_ADVANCED, MSP_SET_PID_ADVANCED},
+	{"pid", MSP_PID, MSP_SET_PID},
+	{"rc_tuning", MSP_RC_TUNING, MSP_SET_RC_TUNING},
+	{NULL} /* last */
+};
+
+static const msp_snapshot_sect_t *msp_snapshot_sect(uint16_t cmd)
+{
+	const msp_snapshot_sect_t *s;
+
+	for (s = msp_snapshot_sects; s->name; s++) {
+		if (s->get == cmd)
+			return s;
+	}
+	return NULL;
+}
+
+static int msp_snapshot_get(serial_handle fd, uint16_t cmd, uint8_t *data, int size)
+{
+	return msp_transmit(fd, cmd, MSP_DIR_OUT, data, 0, data, size);
+}
+
+static int msp_snapshot_hdr(serial_handle fd, msp_snapshot_hdr_t *hdr)
+{
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->magic = MSP_SNAPSHOT_MAGIC;
+
+	if (msp_snapshot_get(fd, MSP_API_VERSION, hdr->api, sizeof(hdr->api)) != sizeof(hdr->api) ||
+	    msp_snapshot_get(fd, MSP_UID, hdr->uid, sizeof(hdr->uid)) != sizeof(hdr->uid)) {
+		fprintf(stderr, "Can't get FC API version and UID\n");
+		return -1;
+	}
+	return 0;
+}
+
+int msp_snapshot_save(serial_handle fd, const char *fname)
+{
+	const msp_snapshot_sect_t *s;
+	msp_snapshot_hdr_t hdr;
+	msp_snapshot_rec_t rec;
+	uint8_t data[MSP_SNAPSHOT_SECT_MAX];
+	int fl, len, num = 0, err = -1;
+
+	if (msp_snapshot_hdr(fd, &hdr) < 0)
+		return -1;
+	hdr.time = time(NULL);
+
+	fl = open(fname, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+	if (fl < 0) {
+		fprintf(stderr, "Can't create snapshot file %s, %s\n", fname, strerror(errno));
+		return -1;
+	}
+
+	if (write(fl, &hdr, sizeof(hdr)) != sizeof(hdr))
+		goto out;
+
+	for (s = msp_snapshot_sects; s->name; s++) {
+		len = msp_snapshot_get(fd, s->get, data, sizeof(data));
+		/* not supported by firmware */
+		if (len <= 0) {
+			printf("%-18s not available\n", s->name);
+			continue;
+		}
+
+		rec.cmd = s->get;
+		rec.size = len;
+		if (write(fl, &rec, sizeof(rec)) != sizeof(rec) || write(fl, data, len) != len)
+			goto out;
+
+		printf("%-18s %3d bytes\n", s->name, len);
+		num++;
+	}
+
+	printf("API %u.%u, %d sections saved to %s\n", hdr.api[1], hdr.api[2], num, fname);
+	err = 0;
+out:
+	if (err < 0)
+		fprintf(stderr, "Can't write snapshot file %s, %s\n", fname, strerror(errno));
+	close(fl);
+	return err;
+}
+
+/*
+ * Number of setters which make live section same as data
+ */
+static int msp_snapshot_diff(const msp_snapshot_sect_t *s, const uint8_t *data, int len,
+			     const uint8_t *live, int live_len)
+{
+	int i, num = 0;
+
+	if (!s->elem)
+		return len != live_len || memcmp(data, live, len);
+
+	for (i = 0; i + s->elem <= len; i += s->elem) {
+		if (i + s->elem > live_len || memcmp(&data[i], &live[i], s->elem))
+			num++;
+	}
+	return num;
+}
+
+/*
+ * Write section, whole or elements of table which differ from live one,
+ * return number of setters sent
+ */
+static int msp_snapshot_put(serial_handle fd, const msp_snapshot_sect_t *s,
+			    const uint8_t *data, int len, const uint8_t *live, int live_len,
+			    bool dry)
+{
+	uint8_t buf[MSP_SNAPSHOT_SECT_MAX + 1];
+	int i, num = 0;
+
+	if (!s->elem) {
+		if (!msp_snapshot_diff(s, data, len, live, live_len))
+			return 0;
+		if (!dry && msp_transmit(fd, s->set, MSP_DIR_OUT, data, len, buf, sizeof(buf)) < 0)
+			return -1;
+		return 1;
+	}
+
+	for (i = 0; i + s->elem <= len; i += s->elem) {
+		if (i + s->elem <= live_len && !memcmp(&data[i], &live[i], s->elem))
+			continue;
+
+		buf[0] = i / s->elem;
+		memcpy(&buf[1], &data[i], s->elem);
+		if (!dry && msp_transmit(fd, s->set, MSP_DIR_OUT, buf, s->elem + 1,
+					 buf, sizeof(buf)) < 0)
+			return -1;
+		num++;
+	}
+	return num;
+}
+
+int msp_snapshot_restore(serial_handle fd, const char *fname, bool dry, bool force)
+{
+	const msp_snapshot_sect_t *s;
+	const msp_snapshot_hdr_t *hdr;
+	const msp_snapshot_rec_t *rec;
+	msp_snapshot_hdr_t live_hdr;
+	uint8_t live[MSP_SNAPSHOT_SECT_MAX];
+	file_map_t map;
+	size_t offt;
+	int n, diff, live_len, num = 0, err = -1;
+
+	if (file_map(fname, &map) < 0) {
+		fprintf(stderr, "Can't read snapshot file %s, %s\n", fname, strerror(errno));
+		return -1;
+	}
+
+	hdr = (const msp_snapshot_hdr_t *)map.data;
+	if (map.size < sizeof(*hdr) || hdr->magic != MSP_SNAPSHOT_MAGIC) {
+		fprintf(stderr, "%s is not a snapshot file\n", fname);
+		goto out;
+	}
+
+	if (msp_snapshot_hdr(fd, &live_hdr) < 0)
+		goto out;
+
+	/* layout of replies is of API version */
+	if (memcmp(hdr->api, live_hdr.api, sizeof(hdr->api)) && !force) {
+		fprintf(stderr, "Snapshot is of API %u.%u, FC is %u.%u, use -f to restore anyway\n",
+			hdr->api[1], hdr->api[2], live_hdr.api[1], live_hdr.api[2]);
+		goto out;
+	}
+	if (memcmp(hdr->uid, live_hdr.uid, sizeof(hdr->uid)))
+		printf("Snapshot is of another FC\n");
+
+	for (offt = sizeof(*hdr); offt + sizeof(*rec) <= map.size; offt += sizeof(*rec) + rec->size) {
+		rec = (const msp_snapshot_rec_t *)&map.data[offt];
+		if (offt + sizeof(*rec) + rec->size > map.size) {
+			fprintf(stderr, "Snapshot file %s is truncated\n", fname);
+			goto out;
+		}
+
+		if (!(s = msp_snapshot_sect(rec->cmd)) || rec->size > MSP_SNAPSHOT_SECT_MAX) {
+			printf("Unknown section %u skipped\n", rec->cmd);
+			continue;
+		}
+
+		if ((live_len = msp_snapshot_get(fd, s->get, live, sizeof(live))) < 0) {
+			fprintf(stderr, "Can't get %s from FC\n", s->name);
+			goto out;
+		}
+
+		n = msp_snapshot_put(fd, s, &map.data[offt + sizeof(*rec)], rec->size,
+				     live, live_len, dry);
+		if (n < 0) {
+			fprintf(stderr, "Can't set %s\n", s->name);
+			goto out;
+		}
+
+		/* FC replies to setter it rejects too, only read back tells */
+		if (n && !dry) {
+			if ((live_len = msp_snapshot_get(fd, s->get, live, sizeof(live))) < 0) {
+				fprintf(stderr, "Can't get %s from FC\n", s->name);
+				goto out;
+			}
+			if ((diff = msp_snapshot_diff(s, &map.data[offt + sizeof(*rec)],
+						      rec->size, live, live_len))) {
+				fprintf(stderr, "%s is not accepted by FC, %d setters differ, "
+					"configuration is not saved\n", s->name, diff);
+				goto out;
+			}
+		}
+
+		if (!n)
+			printf("%-18s same\n", s->name);
+		else if (s->elem)
+			printf("%-18s %d of %d %s\n", s->name, n, rec->size / s->elem,
+			       dry ? "differ" : "written");
+		else
+			printf("%-18s %s\n", s->name, dry ? "differs" : "written");
+
+		if (n)
+			num++;
+	}
+	err = num;
+out:
+	file_unmap(&map);
+	return err;
+}
@@ -0,0 +1,208 @@
+/*
+ * motor sweep
+ *
+ * Throttle to RPM, current and temperature curves in one run. Steps start
+ * at fixed times from the beginning of sweep, so a slow link shortens
+ * sampling, not the schedule. Statistics are updated with every sample,
+ * mean and deviation of RPM by Welford's method, nothing is stored.
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <math.h>
+
+#include "bf.h"
+#include "emit.h"
+#include "msp_sweep.h"
+#include "tstamp.h"
+
+typedef struct msp_sweep_stat {
+	unsigned int n;
+	/* running mean and sum of squared deviations */
+	double rpm;
+	double rpm_m2;
+	uint32_t rpm_min;
+	uint32_t rpm_max;
+	/* running means, A and V */
+	double current;
+	double voltage;
+	uint8_t temp_max;
+} msp_sweep_stat_t;
+
+static volatile sig_atomic_t msp_sweep_stop;
+
+static void msp_sweep_signal(int sig)
+{
+	msp_sweep_stop = 1;
+}
+
+static void msp_sweep_add(msp_sweep_stat_t *st, const motor_tlm_t *tlm)
+{
+	double d;
+
+	st->n++;
+	d = tlm->rpm - st->rpm;
+	st->rpm += d / st->n;
+	st->rpm_m2 += d * (tlm->rpm - st->rpm);
+
+	if (st->n == 1 || tlm->rpm < st->rpm_min)
+		st->rpm_min = tlm->rpm;
+	if (tlm->rpm > st->rpm_max)
+		st->rpm_max = tlm->rpm;
+
+	st->current += (tlm->esc_current * 0.01 - st->current) / st->n;
+	st->voltage += (tlm->esc_voltage * 0.01 - st->voltage) / st->n;
+
+	if (tlm->esc_temperature > st->temp_max)
+		st->temp_max = tlm->esc_temperature;
+}
+
+static double msp_sweep_rpm_sd(const msp_sweep_stat_t *st)
+{
+	return st->n > 1 ? sqrt(st->rpm_m2 / (st->n - 1)) : 0;
+}
+
+static void msp_sweep_row(int value, unsigned int samples, const bool *motors, int num,
+			  const msp_sweep_stat_t *st)
+{
+	bool first = true;
+	int i;
+
+	if (emit_format() != EMIT_TEXT) {
+		emit_map(NULL);
+		emit_int("value", value);
+		emit_int("samples", samples);
+		emit_array("motors");
+		for (i = 0; i < num; i++) {
+			if (!motors[i])
+				continue;
+			emit_map(NULL);
+			emit_int("motor", i);
+			emit_float("rpm", st[i].rpm);
+			emit_float("rpm_sd", msp_sweep_rpm_sd(&st[i]));
+			emit_int("rpm_min", st[i].rpm_min);
+			emit_int("rpm_max", st[i].rpm_max);
+			emit_float("current", st[i].current);
+			emit_float("voltage", st[i].voltage);
+			emit_int("temperature", st[i].temp_max);
+			emit_end();
+		}
+		emit_end();
+		emit_end();
+		return;
+	}
+
+	for (i = 0; i < num; i++) {
+		if (!motors[i])
+			continue;
+		if (first)
+			printf("%5d  %7u", value, samples);
+		else
+			printf("%5s  %7s", "", "");
+		printf("  %5d  %7.0f  %6.0f  %7u  %7u  %9.2f  %9.2f  %6u\n", i,
+		       st[i].rpm, msp_sweep_rpm_sd(&st[i]), st[i].rpm_min, st[i].rpm_max,
+		       st[i].current, st[i].voltage, st[i].temp_max);
+		first = false;
+	}
+	fflush(stdout);
+}
+
+int msp_sweep_run(serial_handle fd, const bool *motors, int num, int from, int to,
+		  int step, int dwell_ms)
+{
+	msp_sweep_stat_t st[BF_MOTOR_MAX_NUM];
+	motor_tlm_t tlm[BF_MOTOR_MAX_NUM];
+	int val[BF_MOTOR_MAX_NUM];
+	unsigned int samples, errors = 0;
+	double t0, dwell, settle, end;
+	int i, k, n, steps, value;
+	void (*sig)(int);
+	int err = 0;
+
+	if (from < 0 || from > MSP_SWEEP_VALUE_MAX || to < 0 || to > MSP_SWEEP_VALUE_MAX ||
+	    step <= 0 || dwell_ms <= 0) {
+		fprintf(stderr, "Invalid sweep from %d to %d step %d dwell %d ms, "
+			"values up to %d\n", from, to, step, dwell_ms, MSP_SWEEP_VALUE_MAX);
+		return -1;
+	}
+
+	steps = abs(to - from) / step + 1;
+	if (steps > MSP_SWEEP_STEPS_MAX) {
+		fprintf(stderr, "Too many steps %d, up to %d\n", steps, MSP_SWEEP_STEPS_MAX);
+		return -1;
+	}
+
+	if (num > BF_MOTOR_MAX_NUM)
+		num = BF_MOTOR_MAX_NUM;
+
+	msp_sweep_stop = 0;
+	sig = signal(SIGINT, msp_sweep_signal);
+
+	if (emit_format() == EMIT_TEXT) {
+		printf("Sweep %d steps of %d ms, Ctrl-C stops motors\n", steps, dwell_ms);
+		printf("Value  Samples  Motor      RPM  RPM sd  RPM min  RPM max  "
+		       "Current A  Voltage V  Temp C\n");
+	}
+
+	dwell = dwell_ms / 1000.0;
+	t0 = tstamp();
+
+	for (k = 0; k < steps && !msp_sweep_stop; k++) {
+		value = to >= from ? from + k * step : from - k * step;
+		for (i = 0; i < num; i++)
+			val[i] = motors[i] ? value : 0;
+
+		if (bf_set_motor(fd, num, val) < 0) {
+			fprintf(stderr, "Can't set motors to %d\n", value);
+			err = -1;
+			break;
+		}
+
+		settle = t0 + k * dwell + dwell / MSP_SWEEP_SETTLE_DIV;
+		end = t0 + (k + 1) * dwell;
+		memset(st, 0, sizeof(st));
+		samples = 0;
+
+		while (tstamp() < end && !msp_sweep_stop) {
+			n = BF_MOTOR_MAX_NUM;
+			if (bf_get_motor_telemetry(fd, &n, tlm) < 0) {
+				errors++;
+				continue;
+			}
+			if (tstamp() < settle)
+				continue;
+
+			samples++;
+			for (i = 0; i < n && i < num; i++) {
+				if (motors[i])
+					msp_sweep_add(&st[i], &tlm[i]);
+			}
+		}
+
+		msp_sweep_row(value, samples, motors, num, st);
+	}
+
+	/* motors off whatever happened */
+	memset(val, 0, sizeof(val));
+	if (bf_set_motor(fd, num, val) < 0) {
+		fprintf(stderr, "Can't stop motors\n");
+		err = -1;
+	}
+
+	signal(SIGINT, sig);
+
+	if (msp_sweep_stop) {
+		fprintf(stderr, "Sweep stopped after %d of %d steps\n", k, steps);
+		err = -1;
+	}
+	if (errors)
+		fprintf(stderr, "Telemetry errors: %u\n", errors);
+
+	return err;
+}
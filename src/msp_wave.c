@@ -0,0 +1,337 @@
+/*
+ * motor waveform
+ *
+ * Step response and resonance tests replay a throttle waveform to
+ * MSP_SET_MOTOR. Waveform is loaded and checked before the first frame,
+ * frames are sent at absolute times of CLOCK_MONOTONIC by
+ * clock_nanosleep(TIMER_ABSTIME), so the error does not accumulate.
+ * Replies are not waited for, they are drained between ticks and
+ * counted. Tick which is late by a whole period is skipped, the rest of
+ * waveform stays in time.
+ *
+ * Linux only.
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "serial.h"
+#include "msp_wave.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bf.h"
+#include "msp.h"
+#include "msp_protocol.h"
+#include "msp_serial.h"
+#include "msp_parser.h"
+#include "file_io.h"
+#include "transport.h"
+#include "rtt.h"
+
+/* $X< header, values and crc */
+#define MSP_WAVE_FRAME_SIZE	(3 + sizeof(mspHeaderV2_t) + BF_MOTOR_MAX_NUM * 2 + 1)
+
+typedef struct msp_wave {
+	int ticks;
+	int motors;
+	/* ticks rows of motors values */
+	uint16_t *val;
+} msp_wave_t;
+
+typedef struct msp_wave_stat {
+	unsigned int sent;
+	unsigned int overruns;
+	unsigned int acks;
+	unsigned int errors;
+	/* lateness of send to schedule, seconds */
+	double late_sum;
+	double late_sum2;
+	double late_max;
+} msp_wave_stat_t;
+
+static volatile sig_atomic_t msp_wave_stop;
+
+static void msp_wave_signal(int sig)
+{
+	msp_wave_stop = 1;
+}
+
+static int msp_wave_check(const msp_wave_t *w)
+{
+	int i;
+
+	for (i = 0; i < w->ticks * w->motors; i++) {
+		if (w->val[i] > MSP_WAVE_VALUE_MAX) {
+			fprintf(stderr, "Value %u of tick %d is out of range, up to %d\n",
+				w->val[i], i / w->motors, MSP_WAVE_VALUE_MAX);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int msp_wave_load_bin(msp_wave_t *w, const file_map_t *map)
+{
+	size_t row = w->motors * sizeof(uint16_t);
+
+	if (map->size % row) {
+		fprintf(stderr, "Size %zu is not a multiple of %d motors row\n",
+			map->size, w->motors);
+		return -1;
+	}
+
+	w->ticks = map->size / row;
+	if (w->ticks > MSP_WAVE_TICKS_MAX)
+		return w->ticks;
+
+	if (!(w->val = malloc(map->size)))
+		return -1;
+	memcpy(w->val, map->data, map->size);
+
+	return w->ticks;
+}
+
+/*
+ * Values separated by comma, semicolon or spaces, missing values are 0,
+ * empty lines and # comments are skipped
+ */
+static int msp_wave_load_csv(msp_wave_t *w, const file_map_t *map)
+{
+	const uint8_t *p = map->data, *end = p + map->size;
+	int line = 1, lines = 1, col;
+	uint16_t *row;
+	uint32_t v;
+	size_t i;
+
+	for (i = 0; i < map->size; i++)
+		lines += map->data[i] == '\n';
+
+	if (!(w->val = calloc(lines, w->motors * sizeof(uint16_t))))
+		return -1;
+
+	for (; p < end; line++) {
+		row = &w->val[w->ticks * w->motors];
+		col = 0;
+
+		while (p < end && *p != '\n') {
+			if (*p == ' ' || *p == '\t' || *p == '\r' || *p == ',' || *p == ';') {
+				p++;
+				continue;
+			}
+			if (*p == '#') {
+				while (p < end && *p != '\n')
+					p++;
+				break;
+			}
+			if (*p < '0' || *p > '9' || col == w->motors) {
+				fprintf(stderr, "Invalid line %d, up to %d numbers expected\n",
+					line, w->motors);
+				return -1;
+			}
+			for (v = 0; p < end && *p >= '0' && *p <= '9' && v <= UINT16_MAX; p++)
+				v = v * 10 + *p - '0';
+			row[col++] = v > UINT16_MAX ? UINT16_MAX : v;
+		}
+		if (p < end)
+			p++;
+
+		if (col && ++w->ticks > MSP_WAVE_TICKS_MAX)
+			break;
+	}
+
+	return w->ticks;
+}
+
+/*
+ * Count replies which are in already, or wait up to ms for them
+ */
+static void msp_wave_drain(serial_handle fd, msp_parser_t *parser, msp_wave_stat_t *st,
+			   int ms)
+{
+	const msp_frame_t *f;
+	uint8_t buf[256];
+	int len, off, n;
+
+	while (transport_poll(fd, ms / 1000.0) > 0) {
+		if ((len = transport_read(fd, buf, sizeof(buf))) <= 0)
+			break;
+
+		for (off = 0; off < len; off += n) {
+			n = msp_parser_feed(parser, buf + off, len - off, &f);
+			if (!f)
+				continue;
+			if (f->dir == '>')
+				st->acks++;
+			else
+				st->errors++;
+		}
+	}
+}
+
+static void msp_wave_stat_printf(const msp_wave_stat_t *st, const msp_wave_t *w, int hz)
+{
+	double mean = 0, var = 0;
+
+	if (st->sent) {
+		mean = st->late_sum / st->sent;
+		var = st->late_sum2 / st->sent - mean * mean;
+	}
+
+	printf("Ticks %u of %d at %d Hz, overruns %u, replies %u, errors %u\n",
+	       st->sent, w->ticks, hz, st->overruns, st->acks, st->errors);
+	printf("Send late: mean %.1f us, jitter %.1f us, max %.1f us\n",
+	       mean * 1e6, sqrt(var > 0 ? var : 0) * 1e6, st->late_max * 1e6);
+}
+
+static int msp_wave_stream(serial_handle fd, const msp_wave_t *w, int hz, msp_wave_stat_t *st)
+{
+	uint8_t frame[MSP_WAVE_FRAME_SIZE];
+	struct timespec ts, now;
+	msp_parser_t parser;
+	int64_t t0, deadline, period;
+	double late;
+	int i, len;
+
+	msp_parser_init(&parser);
+	period = 1000000000LL / hz;
+	/* replies are read as they come */
+	transport_set_timeout(fd, 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t0 = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+
+	for (i = 0; i < w->ticks && !msp_wave_stop; i++) {
+		deadline = t0 + i * period;
+		ts.tv_sec = deadline / 1000000000LL;
+		ts.tv_nsec = deadline % 1000000000LL;
+
+		if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+			/* signal, sleep again if it is not ours */
+			i--;
+			continue;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		late = (now.tv_sec * 1000000000LL + now.tv_nsec - deadline) * 1e-9;
+		if (late * hz >= 1 && i + 1 < w->ticks) {
+			st->overruns++;
+			continue;
+		}
+
+		len = msp_encode(frame, sizeof(frame), MSP_SET_MOTOR, MSP_DIR_OUT,
+				 &w->val[i * w->motors], w->motors * sizeof(uint16_t));
+		if (transport_write(fd, frame, len) != len) {
+			fprintf(stderr, "Can't send tick %d\n", i);
+			return -1;
+		}
+
+		st->sent++;
+		st->late_sum += late;
+		st->late_sum2 += late * late;
+		if (late > st->late_max)
+			st->late_max = late;
+
+		msp_wave_drain(fd, &parser, st, 0);
+	}
+
+	/* replies of last ticks, so they are not taken for reply of stop */
+	msp_wave_drain(fd, &parser, st, rtt_model(RTT_MSP)->rto * 1000);
+	return 0;
+}
+
+int msp_wave_run(serial_handle fd, const char *fname, int hz, int motors)
+{
+	int val[BF_MOTOR_MAX_NUM] = {0};
+	struct sigaction sa, old_int, old_term;
+	msp_wave_stat_t st = {0};
+	msp_wave_t w = {0};
+	file_map_t map;
+	size_t len;
+	int err = -1;
+
+	if (hz <= 0 || hz > MSP_WAVE_HZ_MAX) {
+		fprintf(stderr, "Invalid rate %d Hz, up to %d\n", hz, MSP_WAVE_HZ_MAX);
+		return -1;
+	}
+
+	if (motors <= 0 || motors > BF_MOTOR_MAX_NUM)
+		motors = BF_MOTOR_MAX_NUM;
+	w.motors = motors;
+
+	if (file_map(fname, &map) < 0)
+		return -1;
+
+	len = strlen(fname);
+	if (len > 4 && !strcmp(&fname[len - 4], ".bin"))
+		err = msp_wave_load_bin(&w, &map);
+	else
+		err = msp_wave_load_csv(&w, &map);
+	file_unmap(&map);
+
+	if (err < 0)
+		goto out;
+	err = -1;
+
+	if (!w.ticks) {
+		fprintf(stderr, "Waveform %s is empty\n", fname);
+		goto out;
+	}
+	if (w.ticks > MSP_WAVE_TICKS_MAX) {
+		fprintf(stderr, "Waveform %s is too long, up to %d ticks\n", fname,
+			MSP_WAVE_TICKS_MAX);
+		goto out;
+	}
+	if (msp_wave_check(&w) < 0)
+		goto out;
+
+	msp_wave_stop = 0;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = msp_wave_signal;
+	sigaction(SIGINT, &sa, &old_int);
+	sigaction(SIGTERM, &sa, &old_term);
+
+	printf("Waveform %d ticks of %d motors, %.2f s, Ctrl-C stops motors\n",
+	       w.ticks, w.motors, (double)w.ticks / hz);
+	fflush(stdout);
+
+	err = msp_wave_stream(fd, &w, hz, &st);
+
+	/* motors off whatever happened, once more if FC missed it */
+	if (bf_set_motor(fd, w.motors, val) < 0 && bf_set_motor(fd, w.motors, val) < 0) {
+		fprintf(stderr, "Can't stop motors\n");
+		err = -1;
+	}
+
+	sigaction(SIGINT, &old_int, NULL);
+	sigaction(SIGTERM, &old_term, NULL);
+
+	msp_wave_stat_printf(&st, &w, hz);
+	if (msp_wave_stop) {
+		fprintf(stderr, "Waveform stopped\n");
+		err = -1;
+	}
+out:
+	free(w.val);
+	return err;
+}
+
+#else
+
+int msp_wave_run(serial_handle fd, const char *fname, int hz, int motors)
+{
+	fprintf(stderr, "waveform is supported on Linux only\n");
+	return -1;
+}
+
+#endif
@@ -0,0 +1,60 @@
+/*
+ * progress meter
+ *
+ * Console output is slow compared to the serial link, so lines are printed
+ * not more often than PROGRESS_INTERVAL.
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#include <stdio.h>
+
+#include "progress.h"
+#include "tstamp.h"
+
+void progress_start(progress_t *pr, unsigned int total, unsigned int base)
+{
+	pr->total = total;
+	pr->base = base;
+	pr->start = tstamp();
+	pr->last = 0;
+}
+
+static void progress_print(progress_t *pr, unsigned int done, double now)
+{
+	double elapsed = now - pr->start;
+	double rate = 0, eta = 0;
+	unsigned int pct = 100;
+
+	if (elapsed > 0)
+		rate = done / elapsed;
+
+	if (rate > 0 && pr->total > done)
+		eta = (pr->total - done) / rate;
+
+	if (pr->total)
+		pct = (unsigned long long)done * 100 / pr->total;
+
+	printf("Progress %3u%%\taddr: %u\t%.1f KiB/s\tETA %.1fs  \r",
+			pct, pr->base + done, rate / 1024, eta);
+	fflush(stdout);
+	pr->last = now;
+}
+
+void progress_update(progress_t *pr, unsigned int done)
+{
+	double now = tstamp();
+
+	if (now - pr->last < PROGRESS_INTERVAL)
+		return;
+
+	progress_print(pr, done, now);
+}
+
+void progress_done(progress_t *pr, unsigned int done)
+{
+	double now = tstamp();
+
+	progress_print(pr, done, now);
+	printf("\nDone %u bytes in %.2fs\n", done, now - pr->start);
+}
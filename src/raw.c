@@ -0,0 +1,290 @@
+/*
+ * raw serial transfer
+ *
+ * Sends bytes given on command line ("0x24;0x4d 60" style), a file
+ * (@file) or stdin (@-) and prints received data with timestamps.
+ * Transmit and receive run at the same time from one poll loop, so the
+ * link is used at full rate in both directions.
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#ifndef __MINGW32__
+#include <poll.h>
+#endif
+
+#include "serial.h"
+#include "transport.h"
+#include "file_io.h"
+#include "tstamp.h"
+#include "raw.h"
+
+/* received bytes per output line */
+#define RAW_LINE_BYTES		32
+
+typedef struct raw {
+	serial_handle fd;
+	/* data to transmit */
+	const uint8_t *tx;
+	size_t tx_len;
+	size_t tx_pos;
+	/* stdin is read to buf, -1 if not used */
+	int in;
+	file_map_t map;
+	uint8_t *buf;
+	uint8_t *rx;
+	double start;
+	unsigned long tx_total;
+	unsigned long rx_total;
+} raw_t;
+
+/*
+ * Bytes delimited by ';', ',' or space, each is decimal, 0x hex or 0 octal
+ */
+static int raw_parse(const char *arg, uint8_t *buf, int len)
+{
+	const char *p = arg;
+	char *end;
+	long val;
+	int n = 0;
+
+	while (*p) {
+		if (*p == ';' || *p == ',' || *p == ' ') {
+			p++;
+			continue;
+		}
+
+		val = strtol(p, &end, 0);
+		if (end == p || val < 0 || val > 255 ||
+		    (*end && *end != ';' && *end != ',' && *end != ' ')) {
+			fprintf(stderr, "Invalid byte in raw data: %s\n", p);
+			return -1;
+		}
+		if (n == len) {
+			fprintf(stderr, "Too many raw bytes, maximum is %d\n", len);
+			return -1;
+		}
+		buf[n++] = val;
+		p = end;
+	}
+	return n;
+}
+
+static void raw_rx_printf(raw_t *raw, const uint8_t *data, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if (i % RAW_LINE_BYTES == 0) {
+			if (i)
+				printf("\n");
+			if (i == 0)
+				printf("%11.6f rx %5d:", tstamp() - raw->start, len);
+			else
+				printf("%23s", "");
+		}
+		printf(" %02x", data[i]);
+	}
+	printf("\n");
+	raw->rx_total += len;
+}
+
+static void raw_totals(raw_t *raw)
+{
+	double t = tstamp() - raw->start;
+
+	fprintf(stderr, "tx %lu bytes, rx %lu bytes in %.3fs, %.1f/%.1f KiB/s\n",
+		raw->tx_total, raw->rx_total, t,
+		t > 0 ? raw->tx_total / t / 1024 : 0,
+		t > 0 ? raw->rx_total / t / 1024 : 0);
+}
+
+#ifndef __MINGW32__
+/*
+ * Refill transmit buffer from stdin, return 0 on end of input
+ */
+static int raw_stdin(raw_t *raw)
+{
+	ssize_t n;
+
+	n = read(raw->in, raw->buf + raw->tx_len, RAW_BUF_SIZE - raw->tx_len);
+	if (n < 0)
+		return errno == EINTR || errno == EAGAIN ? 1 : -1;
+	if (n == 0)
+		return 0;
+
+	raw->tx_len += n;
+	return 1;
+}
+
+static int raw_loop(raw_t *raw, int wait_ms)
+{
+	struct pollfd pfd[2];
+	double last = tstamp();
+	int npfd, timeout;
+	ssize_t n;
+
+	fcntl(raw->fd, F_SETFL, fcntl(raw->fd, F_GETFL) | O_NONBLOCK);
+
+	for (;;) {
+		bool tx_pending;
+
+		/* buffer is sent, stdin refills it from the start */
+		if (raw->in >= 0 && raw->tx_pos == raw->tx_len)
+			raw->tx_pos = raw->tx_len = 0;
+		tx_pending = raw->tx_pos < raw->tx_len;
+
+		pfd[0].fd = raw->fd;
+		pfd[0].events = POLLIN | (tx_pending ? POLLOUT : 0);
+		pfd[0].revents = 0;
+		npfd = 1;
+
+		if (raw->in >= 0 && raw->tx_len < RAW_BUF_SIZE) {
+			pfd[1].fd = raw->in;
+			pfd[1].events = POLLIN;
+			pfd[1].revents = 0;
+			npfd = 2;
+		}
+
+		/* wait for replies once everything is sent */
+		if (tx_pending || raw->in >= 0) {
+			timeout = -1;
+		} else {
+			timeout = wait_ms - (int)((tstamp() - last) * 1000);
+			if (timeout <= 0)
+				break;
+		}
+
+		if (poll(pfd, npfd, timeout) < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "poll error, %s\n", strerror(errno));
+			return -1;
+		}
+
+		if (pfd[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+			fprintf(stderr, "serial port error\n");
+			return -1;
+		}
+
+		if (pfd[0].revents & POLLIN) {
+			n = read(raw->fd, raw->rx, RAW_BUF_SIZE);
+			if (n > 0) {
+				raw_rx_printf(raw, raw->rx, n);
+				last = tstamp();
+			}
+		}
+
+		if (pfd[0].revents & POLLOUT) {
+			n = write(raw->fd, raw->tx + raw->tx_pos, raw->tx_len - raw->tx_pos);
+			if (n < 0 && errno != EAGAIN && errno != EINTR) {
+				fprintf(stderr, "serial write error, %s\n", strerror(errno));
+				return -1;
+			}
+			if (n > 0) {
+				raw->tx_pos += n;
+				raw->tx_total += n;
+				last = tstamp();
+			}
+		}
+
+		if (npfd == 2 && (pfd[1].revents & (POLLIN | POLLHUP))) {
+			int err = raw_stdin(raw);
+
+			if (err < 0) {
+				fprintf(stderr, "stdin read error, %s\n", strerror(errno));
+				return -1;
+			}
+			if (err == 0)
+				raw->in = -1;
+		}
+	}
+	return 0;
+}
+#else
+/*
+ * No poll for serial handles, send everything then read replies
+ */
+static int raw_loop(raw_t *raw, int wait_ms)
+{
+	int n;
+
+	for (;;) {
+		while (raw->tx_pos < raw->tx_len) {
+			n = transport_write(raw->fd, raw->tx + raw->tx_pos, raw->tx_len - raw->tx_pos);
+			if (n < 0) {
+				fprintf(stderr, "serial write error\n");
+				return -1;
+			}
+			raw->tx_pos += n;
+			raw->tx_total += n;
+		}
+
+		if (raw->in < 0)
+			break;
+
+		n = read(raw->in, raw->buf, RAW_BUF_SIZE);
+		if (n <= 0)
+			break;
+		raw->tx_pos = 0;
+		raw->tx_len = n;
+	}
+
+	transport_set_timeout(raw->fd, wait_ms / 1000.0);
+	while ((n = transport_read(raw->fd, raw->rx, RAW_BUF_SIZE)) > 0)
+		raw_rx_printf(raw, raw->rx, n);
+
+	return 0;
+}
+#endif
+
+int raw_run(serial_handle fd, const char *arg, int wait_ms)
+{
+	raw_t raw;
+	int n, err;
+
+	memset(&raw, 0, sizeof(raw));
+	raw.fd = fd;
+	raw.in = -1;
+
+	raw.buf = malloc(RAW_BUF_SIZE);
+	raw.rx = malloc(RAW_BUF_SIZE);
+	if (!raw.buf || !raw.rx) {
+		err = -1;
+		goto out;
+	}
+
+	if (!strcmp(arg, "@-")) {
+		raw.in = STDIN_FILENO;
+		raw.tx = raw.buf;
+	} else if (arg[0] == '@') {
+		if ((err = file_map(&arg[1], &raw.map)) < 0)
+			goto out;
+		raw.tx = raw.map.data;
+		raw.tx_len = raw.map.size;
+	} else {
+		if ((err = n = raw_parse(arg, raw.buf, RAW_BUF_SIZE)) < 0)
+			goto out;
+		raw.tx = raw.buf;
+		raw.tx_len = n;
+	}
+
+	raw.start = tstamp();
+	err = raw_loop(&raw, wait_ms);
+	raw_totals(&raw);
+
+	if (raw.map.data)
+		file_unmap(&raw.map);
+out:
+	free(raw.buf);
+	free(raw.rx);
+	return err;
+}
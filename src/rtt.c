@@ -0,0 +1,182 @@
+/*
+ * link round trip time model
+ *
+ * Timeouts are estimated from measured round trip time the same way as
+ * TCP retransmit timeout (RFC 6298), separately for each kind of
+ * transaction. Estimations are kept between runs in state file of the
+ * device.
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "rtt.h"
+#include "state.h"
+#include "transport.h"
+
+#ifndef O_BINARY
+# define O_BINARY	0
+#endif
+
+#define RTT_ALPHA		0.125
+#define RTT_BETA		0.25
+#define RTT_K			4
+/* clock granularity */
+#define RTT_G			0.001
+
+#define RTT_MODEL(n, initial, lo, hi) \
+	{ .name = n, .rto = initial, .min = lo, .max = hi }
+
+/*
+ * Replies of known size are read exactly, so low bound of their timeout
+ * costs nothing until reply is lost and keeps slow FC scheduling of MSP
+ * task from false timeouts. CLI model is for the first byte of output
+ * only, its tail is drained with fixed timeout.
+ */
+static rtt_t rtt_models[RTT_COUNT] = {
+	[RTT_MSP]	 = RTT_MODEL("msp",   0.2, 0.05, 1.0),
+	[RTT_CLI]	 = RTT_MODEL("cli",   0.2, 0.03, 1.0),
+	[RTT_4WAY_READ]	 = RTT_MODEL("read",  1.0, 0.1, 2.0),
+	[RTT_4WAY_WRITE] = RTT_MODEL("write", 1.0, 0.1, 2.0),
+	[RTT_4WAY_ERASE] = RTT_MODEL("erase", 1.0, 0.2, 5.0),
+	[RTT_4WAY_CTRL]	 = RTT_MODEL("ctrl",  1.0, 0.1, 2.0),
+};
+
+rtt_t *rtt_model(int id)
+{
+	return &rtt_models[id];
+}
+
+static double rtt_clamp(const rtt_t *r, double t)
+{
+	if (t < r->min)
+		return r->min;
+	if (t > r->max)
+		return r->max;
+	return t;
+}
+
+/*
+ * Account round trip time of successful transaction
+ */
+void rtt_update(rtt_t *r, double sample)
+{
+	double var;
+
+	if (r->samples == 0) {
+		r->srtt = sample;
+		r->rttvar = sample / 2;
+	} else {
+		var = r->srtt - sample;
+		if (var < 0)
+			var = -var;
+		r->rttvar = (1 - RTT_BETA) * r->rttvar + RTT_BETA * var;
+		r->srtt = (1 - RTT_ALPHA) * r->srtt + RTT_ALPHA * sample;
+	}
+	r->samples++;
+
+	var = RTT_K * r->rttvar;
+	if (var < RTT_G)
+		var = RTT_G;
+
+	r->rto = rtt_clamp(r, r->srtt + var);
+}
+
+/*
+ * Transaction timed out, double timeout
+ */
+void rtt_backoff(rtt_t *r)
+{
+	r->timeouts++;
+	r->rto = rtt_clamp(r, r->rto * 2);
+}
+
+int rtt_set_timeout(serial_handle fd, int id)
+{
+	return transport_set_timeout(fd, rtt_models[id].rto);
+}
+
+/*****************************************************************************/
+
+struct rtt_rec {
+	double srtt;
+	double rttvar;
+	double rto;
+	unsigned int samples;
+} __attribute__((__packed__));
+
+int rtt_load(const char *dev)
+{
+	struct rtt_rec rec[RTT_COUNT];
+	char path[512];
+	int fl, n, i;
+
+	if (state_path(path, sizeof(path), dev, "rtt") < 0)
+		return -1;
+
+	fl = open(path, O_RDONLY | O_BINARY);
+	if (fl < 0)
+		return -1;
+
+	n = read(fl, rec, sizeof(rec));
+	close(fl);
+	if (n != sizeof(rec))
+		return -1;
+
+	for (i = 0; i < RTT_COUNT; i++) {
+		rtt_t *r = &rtt_models[i];
+
+		if (!rec[i].samples)
+			continue;
+		r->srtt = rec[i].srtt;
+		r->rttvar = rec[i].rttvar;
+		r->rto = rtt_clamp(r, rec[i].rto);
+		/* keep history short, so a new link adapts fast */
+		r->samples = 1;
+	}
+	return 0;
+}
+
+int rtt_save(const char *dev)
+{
+	struct rtt_rec rec[RTT_COUNT];
+	char path[512];
+	int fl, n, i;
+
+	for (i = 0; i < RTT_COUNT; i++) {
+		rec[i].srtt = rtt_models[i].srtt;
+		rec[i].rttvar = rtt_models[i].rttvar;
+		rec[i].rto = rtt_models[i].rto;
+		rec[i].samples = rtt_models[i].samples;
+	}
+
+	if (state_path(path, sizeof(path), dev, "rtt") < 0)
+		return -1;
+
+	fl = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+	if (fl < 0)
+		return -1;
+
+	n = write(fl, rec, sizeof(rec));
+	close(fl);
+
+	return n == sizeof(rec) ? 0 : -1;
+}
+
+void rtt_printf(void)
+{
+	int i;
+
+	printf("Link timeouts:\n");
+	for (i = 0; i < RTT_COUNT; i++) {
+		rtt_t *r = &rtt_models[i];
+		printf("\t%-6s srtt %7.2f ms, rttvar %7.2f ms, timeout %7.2f ms,"
+			" samples %u, timeouts %u\n", r->name,
+			r->srtt * 1000, r->rttvar * 1000, r->rto * 1000,
+			r->samples, r->timeouts);
+	}
+}
@@ -0,0 +1,79 @@
+/*
+ * per device state files
+ *
+ * State files live in $HOME/.bfctl (%APPDATA%\.bfctl on Windows), named
+ * after the device, so journals and caches of different ports do not mix.
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "state.h"
+
+#ifdef __MINGW32__
+# define state_mkdir(p)		mkdir(p)
+#else
+# define state_mkdir(p)		mkdir(p, 0755)
+#endif
+
+static const char *state_home(void)
+{
+	const char *home;
+
+#ifdef __MINGW32__
+	if ((home = getenv("APPDATA")) != NULL)
+		return home;
+	if ((home = getenv("USERPROFILE")) != NULL)
+		return home;
+#else
+	if ((home = getenv("HOME")) != NULL)
+		return home;
+#endif
+	return ".";
+}
+
+/*
+ * Make state file path for device, e.g. /dev/ttyACM0 and esc0.journal
+ * gives $HOME/.bfctl/dev_ttyACM0-esc0.journal
+ */
+int state_path(char *path, int len, const char *dev, const char *name)
+{
+	char id[128];
+	int i, n;
+
+	/* skip leading separators and windows prefix \\.\ */
+	while (*dev == '/' || *dev == '\\' || *dev == '.')
+		dev++;
+
+	for (i = 0; dev[i] && i < sizeof(id) - 1; i++) {
+		char c = dev[i];
+		if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+		    (c >= '0' && c <= '9') || c == '-' || c == '.')
+			id[i] = c;
+		else
+			id[i] = '_';
+	}
+	id[i] = '\0';
+
+	n = snprintf(path, len, "%s/%s", state_home(), STATE_DIR_NAME);
+	if (n >= len)
+		return -1;
+
+	if (state_mkdir(path) < 0 && errno != EEXIST) {
+		fprintf(stderr, "Can't create state directory %s, %s\n",
+				path, strerror(errno));
+		return -1;
+	}
+
+	n = snprintf(path, len, "%s/%s/%s-%s", state_home(), STATE_DIR_NAME, id, name);
+	if (n >= len)
+		return -1;
+
+	return 0;
+}
@@ -0,0 +1,429 @@
+/*
+ * link transport
+ *
+ * MSP, 4way and raw traffic goes through link handle, which is serial
+ * port, tcp connection (Betaflight SITL serves MSP on tcp port 5761,
+ * network bridges) or pseudo terminal. Backend of handle is found in
+ * table of open links, handles which are not there are serial ports.
+ *
+ * 2025 Andrey Mitrofanov <avmwww@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "serial.h"
+#include "transport.h"
+
+#ifndef __MINGW32__
+#include <poll.h>
+#include <termios.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+typedef struct transport transport_t;
+
+typedef struct transport_ops {
+	const char *name;
+	serial_handle (*open)(transport_t *t, const char *dev);
+	int (*setup)(transport_t *t, unsigned int baud);
+	int (*set_timeout)(transport_t *t, double tmo);
+	int (*read)(transport_t *t, void *buf, int len);
+	int (*write)(transport_t *t, const void *buf, int len);
+	int (*close)(transport_t *t);
+} transport_ops_t;
+
+struct transport {
+	const transport_ops_t *ops;
+	serial_handle fd;
+	bool used;
+	/* read timeout of stream links, seconds */
+	double timeout;
+};
+
+static transport_t transport_list[TRANSPORT_OPEN_MAX];
+
+/*****************************************************************************/
+
+static serial_handle transport_serial_open(transport_t *t, const char *dev)
+{
+	return serial_open(dev);
+}
+
+static int transport_serial_setup(transport_t *t, unsigned int baud)
+{
+	return serial_setup(t->fd, baud);
+}
+
+static int transport_serial_set_timeout(transport_t *t, double tmo)
+{
+	return serial_set_timeout(t->fd, tmo);
+}
+
+static int transport_serial_read(transport_t *t, void *buf, int len)
+{
+	return serial_read(t->fd, buf, len);
+}
+
+static int transport_serial_write(transport_t *t, const void *buf, int len)
+{
+	return serial_write(t->fd, buf, len);
+}
+
+static int transport_serial_close(transport_t *t)
+{
+	return serial_close(t->fd);
+}
+
+static const transport_ops_t transport_serial = {
+	.name = "serial",
+	.open = transport_serial_open,
+	.setup = transport_serial_setup,
+	.set_timeout = transport_serial_set_timeout,
+	.read = transport_serial_read,
+	.write = transport_serial_write,
+	.close = transport_serial_close,
+};
+
+/*****************************************************************************/
+
+#ifndef __MINGW32__
+/*
+ * Stream links have no baud rate
+ */
+static int transport_stream_setup(transport_t *t, unsigned int baud)
+{
+	return 0;
+}
+
+static int transport_stream_set_timeout(transport_t *t, double tmo)
+{
+	t->timeout = tmo;
+	return 0;
+}
+
+/*
+ * Read up to len bytes, stop when nothing comes in timeout, the same as
+ * serial port does
+ */
+static int transport_stream_read(transport_t *t, void *buf, int len)
+{
+	struct pollfd pfd = {.fd = t->fd, .events = POLLIN};
+	uint8_t *p = buf;
+	int n, rd = 0;
+
+	while (rd < len) {
+		n = poll(&pfd, 1, t->timeout * 1000);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (n == 0)
+			break;
+
+		n = read(t->fd, p + rd, len - rd);
+		if (n < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return rd ? rd : -1;
+		}
+		if (n == 0) {
+			/* peer closed connection */
+			if (rd)
+				break;
+			errno = ECONNRESET;
+			return -1;
+		}
+		rd += n;
+	}
+	return rd;
+}
+
+/*
+ * Write all, socket is written with send, so closed connection is an
+ * error and not SIGPIPE
+ */
+static int transport_stream_write(transport_t *t, const void *buf, int len, bool sock)
+{
+	const uint8_t *p = buf;
+	int n, wr = 0;
+
+	while (wr < len) {
+		n = sock ? send(t->fd, p + wr, len - wr, MSG_NOSIGNAL) :
+			   write(t->fd, p + wr, len - wr);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return wr ? wr : -1;
+		}
+		wr += n;
+	}
+	return wr;
+}
+
+static int transport_tcp_write(transport_t *t, const void *buf, int len)
+{
+	return transport_stream_write(t, buf, len, true);
+}
+
+static int transport_pty_write(transport_t *t, const void *buf, int len)
+{
+	return transport_stream_write(t, buf, len, false);
+}
+
+static int transport_stream_close(transport_t *t)
+{
+	return close(t->fd);
+}
+
+/*
+ * tcp://host:port
+ */
+static serial_handle transport_tcp_open(transport_t *t, const char *dev)
+{
+	struct addrinfo hints, *res, *ai;
+	char host[256], *port;
+	int fd = -1, on = 1, err;
+
+	snprintf(host, sizeof(host), "%s", dev);
+	port = strrchr(host, ':');
+	if (!port) {
+		fprintf(stderr, "Invalid tcp device %s, tcp://host:port\n", dev);
+		errno = EINVAL;
+		return -1;
+	}
+	*port++ = '\0';
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if ((err = getaddrinfo(host, port, &hints, &res)) != 0) {
+		fprintf(stderr, "Can't resolve %s, %s\n", host, gai_strerror(err));
+		errno = EHOSTUNREACH;
+		return -1;
+	}
+
+	for (ai = res; ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0)
+			continue;
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		err = errno;
+		close(fd);
+		fd = -1;
+		errno = err;
+	}
+	freeaddrinfo(res);
+
+	if (fd < 0)
+		return -1;
+
+	/* MSP is request and reply, don't hold small frames */
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	return fd;
+}
+
+static const transport_ops_t transport_tcp = {
+	.name = "tcp",
+	.open = transport_tcp_open,
+	.setup = transport_stream_setup,
+	.set_timeout = transport_stream_set_timeout,
+	.read = transport_stream_read,
+	.write = transport_tcp_write,
+	.close = transport_stream_close,
+};
+
+/*
+ * Pseudo terminal, SITL or simulator behind socat, raw mode and no baud
+ * rate, which pty may not accept
+ */
+static serial_handle transport_pty_open(transport_t *t, const char *dev)
+{
+	struct termios tio;
+	int fd;
+
+	fd = open(dev, O_RDWR | O_NOCTTY);
+	if (fd < 0)
+		return -1;
+
+	if (tcgetattr(fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+	return fd;
+}
+
+static const transport_ops_t transport_pty = {
+	.name = "pty",
+	.open = transport_pty_open,
+	.setup = transport_stream_setup,
+	.set_timeout = transport_stream_set_timeout,
+	.read = transport_stream_read,
+	.write = transport_pty_write,
+	.close = transport_stream_close,
+};
+#endif
+
+/*****************************************************************************/
+
+static transport_t *transport_find(serial_handle fd)
+{
+	int i;
+
+	for (i = 0; i < TRANSPORT_OPEN_MAX; i++) {
+		if (transport_list[i].used && transport_list[i].fd == fd)
+			return &transport_list[i];
+	}
+	return NULL;
+}
+
+static const transport_ops_t *transport_ops(const char *dev, const char **name)
+{
+	*name = dev;
+
+#ifndef __MINGW32__
+	if (!strncmp(dev, "tcp://", 6)) {
+		*name = dev + 6;
+		return &transport_tcp;
+	}
+	if (!strncmp(dev, "pty:", 4)) {
+		*name = dev + 4;
+		return &transport_pty;
+	}
+	if (!strncmp(dev, "/dev/pts/", 9))
+		return &transport_pty;
+#else
+	if (!strncmp(dev, "tcp://", 6) || !strncmp(dev, "pty:", 4)) {
+		fprintf(stderr, "%s is not supported on Windows\n", dev);
+		return NULL;
+	}
+#endif
+	return &transport_serial;
+}
+
+serial_handle transport_open(const char *dev)
+{
+	const transport_ops_t *ops;
+	const char *name;
+	transport_t *t = NULL;
+	int i;
+
+	if (!(ops = transport_ops(dev, &name))) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (i = 0; i < TRANSPORT_OPEN_MAX; i++) {
+		if (!transport_list[i].used) {
+			t = &transport_list[i];
+			break;
+		}
+	}
+	if (!t) {
+		errno = EMFILE;
+		return -1;
+	}
+
+	t->ops = ops;
+	t->timeout = TRANSPORT_TIMEOUT_DEFAULT;
+	if ((t->fd = ops->open(t, name)) < 0)
+		return t->fd;
+
+	t->used = true;
+	return t->fd;
+}
+
+int transport_setup(serial_handle fd, unsigned int baud)
+{
+	transport_t *t = transport_find(fd);
+
+	return t ? t->ops->setup(t, baud) : serial_setup(fd, baud);
+}
+
+int transport_set_timeout(serial_handle fd, double tmo)
+{
+	transport_t *t = transport_find(fd);
+
+	return t ? t->ops->set_timeout(t, tmo) : serial_set_timeout(fd, tmo);
+}
+
+int transport_read(serial_handle fd, void *buf, int len)
+{
+	transport_t *t = transport_find(fd);
+
+	return t ? t->ops->read(t, buf, len) : serial_read(fd, buf, len);
+}
+
+int transport_write(serial_handle fd, const void *buf, int len)
+{
+	transport_t *t = transport_find(fd);
+
+	return t ? t->ops->write(t, buf, len) : serial_write(fd, buf, len);
+}
+
+int transport_close(serial_handle fd)
+{
+	transport_t *t = transport_find(fd);
+
+	if (!t)
+		return serial_close(fd);
+
+	t->used = false;
+	return t->ops->close(t);
+}
+
+const char *transport_name(serial_handle fd)
+{
+	transport_t *t = transport_find(fd);
+
+	return t ? t->ops->name : transport_serial.name;
+}
+
+#ifndef __MINGW32__
+/*
+ * Handles of all backends are descriptors
+ */
+int transport_fd(serial_handle fd)
+{
+	return fd;
+}
+
+int transport_poll(serial_handle fd, double tmo)
+{
+	struct pollfd pfd = {.fd = transport_fd(fd), .events = POLLIN};
+	int n;
+
+	if ((n = poll(&pfd, 1, tmo < 0 ? -1 : tmo * 1000)) <= 0)
+		return n;
+	if (!(pfd.revents & POLLIN)) {
+		errno = EIO;
+		return -1;
+	}
+	return 1;
+}
+#else
+int transport_fd(serial_handle fd)
+{
+	return -1;
+}
+
+/*
+ * No poll for serial handles, the next read waits up to tmo instead
+ */
+int transport_poll(serial_handle fd, double tmo)
+{
+	transport_set_timeout(fd, tmo);
+	return 1;
+}
+#endif